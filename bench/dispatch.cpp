@@ -0,0 +1,134 @@
+/**
+ * @file dispatch.cpp
+ * @brief This file contains a microbenchmark of the event dispatch in the coroutine server's loop.
+ *
+ * Every event in Server::loop() looks up the awaitable waiting on the socket, clears its entry,
+ * and resumes the coroutine, which registers itself again when it awaits the next event.
+ * This program replays that pattern over a set of sockets with the former std::map table
+ * and with the fd-indexed vector, and reports the cost per event of each one.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+struct Awaitable
+{
+    unsigned long resumed = 0;
+};
+
+/**
+ * @brief Handler table based on a balanced tree, as used before.
+ */
+struct MapTable
+{
+    map<int, Awaitable *> handlers;
+
+    void insert(int fd, Awaitable *awaitable) { handlers[fd] = awaitable; }
+
+    Awaitable *take(int fd)
+    {
+        auto it = handlers.find(fd);
+
+        if (it == handlers.end())
+            return nullptr;
+
+        auto awaitable = it->second;
+        handlers.erase(it);
+        return awaitable;
+    }
+};
+
+/**
+ * @brief Handler table indexed by file descriptor, as used by Server.
+ */
+struct VectorTable
+{
+    vector<Awaitable *> handlers;
+
+    void insert(int fd, Awaitable *awaitable)
+    {
+        if ((size_t)fd >= handlers.size())
+            handlers.resize(max<size_t>(fd + 1, handlers.size() * 2));
+
+        handlers[fd] = awaitable;
+    }
+
+    Awaitable *take(int fd)
+    {
+        if ((size_t)fd >= handlers.size())
+            return nullptr;
+
+        auto awaitable = handlers[fd];
+        handlers[fd] = nullptr;
+        return awaitable;
+    }
+};
+
+/**
+ * @brief Replays the events on the table and measures the cost per event.
+ *
+ * @param table The handler table.
+ * @param awaitables The awaitables, one per socket.
+ * @param events The sequence of sockets that become ready.
+ *
+ * @return The function returns the average time per event, in nanoseconds.
+ */
+template <typename Table>
+static double run(Table &table, vector<Awaitable> &awaitables, const vector<int> &events)
+{
+    for (size_t fd = 0; fd < awaitables.size(); fd++)
+        table.insert(fd, &awaitables[fd]);
+
+    auto start = chrono::steady_clock::now();
+
+    for (int fd : events)
+    {
+        auto awaitable = table.take(fd);
+        awaitable->resumed++;
+        table.insert(fd, awaitable);
+    }
+
+    auto elapsed = chrono::steady_clock::now() - start;
+    return (double)chrono::duration_cast<chrono::nanoseconds>(elapsed).count() / events.size();
+}
+
+int main(int argc, char *argv[])
+{
+    size_t sockets = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000;
+    size_t nEvents = argc > 2 ? strtoul(argv[2], NULL, 10) : 10000000;
+
+    if (sockets < 1 || nEvents < 1)
+    {
+        cerr << "Usage: " << argv[0] << " [sockets] [events]\n";
+        return 1;
+    }
+
+    // File descriptors start after the standard streams and the listening socket.
+    vector<int> events(nEvents);
+    mt19937 random(42);
+    uniform_int_distribution<int> distribution(4, sockets + 3);
+
+    for (auto &fd : events)
+        fd = distribution(random);
+
+    vector<Awaitable> awaitables(sockets + 4);
+    MapTable mapTable;
+    VectorTable vectorTable;
+
+    double mapCost = run(mapTable, awaitables, events);
+    double vectorCost = run(vectorTable, awaitables, events);
+
+    cout << "sockets: " << sockets << ", events: " << nEvents << "\n";
+    cout << "std::map:     " << mapCost << " ns/event\n";
+    cout << "std::vector:  " << vectorCost << " ns/event\n";
+    cout << "speedup:      " << mapCost / vectorCost << "x\n";
+}
@@ -0,0 +1,540 @@
+/**
+ * @file load.cpp
+ * @brief This file contains a load generator that measures the throughput and latency of the servers.
+ *
+ * Every thread keeps its share of the concurrent connections busy with non-blocking sockets and poll().
+ * A connection connects, sends its payload, shuts its side down, and waits until the server closes it,
+ * which happens once the server has received everything. The time from connect() to that point is the
+ * latency of the connection. At the end, the program reports connections per second, megabytes per second,
+ * and the latency percentiles.
+ *
+ * With --server, the program starts each given server binary on its own port, runs the same load against it,
+ * stops it, and moves on to the next one, so the servers can be compared back to back.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+using Clock = chrono::steady_clock;
+
+#define POLL_MILLIS 100
+#define START_MILLIS 5000
+
+struct Config
+{
+    unsigned port = 0;
+    unsigned threads = 1;
+    unsigned connections = 64;
+    unsigned long total = 10000;
+    double duration = 0;
+    size_t size = 1024;
+    double rate = 0;
+    bool csv = false;
+    vector<string> servers;
+    string serverArgs;
+};
+
+struct Result
+{
+    unsigned long completed = 0;
+    unsigned long errors = 0;
+    unsigned long long bytes = 0;
+    vector<uint32_t> latencies; // Microseconds per connection.
+};
+
+enum class State
+{
+    Idle,
+    Connecting,
+    Sending,
+    Draining,
+};
+
+struct Connection
+{
+    int fd = -1;
+    State state = State::Idle;
+    size_t sent = 0;
+    Clock::time_point start;
+};
+
+/**
+ * @brief Prints the usage message and exits.
+ *
+ * @param program The name of the program.
+ */
+[[noreturn]] static void usage(const char *program)
+{
+    cerr << "Usage: " << program << " [--threads N] [--connections N] [--total N | --duration SECONDS] [--size BYTES] [--rate CONN/S] [--csv] [--server PATH]... [--server-args ARGS] <port>\n";
+    exit(1);
+}
+
+/**
+ * @brief Retrieves the configuration from the command-line arguments.
+ *
+ * @param argc The number of command-line arguments.
+ * @param argv The array of command-line arguments.
+ *
+ * @return The function returns the validated configuration.
+ */
+static Config getConfig(int argc, char *argv[])
+{
+    static const struct option longOptions[] = {
+        {"threads", required_argument, NULL, 't'},
+        {"connections", required_argument, NULL, 'c'},
+        {"total", required_argument, NULL, 'n'},
+        {"duration", required_argument, NULL, 'd'},
+        {"size", required_argument, NULL, 's'},
+        {"rate", required_argument, NULL, 'r'},
+        {"csv", no_argument, NULL, 'v'},
+        {"server", required_argument, NULL, 'S'},
+        {"server-args", required_argument, NULL, 'A'},
+        {NULL, 0, NULL, 0},
+    };
+
+    Config config;
+
+    for (int opt; (opt = getopt_long(argc, argv, "t:c:n:d:s:r:vS:A:", longOptions, NULL)) != -1;)
+    {
+        switch (opt)
+        {
+        case 't':
+            config.threads = strtoul(optarg, NULL, 10);
+            break;
+
+        case 'c':
+            config.connections = strtoul(optarg, NULL, 10);
+            break;
+
+        case 'n':
+            config.total = strtoul(optarg, NULL, 10);
+            config.duration = 0;
+            break;
+
+        case 'd':
+            config.duration = strtod(optarg, NULL);
+            config.total = 0;
+            break;
+
+        case 's':
+            config.size = strtoul(optarg, NULL, 10);
+            break;
+
+        case 'r':
+            config.rate = strtod(optarg, NULL);
+            break;
+
+        case 'v':
+            config.csv = true;
+            break;
+
+        case 'S':
+            config.servers.push_back(optarg);
+            break;
+
+        case 'A':
+            config.serverArgs = optarg;
+            break;
+
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (argc - optind != 1)
+        usage(argv[0]);
+
+    config.port = strtoul(argv[optind], NULL, 10);
+
+    if (config.port < 1 || config.port > 65535 || config.threads < 1 || config.connections < config.threads || (config.total == 0 && config.duration <= 0))
+    {
+        cerr << "Invalid configuration. The port must be between 1 and 65535, and every thread needs at least one connection.\n";
+        exit(1);
+    }
+
+    return config;
+}
+
+/**
+ * @brief Starts a non-blocking connection to the server.
+ *
+ * @param addr The address of the server.
+ * @param conn The connection slot.
+ *
+ * @return The function returns true if the connection is in progress or established.
+ */
+static bool startConnection(const sockaddr_in &addr, Connection &conn)
+{
+    conn.fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (conn.fd == -1)
+        return false;
+
+    fcntl(conn.fd, F_SETFL, fcntl(conn.fd, F_GETFL) | O_NONBLOCK);
+    conn.start = Clock::now();
+    conn.sent = 0;
+
+    if (connect(conn.fd, (const sockaddr *)&addr, sizeof(addr)) == 0)
+        conn.state = State::Sending;
+    else if (errno == EINPROGRESS)
+        conn.state = State::Connecting;
+    else
+    {
+        close(conn.fd);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Closes a connection and frees its slot.
+ *
+ * The connection is reset instead of closed gracefully, since both sides are done by then,
+ * so that thousands of connections do not leave the client's ports in TIME_WAIT.
+ *
+ * @param conn The connection slot.
+ */
+static void closeConnection(Connection &conn)
+{
+    struct linger reset = {1, 0};
+    setsockopt(conn.fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+    close(conn.fd);
+    conn.fd = -1;
+    conn.state = State::Idle;
+}
+
+/**
+ * @brief Advances a connection after poll() reports it ready.
+ *
+ * @param conn The connection slot.
+ * @param payload The data to send.
+ * @param result The results of the thread, updated when the connection finishes.
+ */
+static void progress(Connection &conn, const string &payload, Result &result)
+{
+    if (conn.state == State::Connecting)
+    {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+
+        if (error != 0)
+        {
+            result.errors++;
+            closeConnection(conn);
+            return;
+        }
+
+        conn.state = State::Sending;
+    }
+
+    if (conn.state == State::Sending)
+    {
+        while (conn.sent < payload.size())
+        {
+            ssize_t n = write(conn.fd, payload.data() + conn.sent, payload.size() - conn.sent);
+
+            if (n == -1)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    return;
+
+                result.errors++;
+                closeConnection(conn);
+                return;
+            }
+
+            conn.sent += n;
+        }
+
+        shutdown(conn.fd, SHUT_WR);
+        conn.state = State::Draining;
+        return;
+    }
+
+    // Draining: the server closes the connection once it has read everything.
+    char discard[512];
+    ssize_t n;
+
+    while ((n = read(conn.fd, discard, sizeof(discard))) > 0)
+        ;
+
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return;
+
+    if (n == 0)
+    {
+        auto latency = chrono::duration_cast<chrono::microseconds>(Clock::now() - conn.start).count();
+        result.latencies.push_back(min<long long>(latency, UINT32_MAX));
+        result.bytes += conn.sent;
+        result.completed++;
+    }
+    else
+        result.errors++;
+
+    closeConnection(conn);
+}
+
+/**
+ * @brief Runs the share of the load of one thread.
+ *
+ * @param config The configuration.
+ * @param addr The address of the server.
+ * @param slots The number of concurrent connections of the thread.
+ * @param remaining The number of connections left to start, shared by all the threads, if the load is limited by count.
+ * @param end The time at which no more connections are started, if the load is limited by time.
+ * @param result The results of the thread.
+ */
+static void worker(const Config &config, const sockaddr_in &addr, unsigned slots, atomic<long> &remaining, Clock::time_point end, Result &result)
+{
+    string payload(config.size, 'x');
+    vector<Connection> conns(slots);
+    vector<pollfd> fds;
+    vector<Connection *> polled;
+    auto interval = chrono::duration_cast<Clock::duration>(chrono::duration<double>(config.rate > 0 ? config.threads / config.rate : 0));
+    auto nextStart = Clock::now();
+    bool starting = true;
+
+    while (true)
+    {
+        auto now = Clock::now();
+
+        if (config.duration > 0 && now >= end)
+            starting = false;
+
+        for (auto &conn : conns)
+        {
+            if (!starting || conn.state != State::Idle || (config.rate > 0 && now < nextStart))
+                continue;
+
+            if (config.total > 0 && remaining.fetch_sub(1, memory_order_relaxed) <= 0)
+            {
+                starting = false;
+                break;
+            }
+
+            if (!startConnection(addr, conn))
+                result.errors++;
+
+            nextStart += interval;
+        }
+
+        fds.clear();
+        polled.clear();
+
+        for (auto &conn : conns)
+        {
+            if (conn.state == State::Idle)
+                continue;
+
+            fds.push_back({conn.fd, (short)(conn.state == State::Draining ? POLLIN : POLLOUT), 0});
+            polled.push_back(&conn);
+        }
+
+        if (fds.empty() && !starting)
+            break;
+
+        int timeout = POLL_MILLIS;
+
+        if (starting && config.rate > 0)
+            timeout = max<long long>(0, min<long long>(timeout, chrono::duration_cast<chrono::milliseconds>(nextStart - Clock::now()).count()));
+
+        if (poll(fds.data(), fds.size(), timeout) <= 0)
+            continue;
+
+        for (size_t i = 0; i < fds.size(); i++)
+            if (fds[i].revents != 0)
+                progress(*polled[i], payload, result);
+    }
+}
+
+/**
+ * @brief Runs the load against a server and reports the results.
+ *
+ * @param config The configuration.
+ * @param port The port of the server.
+ * @param name The name of the server in the report.
+ */
+static void bench(const Config &config, unsigned port, const string &name)
+{
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    atomic<long> remaining(config.total);
+    vector<Result> results(config.threads);
+    vector<thread> threads;
+    auto start = Clock::now();
+    auto end = start + chrono::duration_cast<Clock::duration>(chrono::duration<double>(config.duration));
+
+    for (unsigned i = 0; i < config.threads; i++)
+    {
+        unsigned slots = config.connections / config.threads + (i < config.connections % config.threads ? 1 : 0);
+        threads.emplace_back(worker, cref(config), cref(addr), slots, ref(remaining), end, ref(results[i]));
+    }
+
+    for (auto &t : threads)
+        t.join();
+
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    Result total;
+
+    for (auto &result : results)
+    {
+        total.completed += result.completed;
+        total.errors += result.errors;
+        total.bytes += result.bytes;
+        total.latencies.insert(total.latencies.end(), result.latencies.begin(), result.latencies.end());
+    }
+
+    sort(total.latencies.begin(), total.latencies.end());
+
+    auto percentile = [&total](double p) -> unsigned long {
+        return total.latencies.empty() ? 0 : total.latencies[(size_t)(p * (total.latencies.size() - 1))];
+    };
+
+    double connRate = total.completed / seconds;
+    double megabytes = total.bytes / seconds / 1e6;
+
+    if (config.csv)
+        printf("%s,%lu,%lu,%.3f,%.0f,%.2f,%lu,%lu,%lu\n", name.c_str(), total.completed, total.errors, seconds, connRate, megabytes, percentile(0.5), percentile(0.99), percentile(0.999));
+    else
+    {
+        printf("%s\n", name.c_str());
+        printf("  connections: %lu completed, %lu errors in %.3f s\n", total.completed, total.errors, seconds);
+        printf("  throughput:  %.0f conn/s, %.2f MB/s\n", connRate, megabytes);
+        printf("  latency:     p50 %lu us, p99 %lu us, p999 %lu us\n", percentile(0.5), percentile(0.99), percentile(0.999));
+    }
+
+    fflush(stdout);
+}
+
+/**
+ * @brief Starts a server binary on the specified port, discarding its output.
+ *
+ * @param path The path of the server binary.
+ * @param args Extra arguments for the server, separated by spaces.
+ * @param port The port on which the server listens.
+ *
+ * @return The function returns the process ID of the server, or -1 if it did not start listening in time.
+ */
+static pid_t startServer(const string &path, const string &args, unsigned port)
+{
+    vector<string> words;
+    istringstream stream(args);
+
+    for (string word; stream >> word;)
+        words.push_back(word);
+
+    words.push_back(to_string(port));
+
+    pid_t pid = fork();
+
+    if (pid == 0)
+    {
+        vector<char *> argv = {(char *)path.c_str()};
+
+        for (auto &word : words)
+            argv.push_back(word.data());
+
+        argv.push_back(nullptr);
+
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        execv(path.c_str(), argv.data());
+        perror("execv");
+        _exit(127);
+    }
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    for (auto deadline = Clock::now() + chrono::milliseconds(START_MILLIS); Clock::now() < deadline; this_thread::sleep_for(chrono::milliseconds(10)))
+    {
+        int sock = socket(AF_INET, SOCK_STREAM, 0);
+        bool ready = connect(sock, (const sockaddr *)&addr, sizeof(addr)) == 0;
+        close(sock);
+
+        if (ready)
+            return pid;
+
+        if (waitpid(pid, NULL, WNOHANG) == pid)
+            return -1;
+    }
+
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+/**
+ * @brief The entry point of the load generator.
+ *
+ * Without --server, the load runs against a server already listening on the given port.
+ * With --server, every server is started in turn on the given port plus its position in the list.
+ *
+ * @param argc The number of command-line arguments.
+ * @param argv The array of command-line arguments.
+ *
+ * @return The function returns 0 on success, or 1 if a server could not be started.
+ */
+int main(int argc, char *argv[])
+{
+    Config config = getConfig(argc, argv);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (config.csv)
+        printf("server,connections,errors,seconds,conn_per_s,mb_per_s,p50_us,p99_us,p999_us\n");
+
+    if (config.servers.empty())
+    {
+        bench(config, config.port, "127.0.0.1:" + to_string(config.port));
+        return 0;
+    }
+
+    for (size_t i = 0; i < config.servers.size(); i++)
+    {
+        unsigned port = config.port + i;
+        pid_t pid = startServer(config.servers[i], config.serverArgs, port);
+
+        if (pid == -1)
+        {
+            cerr << "Error starting " << config.servers[i] << endl;
+            return 1;
+        }
+
+        bench(config, port, config.servers[i].substr(config.servers[i].find_last_of('/') + 1));
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+
+    return 0;
+}
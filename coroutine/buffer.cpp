@@ -0,0 +1,288 @@
+/**
+ * @file buffer.cpp
+ * @brief This file contains the implementation of the ChunkPool and Buffer classes.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#include "buffer.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+/**
+ * @brief Counts the chunks of a chain.
+ *
+ * @param head The first chunk of the chain.
+ * @param tail The last chunk of the chain.
+ *
+ * @return The function returns the number of chunks.
+ */
+static size_t chainLength(const ChunkPool::Chunk *head, const ChunkPool::Chunk *tail)
+{
+    size_t count = 1;
+
+    for (; head != tail; head = head->next)
+        count++;
+
+    return count;
+}
+
+ChunkPool::~ChunkPool()
+{
+    for (auto slab : slabs)
+        delete[] slab;
+}
+
+ChunkPool::Chunk *ChunkPool::get()
+{
+    if (freeChunks == nullptr)
+        freeChunks = remoteChunks.exchange(nullptr, memory_order_acquire);
+
+    if (freeChunks == nullptr)
+    {
+        Chunk *slab = new Chunk[SLAB_CHUNKS];
+
+        for (size_t i = 0; i < SLAB_CHUNKS; i++)
+            slab[i].next = i + 1 < SLAB_CHUNKS ? &slab[i + 1] : nullptr;
+
+        slabs.push_back(slab);
+        freeChunks = slab;
+    }
+
+    Chunk *chunk = freeChunks;
+    freeChunks = chunk->next;
+    chunk->next = nullptr;
+    chunk->size = 0;
+    chunk->refs.store(1, memory_order_relaxed);
+    used.fetch_add(1, memory_order_relaxed);
+    return chunk;
+}
+
+void ChunkPool::put(Chunk *head, Chunk *tail)
+{
+    used.fetch_sub(chainLength(head, tail), memory_order_relaxed);
+    tail->next = freeChunks;
+    freeChunks = head;
+}
+
+void ChunkPool::putRemote(Chunk *head, Chunk *tail)
+{
+    used.fetch_sub(chainLength(head, tail), memory_order_relaxed);
+    Chunk *top = remoteChunks.load(memory_order_relaxed);
+
+    do
+        tail->next = top;
+    while (!remoteChunks.compare_exchange_weak(top, head, memory_order_release, memory_order_relaxed));
+}
+
+void ChunkPool::release(Chunk *chunk)
+{
+    if (chunk->refs.fetch_sub(1, memory_order_acq_rel) == 1)
+        put(chunk, chunk);
+}
+
+void ChunkPool::releaseRemote(Chunk *head, Chunk *tail)
+{
+    Chunk *first = nullptr;
+    Chunk *last = nullptr;
+    Chunk *next;
+
+    for (auto chunk = head; chunk != nullptr; chunk = next)
+    {
+        // Once released, the chunk may be recycled by another holder, so its link is read first.
+        next = chunk != tail ? chunk->next : nullptr;
+
+        if (chunk->refs.fetch_sub(1, memory_order_acq_rel) == 1)
+        {
+            chunk->next = first;
+            first = chunk;
+
+            if (last == nullptr)
+                last = chunk;
+        }
+    }
+
+    if (first != nullptr)
+        putRemote(first, last);
+}
+
+void Buffer::append(const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        iovec iov[2];
+        int count = space(size, iov);
+        size_t n = 0;
+
+        for (int i = 0; i < count; i++)
+        {
+            memcpy(iov[i].iov_base, data + n, iov[i].iov_len);
+            n += iov[i].iov_len;
+        }
+
+        commit(n);
+        data += n;
+        size -= n;
+    }
+}
+
+int Buffer::space(size_t size, iovec iov[2])
+{
+    int count = 0;
+
+    if (file != nullptr)
+    {
+        if (!file->space(size, iov[0]))
+        {
+            cerr << "Error extending spill file" << endl;
+            return 0;
+        }
+
+        reserved = true;
+        return 1;
+    }
+
+    if (tail != nullptr && tail->size < sizeof(tail->data))
+    {
+        iov[count] = {tail->data + tail->size, min(size, sizeof(tail->data) - tail->size)};
+        size -= iov[count++].iov_len;
+        reserved = true;
+    }
+
+    if (size > 0)
+    {
+        if (spare == nullptr)
+            spare = pool.get();
+
+        iov[count++] = {spare->data, min(size, sizeof(spare->data))};
+    }
+
+    return count;
+}
+
+void Buffer::commit(size_t size)
+{
+    length += size;
+    reserved = false;
+
+    if (file != nullptr)
+    {
+        file->commit(size);
+        return;
+    }
+
+    if (tail != nullptr)
+    {
+        size_t n = min(size, sizeof(tail->data) - tail->size);
+        tail->size += n;
+        size -= n;
+    }
+
+    if (spare != nullptr)
+    {
+        if (size > 0)
+        {
+            if (tail != nullptr)
+                tail->next = spare;
+            else
+                head = spare;
+
+            tail = spare;
+            tail->size = size;
+        }
+        else
+            pool.put(spare, spare);
+
+        spare = nullptr;
+    }
+}
+
+void Buffer::iovecs(vector<iovec> &iov) const
+{
+    for (auto chunk = head; chunk != nullptr; chunk = chunk->next)
+        iov.push_back({chunk->data + (chunk == head ? offset : 0), chunk->size - (chunk == head ? offset : 0)});
+}
+
+void Buffer::detach(ChunkPool::Chunk *&first, ChunkPool::Chunk *&last)
+{
+    first = head;
+    last = tail;
+
+    if (reserved)
+    {
+        if (head == tail)
+        {
+            first = last = nullptr;
+            return;
+        }
+
+        for (last = head; last->next != tail; last = last->next)
+            ;
+
+        last->next = nullptr;
+        head = tail;
+        length = tail->size;
+        return;
+    }
+
+    head = tail = nullptr;
+    length = 0;
+}
+
+void Buffer::consume(size_t size)
+{
+    offset += size;
+    length -= size;
+
+    while (head != tail && offset >= head->size)
+    {
+        auto next = head->next;
+        offset -= head->size;
+        pool.release(head);
+        head = next;
+    }
+}
+
+void Buffer::clear()
+{
+    for (auto chunk = head, next = head; chunk != nullptr; chunk = next)
+    {
+        next = chunk->next;
+        pool.release(chunk);
+    }
+
+    if (spare != nullptr)
+        pool.put(spare, spare);
+
+    head = tail = spare = nullptr;
+    file.reset();
+    length = 0;
+    offset = 0;
+    reserved = false;
+}
+
+void Buffer::spill(const string &dir)
+{
+    auto spilled = make_unique<SpillFile>(dir);
+
+    for (auto chunk = head; chunk != nullptr; chunk = chunk->next)
+        spilled->write(chunk->data + (chunk == head ? offset : 0), chunk->size - (chunk == head ? offset : 0));
+
+    size_t size = length;
+    clear();
+    file = std::move(spilled);
+    length = size;
+}
+
+int Buffer::release(size_t &size)
+{
+    int fd = file->release();
+    size = length;
+    file.reset();
+    length = 0;
+    return fd;
+}
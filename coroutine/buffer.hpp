@@ -0,0 +1,241 @@
+/**
+ * @file buffer.hpp
+ * @brief This file contains the declaration of the ChunkPool and Buffer classes.
+ *
+ * A Buffer stores the data received from a connection as a chain of fixed-size chunks,
+ * so appending never moves the data already stored. The chunks come from a ChunkPool,
+ * which carves them from slabs and recycles them through a free list. Every event loop owns its pool,
+ * but other threads, such as the output writer, may return chunks to it without locking.
+ * A chunk may be shared by a buffer and the records handed over from it, so it also counts its references,
+ * and it goes back to the pool when the last one is released.
+ * The pool counts the chunks taken from it and not returned yet, so that its owner knows how much memory its data holds.
+ * A buffer may also move its data to a spill file, which then receives the rest of it instead of the chunks.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+#include "spill.hpp"
+
+class ChunkPool
+{
+public:
+    static constexpr size_t CHUNK_SIZE = 16384;
+    static constexpr size_t SLAB_CHUNKS = 64;
+
+    struct Chunk
+    {
+        Chunk *next;
+        size_t size;
+        std::atomic<size_t> refs; // The number of references, 1 when the chunk is taken from the pool.
+        char data[CHUNK_SIZE - sizeof(Chunk *) - 2 * sizeof(size_t)];
+    };
+
+    ChunkPool() : freeChunks(nullptr), remoteChunks(nullptr), used(0) {}
+    ChunkPool(const ChunkPool &) = delete;
+    ChunkPool &operator=(const ChunkPool &) = delete;
+
+    /**
+     * @brief Destroys the pool and frees all the slabs.
+     *
+     * All the chunks must have been returned to the pool.
+     */
+    ~ChunkPool();
+
+    /**
+     * @brief Takes an empty chunk from the pool.
+     *
+     * If the pool has no free chunks, it first collects the chunks returned by other threads,
+     * and then allocates a new slab. Only the owner thread may call this function.
+     *
+     * @return The function returns an empty chunk.
+     */
+    Chunk *get();
+
+    /**
+     * @brief Returns a chain of chunks to the pool from the owner thread.
+     *
+     * @param head The first chunk of the chain.
+     * @param tail The last chunk of the chain.
+     */
+    void put(Chunk *head, Chunk *tail);
+
+    /**
+     * @brief Returns a chain of chunks to the pool from any thread.
+     *
+     * The chain is pushed to a lock-free list that the owner thread collects when it runs out of free chunks.
+     *
+     * @param head The first chunk of the chain.
+     * @param tail The last chunk of the chain.
+     */
+    void putRemote(Chunk *head, Chunk *tail);
+
+    /**
+     * @brief Adds a reference to a chunk. Only a thread that already holds a reference may call this function.
+     *
+     * @param chunk The chunk.
+     */
+    static void retain(Chunk *chunk) { chunk->refs.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     * @brief Releases a reference to a chunk from the owner thread, returning the chunk to the pool if it was the last one.
+     *
+     * @param chunk The chunk.
+     */
+    void release(Chunk *chunk);
+
+    /**
+     * @brief Releases a reference to every chunk of a chain from any thread, returning to the pool those that were the last one.
+     *
+     * The links between the chunks of the chain must not change while it is released, but the last chunk may still be
+     * linked to others by the owner thread, so its link is not followed.
+     *
+     * @param head The first chunk of the chain.
+     * @param tail The last chunk of the chain.
+     */
+    void releaseRemote(Chunk *head, Chunk *tail);
+
+    /**
+     * @brief Gets the memory held by the chunks taken from the pool and not returned yet. Any thread may call this function.
+     *
+     * @return The function returns the number of bytes.
+     */
+    size_t memory() const { return used.load(std::memory_order_relaxed) * CHUNK_SIZE; }
+
+private:
+    Chunk *freeChunks;
+    std::atomic<Chunk *> remoteChunks;
+    std::atomic<size_t> used; // Chunks taken from the pool and not returned yet.
+    std::vector<Chunk *> slabs;
+};
+
+class Buffer
+{
+    friend class Framer;
+
+public:
+    /**
+     * @brief Constructs an empty buffer that takes its chunks from the specified pool.
+     *
+     * @param pool The chunk pool. It must outlive the buffer.
+     */
+    Buffer(ChunkPool &pool) : pool(pool), head(nullptr), tail(nullptr), spare(nullptr), length(0), offset(0), reserved(false) {}
+    Buffer(const Buffer &) = delete;
+    Buffer &operator=(const Buffer &) = delete;
+
+    /**
+     * @brief Destroys the buffer and returns its chunks to the pool.
+     */
+    ~Buffer() { clear(); }
+
+    /**
+     * @brief Appends data to the buffer, linking new chunks as the last one fills up.
+     *
+     * @param data A pointer to the data to be appended.
+     * @param size The size of the data.
+     */
+    void append(const char *data, size_t size);
+
+    /**
+     * @brief Gets free space at the end of the buffer, so that data can be received in place with readv().
+     *
+     * The space is the free room of the last chunk, followed by an overflow region in a spare chunk from the pool
+     * if the last chunk has less room than requested. The data written there becomes part of the buffer after calling commit().
+     *
+     * If the buffer was spilled, the space is in the mapped segment of the spill file instead.
+     *
+     * @param size The number of bytes to reserve. Fewer bytes may be reserved if they would span more than two chunks.
+     * @param iov Output array that receives the I/O vectors.
+     *
+     * @return The function returns the number of I/O vectors filled, which is 0 if the spill file could not be extended.
+     */
+    int space(size_t size, iovec iov[2]);
+
+    /**
+     * @brief Marks the given number of bytes at the end of the buffer as used.
+     *
+     * It must be called after every call to space(), even with zero bytes, so that the overflow chunk
+     * is either linked to the buffer or returned to the pool.
+     *
+     * @param size The number of bytes written to the space returned by space().
+     */
+    void commit(size_t size);
+
+    /**
+     * @brief Exports the contents of the buffer as a vector of I/O buffers, one per chunk.
+     *
+     * @param iov The vector to which the I/O buffers are appended.
+     */
+    void iovecs(std::vector<iovec> &iov) const;
+
+    /**
+     * @brief Takes the chunks out of the buffer, leaving it empty.
+     *
+     * The caller becomes responsible for returning the chunks to the pool.
+     * If part of the last chunk was reserved by space() and has not been committed yet, for example because a receive
+     * is still in flight, that chunk stays in the buffer with its data, and only the chunks before it are taken.
+     *
+     * @param first Output parameter that receives the first chunk, or nullptr if the buffer is empty.
+     * @param last Output parameter that receives the last chunk, or nullptr if the buffer is empty.
+     */
+    void detach(ChunkPool::Chunk *&first, ChunkPool::Chunk *&last);
+
+    /**
+     * @brief Marks the given number of bytes at the front of the buffer as handed over, releasing the chunks left behind.
+     *
+     * The last chunk is kept even if it was handed over entirely, since it receives the next data.
+     *
+     * @param size The number of bytes. It must not exceed the size of the buffer.
+     */
+    void consume(size_t size);
+
+    /**
+     * @brief Releases the chunks and leaves the buffer empty.
+     *
+     * The chunks go back to the pool unless records handed over from the buffer still use them.
+     */
+    void clear();
+
+    /**
+     * @brief Moves the data of the buffer to a new spill file and returns its chunks to the pool.
+     *
+     * No space may be reserved by space() and not committed yet.
+     *
+     * @param dir The directory where the file is created.
+     *
+     * @throws runtime_error If the file cannot be created or written. The data stays in the buffer.
+     */
+    void spill(const std::string &dir);
+
+    /**
+     * @brief Takes the spill file out of the buffer, leaving it empty.
+     *
+     * @param size Output parameter that receives the size of the data in the file.
+     *
+     * @return The function returns the file descriptor, which the caller must close.
+     */
+    int release(size_t &size);
+
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    bool spilled() const { return file != nullptr; }
+    bool pending() const { return reserved; }
+
+private:
+    ChunkPool &pool;
+    ChunkPool::Chunk *head;
+    ChunkPool::Chunk *tail;
+    ChunkPool::Chunk *spare;
+    std::unique_ptr<SpillFile> file;
+    size_t length; // The number of bytes not handed over yet, from the offset of the head on, or in the spill file.
+    size_t offset; // The number of bytes of the head already handed over by consume().
+    bool reserved; // Whether space() reserved free room in the last chunk that has not been committed yet.
+};
@@ -0,0 +1,120 @@
+/**
+ * @file cpu.cpp
+ * @brief This file contains the implementation of the Cpu class.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "cpu.hpp"
+
+#ifdef __linux__
+#include <sched.h>
+#include <linux/filter.h>
+#endif
+
+using namespace std;
+
+// Parses a list of CPUs.
+
+vector<int> Cpu::parse(const string &list)
+{
+    vector<int> cpus;
+
+    for (const char *p = list.c_str();; p++)
+    {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+
+        if (end == p || first < 0)
+            return {};
+
+        if (*end == '-')
+        {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+
+            if (end == p || last < first)
+                return {};
+        }
+
+        for (long cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+
+        if (*end == '\0')
+            return cpus;
+
+        if (*end != ',')
+            return {};
+
+        p = end;
+    }
+}
+
+// Pins the calling thread to the specified CPU.
+
+void Cpu::pin(int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        cerr << "Cannot pin thread to CPU " << cpu << endl;
+#endif
+}
+
+// Makes the kernel prefer a listening socket for the connections whose packets are processed on the specified CPU.
+
+void Cpu::prefer(int sock, int cpu)
+{
+#ifdef SO_INCOMING_CPU
+    if (setsockopt(sock, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) == -1)
+        cerr << "Error setting SO_INCOMING_CPU" << endl;
+#endif
+}
+
+// Attaches a program to a SO_REUSEPORT group that sends every connection to the socket of the CPU that received it.
+
+bool Cpu::steer(int sock, const vector<int> &cpus)
+{
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+    // Load the CPU, return the index of the first socket on it, or fall back to the CPU modulo the number of sockets.
+    vector<sock_filter> code = {BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (unsigned)(SKF_AD_OFF + SKF_AD_CPU))};
+
+    for (size_t i = 0; i < cpus.size(); i++)
+    {
+        code.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (unsigned)cpus[i], 0, 1));
+        code.push_back(BPF_STMT(BPF_RET | BPF_K, (unsigned)i));
+    }
+
+    code.push_back(BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (unsigned)cpus.size()));
+    code.push_back(BPF_STMT(BPF_RET | BPF_A, 0));
+
+    sock_fprog program = {(unsigned short)code.size(), code.data()};
+    return setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) == 0;
+#else
+    return false;
+#endif
+}
+
+// Gets the CPU on which the kernel processed the last packet of a socket.
+
+int Cpu::incoming(int sock)
+{
+#ifdef SO_INCOMING_CPU
+    int cpu;
+    socklen_t length = sizeof(cpu);
+
+    if (getsockopt(sock, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &length) == 0)
+        return cpu;
+#endif
+
+    return -1;
+}
@@ -0,0 +1,68 @@
+/**
+ * @file cpu.hpp
+ * @brief This file contains the declaration of the Cpu class.
+ *
+ * The Cpu class binds event loops and connections to CPUs. An event loop can be pinned to a CPU, and the connections
+ * can be steered to the loop that runs on the CPU where the kernel processes their packets, so that receiving and
+ * handling the data stay in the same cache. Connections are steered by the kernel when they are accepted, either with
+ * a classic BPF program attached to the SO_REUSEPORT group of the listening sockets, or with SO_INCOMING_CPU on every
+ * listening socket. These features are only available on Linux. Elsewhere, the functions do nothing.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+class Cpu
+{
+public:
+    /**
+     * @brief Parses a list of CPUs, such as "0-3,8,10-11".
+     *
+     * @param list The list.
+     *
+     * @return The function returns the CPUs, or an empty vector if the list is not valid.
+     */
+    static std::vector<int> parse(const std::string &list);
+
+    /**
+     * @brief Pins the calling thread to the specified CPU.
+     *
+     * @param cpu The CPU.
+     */
+    static void pin(int cpu);
+
+    /**
+     * @brief Makes the kernel prefer a listening socket for the connections whose packets are processed on the specified CPU.
+     *
+     * @param sock The listening socket, which belongs to a SO_REUSEPORT group.
+     * @param cpu The CPU.
+     */
+    static void prefer(int sock, int cpu);
+
+    /**
+     * @brief Attaches a program to a SO_REUSEPORT group that sends every connection to the socket of the CPU that received it.
+     *
+     * The sockets of the group are numbered in the order they started listening. The connections received on the CPU
+     * of a socket go to that socket, and the rest are spread among all the sockets by CPU number.
+     *
+     * @param sock Any listening socket of the group.
+     * @param cpus The CPU of every socket of the group, in order.
+     *
+     * @return The function returns true on success, or false if the program could not be attached.
+     */
+    static bool steer(int sock, const std::vector<int> &cpus);
+
+    /**
+     * @brief Gets the CPU on which the kernel processed the last packet of a socket.
+     *
+     * @param sock The socket.
+     *
+     * @return The function returns the CPU, or -1 if it is not known.
+     */
+    static int incoming(int sock);
+};
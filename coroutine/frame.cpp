@@ -0,0 +1,351 @@
+/**
+ * @file frame.cpp
+ * @brief This file contains the implementation of the Framer class.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#include <cstdlib>
+#include "frame.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define FRAME_AVX2
+#endif
+
+using namespace std;
+
+/**
+ * @brief Searches a block of data for a delimiter one byte at a time.
+ *
+ * @param data The data.
+ * @param length The size of the data.
+ * @param delimiter The delimiter.
+ *
+ * @return The function returns the position of the first delimiter, or the size of the data if there is none.
+ */
+static size_t findScalar(const char *data, size_t length, char delimiter)
+{
+    for (size_t i = 0; i < length; i++)
+        if (data[i] == delimiter)
+            return i;
+
+    return length;
+}
+
+#ifdef __SSE2__
+/**
+ * @brief Searches a block of data for a delimiter 16 bytes at a time.
+ *
+ * @param data The data.
+ * @param length The size of the data.
+ * @param delimiter The delimiter.
+ *
+ * @return The function returns the position of the first delimiter, or the size of the data if there is none.
+ */
+static size_t findSse2(const char *data, size_t length, char delimiter)
+{
+    __m128i pattern = _mm_set1_epi8(delimiter);
+    size_t i = 0;
+
+    for (; i + 16 <= length; i += 16)
+    {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i)), pattern));
+
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + findScalar(data + i, length - i, delimiter);
+}
+#endif
+
+#ifdef FRAME_AVX2
+/**
+ * @brief Searches a block of data for a delimiter 32 bytes at a time.
+ *
+ * The function is compiled for AVX2 regardless of the target of the build, so it must only run on CPUs that support it.
+ *
+ * @param data The data.
+ * @param length The size of the data.
+ * @param delimiter The delimiter.
+ *
+ * @return The function returns the position of the first delimiter, or the size of the data if there is none.
+ */
+__attribute__((target("avx2"))) static size_t findAvx2(const char *data, size_t length, char delimiter)
+{
+    __m256i pattern = _mm256_set1_epi8(delimiter);
+    size_t i = 0;
+
+    for (; i + 32 <= length; i += 32)
+    {
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i)), pattern));
+
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + findScalar(data + i, length - i, delimiter);
+}
+#endif
+
+bool Framer::parse(const string &spec, Mode &mode, char &delimiter)
+{
+    static const string prefix = "delimiter:";
+
+    if (spec == "newline")
+    {
+        mode = DELIMITER;
+        delimiter = '\n';
+    }
+    else if (spec == "u32")
+        mode = U32;
+    else if (spec == "varint")
+        mode = VARINT;
+    else if (spec.starts_with(prefix) && spec.size() == prefix.size() + 1)
+    {
+        mode = DELIMITER;
+        delimiter = spec.back();
+    }
+    else if (spec.starts_with(prefix) && spec.size() > prefix.size())
+    {
+        char *end;
+        unsigned long value = strtoul(spec.c_str() + prefix.size(), &end, 0);
+
+        if (*end != '\0' || value > 255)
+            return false;
+
+        mode = DELIMITER;
+        delimiter = (char)value;
+    }
+    else
+        return false;
+
+    return true;
+}
+
+size_t Framer::find(const char *data, size_t length, char delimiter)
+{
+#ifdef FRAME_AVX2
+    if (__builtin_cpu_supports("avx2"))
+        return findAvx2(data, length, delimiter);
+#endif
+#ifdef __SSE2__
+    return findSse2(data, length, delimiter);
+#else
+    return findScalar(data, length, delimiter);
+#endif
+}
+
+int Framer::decode(Mode mode, const unsigned char *data, size_t length, uint64_t &value)
+{
+    if (mode == U32)
+    {
+        if (length < 4)
+            return 0;
+
+        value = (uint64_t)data[0] << 24 | (uint64_t)data[1] << 16 | (uint64_t)data[2] << 8 | data[3];
+        return 4;
+    }
+
+    uint64_t result = 0;
+
+    for (size_t i = 0; i < length && i < PREFIX_MAX; i++)
+    {
+        // The tenth byte holds the top bit of a 64-bit length only.
+        if (i == PREFIX_MAX - 1 && data[i] > 1)
+            return -1;
+
+        result |= (uint64_t)(data[i] & 0x7f) << (7 * i);
+
+        if ((data[i] & 0x80) == 0)
+        {
+            value = result;
+            return i + 1;
+        }
+    }
+
+    return length < PREFIX_MAX ? 0 : -1;
+}
+
+int Framer::extract(Buffer &buffer, Writer::Payload &payload)
+{
+    int count = 0;
+
+    while (!buffer.empty())
+    {
+        size_t skip = 0;
+        size_t length;
+        size_t trailing = 0;
+
+        if (mode == DELIMITER)
+        {
+            ssize_t size = search(buffer);
+
+            if (size == -1)
+                return scanned > maxRecord ? -1 : count;
+
+            if ((size_t)size > maxRecord)
+                return -1;
+
+            length = size;
+            trailing = 1;
+        }
+        else
+        {
+            if (prefixLength == 0)
+            {
+                uint64_t value;
+                int n = prefix(buffer, value);
+
+                if (n == 0)
+                    break;
+
+                if (n == -1 || value > maxRecord)
+                    return -1;
+
+                prefixLength = n;
+                needed = n + value;
+            }
+
+            if (buffer.size() < needed)
+                break;
+
+            skip = prefixLength;
+            length = needed - prefixLength;
+            prefixLength = 0;
+        }
+
+        add(buffer, skip, length, payload);
+        buffer.consume(skip + length + trailing);
+        count++;
+    }
+
+    return count;
+}
+
+void Framer::rest(Buffer &buffer, Writer::Payload &payload)
+{
+    add(buffer, 0, buffer.size(), payload);
+    buffer.consume(buffer.size());
+    scan = nullptr;
+    scanned = 0;
+    prefixLength = 0;
+}
+
+/**
+ * @brief Adds a record of a buffer to a payload, taking a reference to the chunks it spans.
+ *
+ * The records of a payload are consecutive, so the payload references a single chain of chunks.
+ *
+ * @param buffer The buffer.
+ * @param skip The position of the record, counted from the first byte not taken out yet.
+ * @param length The size of the record.
+ * @param payload The payload.
+ */
+void Framer::add(Buffer &buffer, size_t skip, size_t length, Writer::Payload &payload)
+{
+    auto chunk = buffer.head;
+    size_t offset = buffer.offset + skip;
+
+    while (offset >= chunk->size && chunk->next != nullptr)
+    {
+        offset -= chunk->size;
+        chunk = chunk->next;
+    }
+
+    auto end = chunk;
+
+    for (size_t remaining = offset + length; remaining > end->size; end = end->next)
+        remaining -= end->size;
+
+    payload.records.push_back({chunk, offset, length});
+
+    if (payload.tail != end)
+        for (auto c = payload.tail != nullptr ? payload.tail->next : chunk;; c = c->next)
+        {
+            ChunkPool::retain(c);
+
+            if (c == end)
+                break;
+        }
+
+    if (payload.head == nullptr)
+        payload.head = chunk;
+
+    payload.tail = end;
+}
+
+/**
+ * @brief Searches a buffer for the delimiter that ends its current record, resuming where the previous search stopped.
+ *
+ * @param buffer The buffer, which must not be empty.
+ *
+ * @return The function returns the size of the record without its delimiter, or -1 if the buffer does not hold the delimiter yet.
+ */
+ssize_t Framer::search(Buffer &buffer)
+{
+    if (scan == nullptr)
+    {
+        scan = buffer.head;
+        scanOffset = buffer.offset;
+    }
+
+    while (true)
+    {
+        size_t length = scan->size - scanOffset;
+        size_t found = find(scan->data + scanOffset, length, delimiter);
+
+        if (found < length)
+        {
+            size_t size = scanned + found;
+            scan = nullptr;
+            scanned = 0;
+            return size;
+        }
+
+        scanned += length;
+        scanOffset += length;
+
+        if (scan->next == nullptr)
+            return -1;
+
+        scan = scan->next;
+        scanOffset = 0;
+    }
+}
+
+/**
+ * @brief Decodes the length prefix of the current record of a buffer.
+ *
+ * @param buffer The buffer, which must not be empty.
+ * @param value Output parameter that receives the length of the record, without the prefix.
+ *
+ * @return The function returns the size of the prefix, 0 if the buffer does not hold all of it yet, or -1 if it is not valid.
+ */
+int Framer::prefix(Buffer &buffer, uint64_t &value)
+{
+    unsigned char bytes[PREFIX_MAX];
+    size_t length = 0;
+    auto chunk = buffer.head;
+    size_t offset = buffer.offset;
+
+    while (length < PREFIX_MAX && length < buffer.size())
+    {
+        if (offset == chunk->size)
+        {
+            chunk = chunk->next;
+            offset = 0;
+            continue;
+        }
+
+        bytes[length++] = chunk->data[offset++];
+    }
+
+    return decode(mode, bytes, length, value);
+}
@@ -0,0 +1,121 @@
+/**
+ * @file frame.hpp
+ * @brief This file contains the declaration of the Framer class.
+ *
+ * The Framer class splits the data of a connection into records as it arrives. Records are either terminated by a
+ * delimiter byte, such as a newline, or preceded by their length, as a 32-bit big-endian integer or as a varint
+ * (7 bits per byte, least significant group first, with the high bit set on every byte but the last).
+ * The records are handed out as views into the chunks of the connection's buffer, so the data is never copied.
+ * The delimiter is searched 32 or 16 bytes at a time with AVX2 or SSE2 where the CPU supports them, and the search
+ * resumes where the previous one stopped, so every byte is scanned once.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+#include "buffer.hpp"
+#include "writer.hpp"
+
+class Framer
+{
+public:
+    static constexpr size_t PREFIX_MAX = 10;
+
+    enum Mode
+    {
+        NONE,      // The data of a connection is not split.
+        DELIMITER, // Every record ends with a delimiter byte.
+        U32,       // Every record starts with its length as a 32-bit big-endian integer.
+        VARINT,    // Every record starts with its length as a varint.
+    };
+
+    /**
+     * @brief Constructs a Framer object for a new connection.
+     *
+     * @param mode The framing mode.
+     * @param delimiter In delimiter mode, the byte that ends every record.
+     * @param maxRecord The maximum size of a record. A connection that exceeds it is not valid.
+     */
+    Framer(Mode mode, char delimiter, size_t maxRecord) : mode(mode), delimiter(delimiter), maxRecord(maxRecord) {}
+
+    /**
+     * @brief Constructs a Framer object that does not split the data, to be replaced once the mode is known.
+     */
+    Framer() : Framer(NONE, '\n', 0) {}
+
+    /**
+     * @brief Takes the complete records out of a buffer and adds them to a payload.
+     *
+     * Every record is added as a view into the chunks of the buffer, and the payload takes a reference to the chunks
+     * from its first record to its last one. The delimiters and length prefixes are left out.
+     *
+     * @param buffer The buffer of the connection.
+     * @param payload The payload, whose head and tail are updated with the chunks of the records.
+     *
+     * @return The function returns the number of records added, or -1 if a record is not valid or too large. The records before it
+     * are added all the same.
+     */
+    int extract(Buffer &buffer, Writer::Payload &payload);
+
+    /**
+     * @brief Takes the data left in a buffer out as a last, incomplete record, and adds it to a payload.
+     *
+     * @param buffer The buffer of the connection, which must not be empty.
+     * @param payload The payload.
+     */
+    void rest(Buffer &buffer, Writer::Payload &payload);
+
+    /**
+     * @brief Parses a framing mode: "newline", "u32", "varint" or "delimiter:C", where C is a character or a byte such as "0x1e".
+     *
+     * @param spec The mode.
+     * @param mode Output parameter that receives the mode.
+     * @param delimiter Output parameter that receives the delimiter, in delimiter mode.
+     *
+     * @return The function returns true on success, or false if the mode is not valid.
+     */
+    static bool parse(const std::string &spec, Mode &mode, char &delimiter);
+
+    /**
+     * @brief Searches a block of data for a delimiter.
+     *
+     * @param data The data.
+     * @param length The size of the data.
+     * @param delimiter The delimiter.
+     *
+     * @return The function returns the position of the first delimiter, or the size of the data if there is none.
+     */
+    static size_t find(const char *data, size_t length, char delimiter);
+
+    /**
+     * @brief Decodes the length prefix of a record.
+     *
+     * @param mode The framing mode, U32 or VARINT.
+     * @param data The first bytes of the record.
+     * @param length The number of bytes available, at most PREFIX_MAX are used.
+     * @param value Output parameter that receives the length of the record, without the prefix.
+     *
+     * @return The function returns the size of the prefix, 0 if more bytes are needed, or -1 if the prefix is not valid.
+     */
+    static int decode(Mode mode, const unsigned char *data, size_t length, uint64_t &value);
+
+private:
+    void add(Buffer &buffer, size_t skip, size_t length, Writer::Payload &payload);
+    ssize_t search(Buffer &buffer);
+    int prefix(Buffer &buffer, uint64_t &value);
+
+    Mode mode;
+    char delimiter;
+    size_t maxRecord;
+    ChunkPool::Chunk *scan = nullptr; // In delimiter mode, the chunk where the search resumes, or nullptr to start over.
+    size_t scanOffset = 0;            // The position in that chunk where the search resumes.
+    size_t scanned = 0;               // The number of bytes of the current record already searched.
+    size_t prefixLength = 0;          // In length-prefix mode, the size of the prefix of the current record, or 0 if it is not decoded yet.
+    size_t needed = 0;                // The size of the current record with its prefix.
+};
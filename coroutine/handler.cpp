@@ -0,0 +1,306 @@
+/**
+ * @file handler.cpp
+ * @brief This file contains the implementation of the PrintHandler and HashHandler classes.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include "handler.hpp"
+
+using namespace std;
+
+/**
+ * @brief Constructs the handler of a loop.
+ *
+ * The memory budget is split evenly among the loops, and only applies when the data is kept until the connection closes.
+ */
+PrintHandler::PrintHandler(const Options &options, Writer &writer, ChunkPool &pool, LoopMetrics &metrics) : options(options), writer(writer), pool(pool), metrics(metrics), residentBytes(0), spillBudget(0)
+{
+    if (!options.stream && options.frame == Framer::NONE)
+        spillBudget = (options.memoryBudget + options.threads - 1) / options.threads;
+}
+
+/**
+ * @brief Sets up the framing of a new connection and registers it, so that its segments can be found when they get old.
+ *
+ * @param conn The connection.
+ */
+void PrintHandler::onAccept(Conn &conn)
+{
+    conn.state.framer = Framer(options.frame, options.delimiter, options.maxRecord);
+    connections[conn.sock] = &conn;
+}
+
+/**
+ * @brief Hands the data left in a connection over to the writer: its last record in framing mode, or else its last segment
+ * or all its data.
+ *
+ * @param conn The connection.
+ */
+void PrintHandler::onClose(Conn &conn)
+{
+    connections[conn.sock] = nullptr;
+
+    if (options.frame != Framer::NONE)
+        frame(conn, true);
+    else if (!options.stream || !conn.buffer.empty())
+        emit(conn);
+}
+
+/**
+ * @brief Applies the streaming thresholds to a connection that just received data.
+ *
+ * The first byte of a segment queues the connection to be handed over when the segment gets old,
+ * and the segment is handed over right away if it reaches the size threshold.
+ *
+ * @param conn The connection.
+ */
+void PrintHandler::received(Conn &conn)
+{
+    schedule(conn);
+
+    if (conn.buffer.size() >= options.flushBytes)
+        emit(conn);
+}
+
+/**
+ * @brief Queues the current segment of a connection to be handed over when it reaches the age threshold.
+ *
+ * Nothing is queued if the segment is empty or already queued.
+ *
+ * @param conn The connection.
+ */
+void PrintHandler::schedule(Conn &conn)
+{
+    if (conn.state.aging || conn.buffer.empty())
+        return;
+
+    aging.push_back({conn.sock, conn.id, conn.state.sequence, chrono::steady_clock::now() + chrono::milliseconds(options.flushMillis)});
+    conn.state.aging = true;
+}
+
+/**
+ * @brief Hands the data of a connection over to the writer.
+ *
+ * In streaming mode, the data is tagged with the connection identifier and the segment number.
+ * If a receive is in flight into the last chunk, that chunk stays with the connection and goes with the next segment.
+ * If the data was spilled, the writer takes the spill file instead.
+ *
+ * @param conn The connection.
+ */
+void PrintHandler::emit(Conn &conn)
+{
+    Writer::Payload payload;
+    payload.pool = &pool;
+    payload.trailer = "\n";
+    payload.sock = conn.sock;
+    payload.connection = conn.id;
+
+    if (conn.state.resident != NOT_RESIDENT)
+        unhold(conn);
+
+    if (conn.buffer.spilled())
+        payload.file = conn.buffer.release(payload.fileSize);
+    else
+        conn.buffer.detach(payload.head, payload.tail);
+
+    if (options.stream)
+    {
+        conn.state.aging = false;
+
+        if (payload.head == nullptr)
+        {
+            schedule(conn);
+            return;
+        }
+
+        payload.sequence = conn.state.sequence++;
+        payload.header = "[" + to_string(conn.sock) + " conn=" + to_string(conn.id) + " seq=" + to_string(payload.sequence) + "]: ";
+        schedule(conn);
+    }
+    else
+        payload.header = "[" + to_string(conn.sock) + "]: ";
+
+    writer.submit(std::move(payload));
+}
+
+/**
+ * @brief Hands the complete records of a connection over to the writer, as views into the chunks of its buffer.
+ *
+ * At the end of the connection, the data of an incomplete record is handed over as the last record.
+ *
+ * @param conn The connection.
+ * @param end Whether the connection has ended.
+ *
+ * @return The function returns false if the data of the connection is not valid.
+ */
+bool PrintHandler::frame(Conn &conn, bool end)
+{
+    Writer::Payload payload;
+    int records = conn.state.framer.extract(conn.buffer, payload);
+    metricsAdd(metrics.records, payload.records.size());
+
+    if (end && !conn.buffer.empty())
+    {
+        conn.state.framer.rest(conn.buffer, payload);
+        payload.partial = true;
+    }
+
+    if (payload.records.empty())
+        return records != -1;
+
+    payload.pool = &pool;
+    payload.trailer = "\n";
+    payload.sock = conn.sock;
+    payload.connection = conn.id;
+    payload.sequence = conn.state.sequence;
+    conn.state.sequence += payload.records.size();
+    writer.submit(std::move(payload));
+    return records != -1;
+}
+
+/**
+ * @brief Accounts for data received under the memory budget, spilling the largest buffers if it is exceeded.
+ *
+ * The data of a spilled connection goes to its spill file, so it does not count against the budget.
+ *
+ * @param conn The connection.
+ * @param size The number of bytes received.
+ */
+void PrintHandler::hold(Conn &conn, size_t size)
+{
+    if (conn.buffer.spilled())
+    {
+        metricsAdd(metrics.spilledBytes, size);
+        return;
+    }
+
+    if (conn.state.resident == NOT_RESIDENT)
+    {
+        conn.state.resident = residents.size();
+        residents.push_back(&conn);
+    }
+
+    residentBytes += size;
+
+    if (residentBytes > spillBudget)
+        enforceBudget();
+
+    metrics.residentBytes.store(residentBytes, memory_order_relaxed);
+}
+
+/**
+ * @brief Removes a connection from the list of buffers that hold data in memory, and takes its data out of the total.
+ *
+ * @param conn The connection, which must be in the list.
+ */
+void PrintHandler::unhold(Conn &conn)
+{
+    residents[conn.state.resident] = residents.back();
+    residents[conn.state.resident]->state.resident = conn.state.resident;
+    residents.pop_back();
+    conn.state.resident = NOT_RESIDENT;
+    residentBytes -= conn.buffer.size();
+    metrics.residentBytes.store(residentBytes, memory_order_relaxed);
+}
+
+/**
+ * @brief Moves the largest buffers to spill files until the data held in memory fits in the budget.
+ *
+ * On completion backends, a buffer with a receive in flight cannot move, so only the others are considered.
+ * If a spill file cannot be created, spilling is disabled, so that the error is not retried on every receive.
+ */
+void PrintHandler::enforceBudget()
+{
+    while (residentBytes > spillBudget)
+    {
+        Conn *largest = nullptr;
+
+        for (auto conn : residents)
+            if (!conn->buffer.pending() && (largest == nullptr || conn->buffer.size() > largest->buffer.size()))
+                largest = conn;
+
+        if (largest == nullptr)
+            return;
+
+        size_t size = largest->buffer.size();
+
+        try
+        {
+            largest->buffer.spill(options.spillDir);
+        }
+        catch (const runtime_error &e)
+        {
+            cerr << e.what() << ", spilling is disabled" << endl;
+            spillBudget = 0;
+            return;
+        }
+
+        unhold(*largest);
+        metricsAdd(metrics.spills, 1);
+        metricsAdd(metrics.spilledBytes, size);
+    }
+}
+
+/**
+ * @brief Hands over the segments whose oldest byte reached the age threshold.
+ *
+ * The segments are queued in the order they received their first byte, so only the front of the queue is checked.
+ * The entries of the segments that were handed over in the meantime, or whose connection closed, are skipped.
+ *
+ * @return The function returns the number of milliseconds until the next segment reaches the threshold, or -1 if there is none.
+ */
+int PrintHandler::expireStreams()
+{
+    auto now = chrono::steady_clock::time_point::min();
+
+    while (!aging.empty())
+    {
+        Aging entry = aging.front();
+        Conn **slot = connections.find(entry.sock);
+        Conn *conn = slot != nullptr ? *slot : nullptr;
+
+        if (conn != nullptr && conn->id == entry.id && conn->state.sequence == entry.sequence)
+        {
+            if (now == chrono::steady_clock::time_point::min())
+                now = chrono::steady_clock::now();
+
+            if (entry.deadline > now)
+                return chrono::ceil<chrono::milliseconds>(entry.deadline - now).count();
+
+            aging.pop_front();
+            emit(*conn);
+        }
+        else
+            aging.pop_front();
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Hands the count and the hash of a connection over to the writer.
+ *
+ * @param conn The connection.
+ */
+void HashHandler::onClose(Conn &conn)
+{
+    char line[64];
+    int length = snprintf(line, sizeof(line), "bytes=%llu fnv1a=%016llx", (unsigned long long)conn.state.bytes, (unsigned long long)conn.state.hash);
+
+    Writer::Payload payload;
+    payload.pool = &pool;
+    payload.trailer = "\n";
+    payload.sock = conn.sock;
+    payload.connection = conn.id;
+    payload.header = "[" + to_string(conn.sock) + " conn=" + to_string(conn.id) + "]: ";
+    conn.buffer.clear();
+    conn.buffer.append(line, length);
+    conn.buffer.detach(payload.head, payload.tail);
+    writer.submit(std::move(payload));
+}
@@ -0,0 +1,217 @@
+/**
+ * @file handler.hpp
+ * @brief This file contains the declaration of the Connection struct and of the PrintHandler and HashHandler classes.
+ *
+ * The Server class is a template over a handler, which decides what an event loop does with the data it receives.
+ * The hooks of the handler are called directly, without a virtual call, and the one called on every read is defined inline
+ * in this header, so that it can be inlined into the loop.
+ * A handler provides:
+ *
+ * - State: the data that the handler keeps in every connection. It must be default-constructible.
+ * - A constructor taking the options, the writer, the chunk pool and the metrics of the loop.
+ * - bool onData(Connection<State> &conn, size_t size): called after every read that returns data, with the data not consumed
+ *   yet in the buffer of the connection, of which the last size bytes are new. It returns false to close the connection.
+ * - void onClose(Connection<State> &conn): called once the socket is closed, with the data left in the buffer.
+ *
+ * And, optionally:
+ *
+ * - void onAccept(Connection<State> &conn): called when the connection starts, before its first read.
+ * - int onLoop(): called on every iteration of the loop before waiting. It returns the milliseconds until it must be called
+ *   again, or -1 if it need not.
+ * - bool drains(): whether the handler hands the data over on its own while the connections wait, so that waiting frees memory.
+ *   Without it, the memory of the connections is only freed by reading more.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <vector>
+#include <sys/uio.h>
+#include "buffer.hpp"
+#include "frame.hpp"
+#include "metrics.hpp"
+#include "options.hpp"
+#include "table.hpp"
+#include "writer.hpp"
+
+/**
+ * @brief Connection as the handler sees it.
+ */
+template <class State>
+struct Connection
+{
+    Connection(ChunkPool &pool, int sock, unsigned long id) : sock(sock), id(id), buffer(pool) {}
+    int sock;         // The socket of the connection.
+    unsigned long id; // The identifier of the connection, unique in the process.
+    Buffer buffer;    // The data received and not consumed by the handler yet.
+    State state;      // The data that the handler keeps for the connection.
+};
+
+/**
+ * @brief Handler that hands the data of every connection over to the writer: when the connection closes,
+ * in segments by size and age in streaming mode, or as records in framing mode.
+ *
+ * While the data is kept until the connection closes, the largest buffers move to spill files whenever the data
+ * in memory exceeds the share of the memory budget of the loop.
+ */
+class PrintHandler
+{
+public:
+    static constexpr size_t NOT_RESIDENT = SIZE_MAX;
+
+    struct State
+    {
+        unsigned long sequence = 0;     // The number of the next segment, or record in framing mode.
+        bool aging = false;             // Whether the current segment is queued to be handed over when it gets old.
+        size_t resident = NOT_RESIDENT; // The position of the connection in the list of buffers that hold data in memory, or NOT_RESIDENT.
+        Framer framer;
+    };
+
+    using Conn = Connection<State>;
+
+    /**
+     * @brief Constructs the handler of a loop.
+     *
+     * @param options The options of the server.
+     * @param writer The writer that prints the data.
+     * @param pool The chunk pool of the loop.
+     * @param metrics The metrics of the loop.
+     */
+    PrintHandler(const Options &options, Writer &writer, ChunkPool &pool, LoopMetrics &metrics);
+
+    void onAccept(Conn &conn);
+    bool onData(Conn &conn, size_t size);
+    void onClose(Conn &conn);
+    int onLoop() { return expireStreams(); }
+    bool drains() const { return options.stream; }
+
+private:
+    /**
+     * @brief Segment queued to be handed over when its oldest byte reaches the age threshold.
+     */
+    struct Aging
+    {
+        int sock;
+        unsigned long id;
+        unsigned long sequence;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    void received(Conn &conn);
+    void schedule(Conn &conn);
+    void emit(Conn &conn);
+    bool frame(Conn &conn, bool end = false);
+    void hold(Conn &conn, size_t size);
+    void unhold(Conn &conn);
+    void enforceBudget();
+    int expireStreams();
+
+    const Options &options;
+    Writer &writer;
+    ChunkPool &pool;
+    LoopMetrics &metrics;
+    FdTable<Conn *> connections;
+    std::deque<Aging> aging;
+    std::vector<Conn *> residents;
+    size_t residentBytes;
+    size_t spillBudget;
+};
+
+/**
+ * @brief Handler that counts the bytes of every connection and hashes them with 64-bit FNV-1a as they arrive,
+ * and hands a line with both over to the writer when the connection closes.
+ *
+ * The data is consumed after every read, so a connection holds no more than the chunk it receives into, whatever it sends.
+ * The streaming, framing and spilling options do not apply.
+ */
+class HashHandler
+{
+public:
+    static constexpr uint64_t FNV_OFFSET = 14695981039346656037ULL;
+    static constexpr uint64_t FNV_PRIME = 1099511628211ULL;
+
+    struct State
+    {
+        uint64_t bytes = 0;
+        uint64_t hash = FNV_OFFSET;
+    };
+
+    using Conn = Connection<State>;
+
+    /**
+     * @brief Constructs the handler of a loop.
+     *
+     * @param options The options of the server.
+     * @param writer The writer that prints the summaries.
+     * @param pool The chunk pool of the loop.
+     * @param metrics The metrics of the loop.
+     */
+    HashHandler(const Options &, Writer &writer, ChunkPool &pool, LoopMetrics &) : writer(writer), pool(pool) {}
+
+    bool onData(Conn &conn, size_t size);
+    void onClose(Conn &conn);
+
+private:
+    Writer &writer;
+    ChunkPool &pool;
+    std::vector<iovec> iov;
+};
+
+/**
+ * @brief Accounts for the data just received by a connection.
+ *
+ * Under the memory budget, the data counts against it. In streaming mode, the thresholds of the segment are applied.
+ * In framing mode, the records completed by the read are handed over right away.
+ *
+ * @param conn The connection.
+ * @param size The number of bytes received.
+ *
+ * @return The function returns false if the connection sent a record that is not valid.
+ */
+inline bool PrintHandler::onData(Conn &conn, size_t size)
+{
+    if (spillBudget > 0)
+        hold(conn, size);
+
+    if (options.stream)
+        received(conn);
+
+    if (options.frame != Framer::NONE && !frame(conn))
+    {
+        std::cerr << "Invalid record from client" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Counts and hashes the data just received by a connection, and consumes it.
+ *
+ * @param conn The connection.
+ * @param size The number of bytes received.
+ *
+ * @return The function returns true, since any data is valid.
+ */
+inline bool HashHandler::onData(Conn &conn, size_t size)
+{
+    uint64_t hash = conn.state.hash;
+    iov.clear();
+    conn.buffer.iovecs(iov);
+
+    for (auto &entry : iov)
+        for (size_t i = 0; i < entry.iov_len; i++)
+            hash = (hash ^ ((unsigned char *)entry.iov_base)[i]) * FNV_PRIME;
+
+    conn.state.hash = hash;
+    conn.state.bytes += size;
+    conn.buffer.consume(conn.buffer.size());
+    return true;
+}
@@ -0,0 +1,98 @@
+/**
+ * @file inbox.cpp
+ * @brief This file contains the implementation of the Inbox class.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#include <cerrno>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include "inbox.hpp"
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+using namespace std;
+
+Inbox::Inbox() : head(0), tail(0), closed(0), counter(0), iov{&counter, sizeof(counter)}
+{
+#ifdef __linux__
+    readFd = writeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (readFd == -1)
+        throw runtime_error("Error creating eventfd");
+#else
+    int fds[2];
+
+    if (pipe(fds) == -1)
+        throw runtime_error("Error creating pipe");
+
+    for (int fd : fds)
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    readFd = fds[0];
+    writeFd = fds[1];
+#endif
+}
+
+Inbox::~Inbox()
+{
+    if (writeFd != readFd)
+        close(writeFd);
+
+    close(readFd);
+}
+
+bool Inbox::push(int sock)
+{
+    size_t t = tail.load(memory_order_relaxed);
+
+    if (t - head.load(memory_order_acquire) == CAPACITY)
+        return false;
+
+    socks[t % CAPACITY] = sock;
+    tail.store(t + 1, memory_order_release);
+    return true;
+}
+
+void Inbox::notify()
+{
+    uint64_t one = 1;
+
+    // A full pipe already holds a notification, and an eventfd only fails if its counter overflows.
+    while (write(writeFd, &one, sizeof(one)) == -1 && errno == EINTR)
+        ;
+}
+
+int Inbox::pop()
+{
+    size_t h = head.load(memory_order_relaxed);
+
+    if (h == tail.load(memory_order_acquire))
+        return -1;
+
+    int sock = socks[h % CAPACITY];
+    head.store(h + 1, memory_order_release);
+    return sock;
+}
+
+void Inbox::drain()
+{
+#ifdef __linux__
+    // Reading an eventfd resets its counter.
+    while (read(readFd, &counter, sizeof(counter)) == -1 && errno == EINTR)
+        ;
+#else
+    char data[256];
+
+    for (ssize_t n; (n = read(readFd, data, sizeof(data))) > 0 || (n == -1 && errno == EINTR);)
+        ;
+#endif
+}
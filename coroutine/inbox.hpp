@@ -0,0 +1,117 @@
+/**
+ * @file inbox.hpp
+ * @brief This file contains the declaration of the Inbox class.
+ *
+ * An inbox hands accepted connections over from the acceptor thread to one event loop. It is a bounded ring of sockets
+ * with a single producer and a single consumer, so both sides only touch their own index and no lock is taken.
+ * After putting a socket, the acceptor writes to a notification descriptor (an eventfd on Linux, a pipe elsewhere)
+ * that the loop keeps in its poll set, so an idle loop wakes up, and a busy one takes every waiting socket at once.
+ * The inbox also counts the connections it handed over that the loop has closed, so the acceptor knows the load of the loop.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <sys/uio.h>
+
+class Inbox
+{
+public:
+    /**
+     * @brief How the connections are handed over to the loops.
+     */
+    enum Policy
+    {
+        NONE,         // Every loop accepts its own connections.
+        ROUND_ROBIN,  // The acceptor thread hands the connections over to the loops in turn.
+        LEAST_LOADED, // The acceptor thread hands every connection over to the loop with the fewest open ones.
+    };
+
+    static constexpr size_t CAPACITY = 1024;
+
+    /**
+     * @brief Constructs an empty inbox and opens its notification descriptors.
+     *
+     * @throws runtime_error If the descriptors cannot be opened.
+     */
+    Inbox();
+    Inbox(const Inbox &) = delete;
+    Inbox &operator=(const Inbox &) = delete;
+
+    /**
+     * @brief Closes the notification descriptors.
+     */
+    ~Inbox();
+
+    /**
+     * @brief Puts a socket in the inbox. Only the acceptor thread may call this function.
+     *
+     * @param sock The socket.
+     *
+     * @return The function returns true, or false if the inbox is full.
+     */
+    bool push(int sock);
+
+    /**
+     * @brief Wakes up the loop of the inbox. Only the acceptor thread may call this function.
+     */
+    void notify();
+
+    /**
+     * @brief Gets the number of connections handed over through the inbox that are still waiting or open.
+     * Only the acceptor thread may call this function.
+     *
+     * @return The function returns the number of connections.
+     */
+    size_t load() const { return tail.load(std::memory_order_relaxed) - closed.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Takes the oldest socket out of the inbox. Only the loop of the inbox may call this function.
+     *
+     * @return The function returns the socket, or -1 if the inbox is empty.
+     */
+    int pop();
+
+    /**
+     * @brief Consumes the pending notifications. Only the loop of the inbox may call this function.
+     *
+     * The notifications must be consumed before the inbox is emptied, so that a socket put in between is not missed:
+     * at worst, its notification wakes the loop up once more with nothing to take.
+     * Completion backends consume them by reading the descriptor into buffer() instead.
+     */
+    void drain();
+
+    /**
+     * @brief Counts a connection handed over through the inbox as closed. Only the loop of the inbox may call this function.
+     */
+    void release() { closed.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     * @brief Retrieves the descriptor that the loop polls for notifications.
+     *
+     * @return The function returns the descriptor.
+     */
+    int fd() const { return readFd; }
+
+    /**
+     * @brief Retrieves the buffer into which completion backends read the notifications.
+     *
+     * @return The function returns the buffer, which stays valid as long as the inbox.
+     */
+    const iovec *buffer() const { return &iov; }
+
+private:
+    alignas(64) std::atomic<size_t> head;   // The number of sockets taken, written by the loop.
+    alignas(64) std::atomic<size_t> tail;   // The number of sockets put, written by the acceptor.
+    alignas(64) std::atomic<size_t> closed; // The number of connections handed over that the loop has closed.
+    int socks[CAPACITY];
+    int readFd;
+    int writeFd;
+    uint64_t counter;
+    iovec iov;
+};
@@ -0,0 +1,355 @@
+/**
+ * @file log.cpp
+ * @brief This file contains the implementation of the LogSink class.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <stdexcept>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "log.hpp"
+
+using namespace std;
+
+/**
+ * @brief Computes the size of a record in a segment, including its header and padding.
+ *
+ * @param length The size of the data of the record.
+ *
+ * @return The function returns the size of the record.
+ */
+static size_t recordSize(size_t length)
+{
+    return (sizeof(LogSink::Header) + length + 7) & ~(size_t)7;
+}
+
+/**
+ * @brief Computes the size of the index of a segment, which has room for as many records without data as the segment.
+ *
+ * @param capacity The size of the segment.
+ *
+ * @return The function returns the size of the index.
+ */
+static size_t indexSize(size_t capacity)
+{
+    return capacity / sizeof(LogSink::Header) * sizeof(uint64_t);
+}
+
+/**
+ * @brief Copies a record out of the chunks it spans.
+ *
+ * The size of the last chunk of the payload may still grow while it is copied, so it is never read.
+ *
+ * @param payload The payload that holds the record.
+ * @param record The record.
+ * @param data The destination.
+ */
+static void copyRecord(const Writer::Payload &payload, const Writer::Record &record, char *data)
+{
+    auto chunk = record.chunk;
+    size_t offset = record.offset;
+
+    for (size_t remaining = record.length; remaining > 0;)
+    {
+        size_t length = chunk != payload.tail ? min(chunk->size - offset, remaining) : remaining;
+        memcpy(data, chunk->data + offset, length);
+        data += length;
+        remaining -= length;
+
+        // The link of the last chunk may be changing, so it is only followed if the record goes on.
+        if (remaining > 0)
+        {
+            chunk = chunk->next;
+            offset = 0;
+        }
+    }
+}
+
+/**
+ * @brief Reads the data of a spill file.
+ *
+ * @param fd The spill file.
+ * @param data The destination.
+ * @param size The size of the data in the file.
+ */
+static void readFile(int fd, char *data, size_t size)
+{
+    for (size_t offset = 0; offset < size;)
+    {
+        ssize_t length = pread(fd, data + offset, size - offset, offset);
+
+        if (length <= 0)
+        {
+            if (length == -1 && errno == EINTR)
+                continue;
+
+            cerr << "Error reading spill file" << endl;
+            return;
+        }
+
+        offset += length;
+    }
+}
+
+LogSink::LogSink(const string &dir, size_t segmentSize) : dir(dir), segmentSize(segmentSize), first(0), fd(-1), indexFd(-1), map(nullptr), index(nullptr), capacity(0), length(0), count(0)
+{
+    if (mkdir(dir.c_str(), 0755) == -1 && errno != EEXIST)
+        throw runtime_error("Error creating log directory " + dir);
+
+    recover();
+}
+
+LogSink::~LogSink()
+{
+    close();
+}
+
+size_t LogSink::write(vector<Writer::Payload> &batch)
+{
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    Header header = {VALID, 0, 0, 0, 0, (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec};
+    size_t total = 0;
+
+    for (auto &payload : batch)
+    {
+        header.connection = payload.connection;
+
+        for (size_t i = 0; i < payload.records.size(); i++)
+        {
+            header.flags = VALID | (payload.partial && i + 1 == payload.records.size() ? PARTIAL : 0);
+            header.length = payload.records[i].length;
+            header.sequence = payload.sequence + i;
+
+            if (char *data = append(header))
+            {
+                copyRecord(payload, payload.records[i], data);
+                commit();
+                total += recordSize(header.length);
+            }
+        }
+
+        if (!payload.records.empty())
+            continue;
+
+        header.flags = VALID;
+        header.length = payload.file != -1 ? payload.fileSize : 0;
+        header.sequence = payload.sequence;
+
+        for (auto chunk = payload.head; chunk != nullptr; chunk = chunk->next)
+            header.length += chunk->size;
+
+        if (char *data = append(header))
+        {
+            for (auto chunk = payload.head; chunk != nullptr; chunk = chunk->next)
+            {
+                memcpy(data, chunk->data, chunk->size);
+                data += chunk->size;
+            }
+
+            if (payload.file != -1)
+                readFile(payload.file, data, payload.fileSize);
+
+            commit();
+            total += recordSize(header.length);
+        }
+    }
+
+    return total;
+}
+
+/**
+ * @brief Builds the path of a file of a segment.
+ *
+ * @param first The number of the first record of the segment in the log.
+ * @param extension The extension of the file: "log" for the records, or "idx" for the index.
+ *
+ * @return The function returns the path.
+ */
+string LogSink::path(uint64_t first, const char *extension) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%020llu.%s", (unsigned long long)first, extension);
+    return dir + "/" + name;
+}
+
+/**
+ * @brief Finds the last segment of the log, so that the next one is numbered after its records.
+ *
+ * The index of a segment that was not closed keeps its preallocated size, and the entries after the last record are zero,
+ * so the records are counted up to the first entry that does not grow. Both files are then truncated to those records.
+ *
+ * @throws runtime_error If the directory cannot be read.
+ */
+void LogSink::recover()
+{
+    DIR *d = opendir(dir.c_str());
+
+    if (d == nullptr)
+        throw runtime_error("Error reading log directory " + dir);
+
+    bool found = false;
+    uint64_t last = 0;
+
+    while (dirent *entry = readdir(d))
+    {
+        char *end;
+        uint64_t number = strtoull(entry->d_name, &end, 10);
+
+        if (end == entry->d_name + 20 && strcmp(end, ".log") == 0 && (!found || number > last))
+        {
+            last = number;
+            found = true;
+        }
+    }
+
+    closedir(d);
+
+    if (!found)
+        return;
+
+    int file = ::open(path(last, "idx").c_str(), O_RDWR | O_CLOEXEC);
+    vector<uint64_t> entries;
+    struct stat st;
+
+    if (file != -1 && fstat(file, &st) == 0)
+    {
+        entries.resize(st.st_size / sizeof(uint64_t));
+
+        if (pread(file, entries.data(), entries.size() * sizeof(uint64_t), 0) != (ssize_t)(entries.size() * sizeof(uint64_t)))
+            entries.clear();
+    }
+
+    size_t records = 0;
+
+    while (records < entries.size() && entries[records] > (records > 0 ? entries[records - 1] : 0))
+        records++;
+
+    if (file != -1)
+    {
+        if (ftruncate(file, records * sizeof(uint64_t)) == -1)
+            cerr << "Error truncating log index" << endl;
+
+        ::close(file);
+    }
+
+    if (truncate(path(last, "log").c_str(), records > 0 ? entries[records - 1] : 0) == -1)
+        cerr << "Error truncating log segment" << endl;
+
+    first = last + records;
+}
+
+/**
+ * @brief Starts a record at the end of the current segment, writing its header.
+ *
+ * If the record does not fit, the segment rolls over. A record larger than the segment size gets a segment of its own.
+ *
+ * @param header The header of the record.
+ *
+ * @return The function returns the space for the data of the record, or nullptr if no segment could be opened.
+ */
+char *LogSink::append(const Header &header)
+{
+    size_t size = recordSize(header.length);
+
+    if (fd != -1 && length + size > capacity)
+        close();
+
+    if (fd == -1 && !open(max(segmentSize, size)))
+        return nullptr;
+
+    memcpy(map + length, &header, sizeof(header));
+    return map + length + sizeof(header);
+}
+
+/**
+ * @brief Ends the record started by append(), adding it to the index.
+ */
+void LogSink::commit()
+{
+    length += recordSize(((Header *)(map + length))->length);
+    index[count++] = length;
+}
+
+/**
+ * @brief Opens a new segment and its index, numbered after the records of the previous segments.
+ *
+ * The segment is preallocated, so that the pages of the mapping never run out of disk space while they are written,
+ * and the index is extended without allocating, since it only grows with the records.
+ *
+ * @param size The size of the segment.
+ *
+ * @return The function returns true, or false if the segment could not be opened.
+ */
+bool LogSink::open(size_t size)
+{
+    fd = ::open(path(first, "log").c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    indexFd = ::open(path(first, "idx").c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    capacity = size;
+
+#ifdef __linux__
+    bool allocated = fd != -1 && posix_fallocate(fd, 0, capacity) == 0;
+#else
+    bool allocated = fd != -1 && ftruncate(fd, capacity) == 0;
+#endif
+
+    if (allocated && indexFd != -1 && ftruncate(indexFd, indexSize(capacity)) == 0)
+    {
+        void *segment = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        void *entries = mmap(nullptr, indexSize(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, indexFd, 0);
+        map = segment != MAP_FAILED ? (char *)segment : nullptr;
+        index = entries != MAP_FAILED ? (uint64_t *)entries : nullptr;
+
+        if (map != nullptr && index != nullptr)
+            return true;
+    }
+
+    cerr << "Error opening log segment " << path(first, "log") << endl;
+    close();
+    return false;
+}
+
+/**
+ * @brief Closes the current segment and its index, truncating them to their records.
+ */
+void LogSink::close()
+{
+    if (map != nullptr)
+        munmap(map, capacity);
+
+    if (index != nullptr)
+        munmap(index, indexSize(capacity));
+
+    if (fd != -1 && ftruncate(fd, length) == -1)
+        cerr << "Error truncating log segment" << endl;
+
+    if (indexFd != -1 && ftruncate(indexFd, count * sizeof(uint64_t)) == -1)
+        cerr << "Error truncating log index" << endl;
+
+    if (fd != -1)
+        ::close(fd);
+
+    if (indexFd != -1)
+        ::close(indexFd);
+
+    first += count;
+    fd = -1;
+    indexFd = -1;
+    map = nullptr;
+    index = nullptr;
+    length = 0;
+    count = 0;
+}
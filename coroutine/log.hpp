@@ -0,0 +1,83 @@
+/**
+ * @file log.hpp
+ * @brief This file contains the declaration of the LogSink class.
+ *
+ * The LogSink class appends the payloads to a log of segment files instead of printing them. A segment is
+ * preallocated and memory-mapped when it is opened, so appending a record is a copy into the page cache.
+ * Every record starts with a fixed header that tells its length, connection, sequence number and timestamp,
+ * and is padded to 8 bytes. Next to every segment, an index file holds the offset where each record ends,
+ * so record N of a segment starts where record N - 1 ends, and is found without scanning the segment.
+ * The files of a segment are named after the number of its first record in the log, and a segment rolls over
+ * once the next record does not fit in its size. When the log is opened, it continues after the last segment.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "sink.hpp"
+
+class LogSink : public Sink
+{
+public:
+    static constexpr uint32_t VALID = 1;   // The header belongs to a record. The unused space of a segment is zero.
+    static constexpr uint32_t PARTIAL = 2; // The record was cut short by the end of the connection.
+
+    /**
+     * @brief Header of a record in a segment.
+     */
+    struct Header
+    {
+        uint32_t flags;      // VALID, and PARTIAL if the record is incomplete.
+        uint32_t reserved;   // Zero.
+        uint64_t length;     // The size of the data after the header.
+        uint64_t connection; // The identifier of the connection in the process.
+        uint64_t sequence;   // The number of the record, or of the segment in streaming mode, in the connection.
+        uint64_t timestamp;  // The time when the record was written, in nanoseconds since the Unix epoch.
+    };
+
+    /**
+     * @brief Opens the log in the specified directory, creating the directory if it does not exist.
+     *
+     * If the last segment was not closed, it is truncated after its last record.
+     *
+     * @param dir The directory.
+     * @param segmentSize The size at which segments roll over.
+     *
+     * @throws runtime_error If the directory cannot be created or read.
+     */
+    LogSink(const std::string &dir, size_t segmentSize);
+    LogSink(const LogSink &) = delete;
+    LogSink &operator=(const LogSink &) = delete;
+
+    /**
+     * @brief Closes the current segment, truncating it to its records.
+     */
+    ~LogSink();
+
+    size_t write(std::vector<Writer::Payload> &batch) override;
+
+private:
+    std::string path(uint64_t first, const char *extension) const;
+    void recover();
+    char *append(const Header &header);
+    void commit();
+    bool open(size_t size);
+    void close();
+
+    std::string dir;
+    size_t segmentSize;
+    uint64_t first;    // The number of the first record of the current segment in the log.
+    int fd;            // The current segment, or -1 if there is none.
+    int indexFd;       // The index of the current segment.
+    char *map;         // The mapping of the current segment.
+    uint64_t *index;   // The mapping of the index of the current segment.
+    size_t capacity;   // The size of the current segment.
+    size_t length;     // The bytes of records in the current segment.
+    size_t count;      // The number of records in the current segment.
+};
@@ -3,53 +3,498 @@
  * @brief This file contains the entry point of the TCP server application.
  *
  * The main function parses the command-line arguments, validates the port number,
- * creates an instance of the Server class, and runs the server.
+ * creates an instance of the Server class per thread, with the handler given on the command line, and runs the servers.
  *
  * @author Vikman Fernandez-Castro
  * @date July 13, 2024
  */
 
 #include <iostream>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "cpu.hpp"
+#include "inbox.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "options.hpp"
 #include "server.hpp"
+#include "sink.hpp"
 
 using namespace std;
 
+static constexpr unsigned long long MAX_THREADS = 1024; // The largest number of event loops.
+
+/**
+ * @brief Prints the usage message and exits.
+ *
+ * @param program The name of the program.
+ */
+[[noreturn]] static void usage(const char *program)
+{
+    cerr << "Usage: " << program << " [--threads N] [--shared-listener] [--accept-budget N] [--acceptor round-robin|least-loaded] [--edge-triggered] [--read-budget BYTES] [--loop-budget BYTES] [--output-queue N] [--stream] [--flush-bytes BYTES] [--flush-millis MS] [--idle-timeout MS] [--lifetime MS] [--event-batch N] [--busy-poll USEC] [--socket-busy-poll USEC] [--socket-rcvlowat BYTES] [--cpus LIST] [--metrics-port PORT] [--frame newline|u32|varint|delimiter:C] [--max-record BYTES] [--memory-budget BYTES] [--spill-dir DIR] [--high-watermark BYTES] [--low-watermark BYTES] [--log-dir DIR] [--segment-size BYTES] [--handler print|hash] <port>\n";
+    exit(1);
+}
+
+/**
+ * @brief Parses the numeric value of an option, and exits with an error message if it is not valid.
+ *
+ * The value must be a decimal number, with no sign or trailing characters, between the given bounds.
+ *
+ * @param text The value as given on the command line.
+ * @param min The smallest value allowed.
+ * @param max The largest value allowed.
+ * @param error The message printed if the value is not valid.
+ *
+ * @return The function returns the value.
+ */
+static unsigned long long parseNumber(const char *text, unsigned long long min, unsigned long long max, const char *error)
+{
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 10);
+
+    if (*text < '0' || *text > '9' || *end != '\0' || errno == ERANGE || value < min || value > max)
+    {
+        cerr << error << "\n";
+        exit(1);
+    }
+
+    return value;
+}
+
 /**
- * @brief Retrieves the port number from the command-line arguments.
+ * @brief Retrieves the options from the command-line arguments.
  *
- * This function checks if the correct number of arguments is provided,
+ * This function parses the optional flags, checks if the correct number of arguments is provided,
  * converts the port number string to an unsigned integer, and validates the port number.
  *
  * @param argc The number of command-line arguments.
  * @param argv The array of command-line arguments.
  *
- * @return The function returns the validated port number.
+ * @return The function returns the validated options.
  */
-static unsigned getPort(int argc, char *argv[])
+static Options getOptions(int argc, char *argv[])
 {
-    if (argc != 2)
+    static const struct option longOptions[] = {
+        {"threads", required_argument, NULL, 't'},
+        {"shared-listener", no_argument, NULL, 's'},
+        {"accept-budget", required_argument, NULL, 'a'},
+        {"acceptor", required_argument, NULL, 'A'},
+        {"edge-triggered", no_argument, NULL, 'e'},
+        {"read-budget", required_argument, NULL, 'b'},
+        {"loop-budget", required_argument, NULL, 'u'},
+        {"output-queue", required_argument, NULL, 'q'},
+        {"stream", no_argument, NULL, 'm'},
+        {"flush-bytes", required_argument, NULL, 'l'},
+        {"flush-millis", required_argument, NULL, 'w'},
+        {"idle-timeout", required_argument, NULL, 'i'},
+        {"lifetime", required_argument, NULL, 'L'},
+        {"event-batch", required_argument, NULL, 'E'},
+        {"busy-poll", required_argument, NULL, 'B'},
+        {"socket-busy-poll", required_argument, NULL, 'S'},
+        {"socket-rcvlowat", required_argument, NULL, 'R'},
+        {"cpus", required_argument, NULL, 'c'},
+        {"metrics-port", required_argument, NULL, 'M'},
+        {"frame", required_argument, NULL, 'f'},
+        {"max-record", required_argument, NULL, 'r'},
+        {"memory-budget", required_argument, NULL, 'g'},
+        {"spill-dir", required_argument, NULL, 'd'},
+        {"high-watermark", required_argument, NULL, 'H'},
+        {"low-watermark", required_argument, NULL, 'W'},
+        {"log-dir", required_argument, NULL, 'o'},
+        {"segment-size", required_argument, NULL, 'Z'},
+        {"handler", required_argument, NULL, 'P'},
+        {NULL, 0, NULL, 0},
+    };
+
+    Options options;
+
+    for (int opt; (opt = getopt_long(argc, argv, "t:sa:A:eb:u:q:ml:w:i:L:E:B:S:R:c:M:f:r:g:d:H:W:o:Z:P:", longOptions, NULL)) != -1;)
     {
-        cerr << "Usage: " << argv[0] << " <port>\n";
+        switch (opt)
+        {
+        case 't':
+            options.threads = parseNumber(optarg, 1, MAX_THREADS, "Invalid number of threads.");
+            break;
+
+        case 's':
+            options.sharedListener = true;
+            break;
+
+        case 'a':
+            options.acceptBudget = parseNumber(optarg, 1, UINT_MAX, "Invalid accept budget.");
+            break;
+
+        case 'A':
+            if (strcmp(optarg, "round-robin") == 0)
+                options.acceptor = Inbox::ROUND_ROBIN;
+            else if (strcmp(optarg, "least-loaded") == 0)
+                options.acceptor = Inbox::LEAST_LOADED;
+            else
+            {
+                cerr << "Invalid acceptor policy.\n";
+                exit(1);
+            }
+
+            break;
+
+        case 'e':
+            options.edgeTriggered = true;
+            break;
+
+        case 'b':
+            options.readBudget = parseNumber(optarg, 1, SIZE_MAX, "Invalid read budget.");
+            break;
+
+        case 'u':
+            options.loopBudget = parseNumber(optarg, 0, SIZE_MAX, "Invalid loop budget.");
+            break;
+
+        case 'q':
+            options.outputQueue = parseNumber(optarg, 1, SIZE_MAX, "Invalid output queue size.");
+            break;
+
+        case 'm':
+            options.stream = true;
+            break;
+
+        case 'l':
+            options.flushBytes = parseNumber(optarg, 1, SIZE_MAX, "Invalid flush size.");
+            break;
+
+        case 'w':
+            options.flushMillis = parseNumber(optarg, 1, INT_MAX, "Invalid flush age.");
+            break;
+
+        case 'i':
+            options.idleTimeout = parseNumber(optarg, 0, UINT_MAX, "Invalid idle timeout.");
+            break;
+
+        case 'L':
+            options.lifetime = parseNumber(optarg, 0, UINT_MAX, "Invalid lifetime.");
+            break;
+
+        case 'E':
+            options.eventBatch = parseNumber(optarg, 1, INT_MAX, "Invalid event batch size.");
+            break;
+
+        case 'B':
+            options.busyPoll = parseNumber(optarg, 0, INT_MAX, "Invalid busy-poll time.");
+            break;
+
+        case 'S':
+            options.socketBusyPoll = parseNumber(optarg, 0, INT_MAX, "Invalid socket busy-poll time.");
+            break;
+
+        case 'R':
+            options.socketRcvLowat = parseNumber(optarg, 1, INT_MAX, "Invalid socket receive low-water mark.");
+            break;
+
+        case 'c':
+            options.cpus = Cpu::parse(optarg);
+
+            if (options.cpus.empty())
+            {
+                cerr << "Invalid list of CPUs.\n";
+                exit(1);
+            }
+
+            break;
+
+        case 'M':
+            options.metricsPort = parseNumber(optarg, 1, 65535, "Invalid metrics port.");
+            break;
+
+        case 'f':
+            if (!Framer::parse(optarg, options.frame, options.delimiter))
+            {
+                cerr << "Invalid framing mode.\n";
+                exit(1);
+            }
+
+            break;
+
+        case 'r':
+            options.maxRecord = parseNumber(optarg, 1, SIZE_MAX, "Invalid maximum record size.");
+            break;
+
+        case 'g':
+            options.memoryBudget = parseNumber(optarg, 0, SIZE_MAX, "Invalid memory budget.");
+            break;
+
+        case 'd':
+            options.spillDir = optarg;
+            break;
+
+        case 'H':
+            options.highWatermark = parseNumber(optarg, 0, SIZE_MAX, "Invalid high watermark.");
+            break;
+
+        case 'W':
+            options.lowWatermark = parseNumber(optarg, 0, SIZE_MAX, "Invalid low watermark.");
+            break;
+
+        case 'o':
+            options.logDir = optarg;
+            break;
+
+        case 'Z':
+            options.segmentSize = parseNumber(optarg, 4096, SIZE_MAX, "Invalid segment size.");
+            break;
+
+        case 'P':
+            if (strcmp(optarg, "print") == 0)
+                options.handler = Options::PRINT;
+            else if (strcmp(optarg, "hash") == 0)
+                options.handler = Options::HASH;
+            else
+            {
+                cerr << "Invalid handler.\n";
+                exit(1);
+            }
+
+            break;
+
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (argc - optind != 1)
+        usage(argv[0]);
+
+    if (options.sharedListener && options.acceptor != Inbox::NONE)
+    {
+        cerr << "The shared listener and the acceptor thread are exclusive.\n";
         exit(1);
     }
 
-    unsigned port = strtoul(argv[1], NULL, 10);
+    if (options.stream && options.frame != Framer::NONE)
+    {
+        cerr << "Streaming and framing modes are exclusive.\n";
+        exit(1);
+    }
 
-    if (port < 1 || port > 65535)
+    if (options.lowWatermark == 0)
+        options.lowWatermark = options.highWatermark / 2;
+    else if (options.lowWatermark >= options.highWatermark)
     {
-        cerr << "Invalid port number. Please enter a value between 1 and 65535.\n";
+        cerr << "The low watermark must be below the high watermark.\n";
         exit(1);
     }
 
-    return port;
+    options.port = parseNumber(argv[optind], 1, 65535, "Invalid port number. Please enter a value between 1 and 65535.");
+
+    return options;
+}
+
+/**
+ * @brief Raises the soft limit of open files to the hard limit, so that the number of connections is bounded by the system only.
+ */
+static void raiseFileLimit()
+{
+    rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+/**
+ * @brief Opens the listening sockets of the event loops, or of the acceptor thread.
+ *
+ * With an acceptor thread, the port is opened once for it. With a shared listener, the port is opened once and every loop gets its own descriptor of the same socket.
+ * Otherwise, a socket is opened per loop, in the order of the loops, so that they have the same index in the SO_REUSEPORT group.
+ * If the loops are pinned, every socket prefers the connections of its loop's CPU with SO_INCOMING_CPU,
+ * and a steering program is attached to the group, if the kernel allows it, to apply that preference strictly.
+ *
+ * @param options The options of the server.
+ *
+ * @return The function returns the listening socket of every loop.
+ */
+static vector<int> openListeners(const Options &options)
+{
+    vector<int> listeners;
+    vector<int> cpus;
+
+    if (options.acceptor != Inbox::NONE)
+        return {Server<>::openPort(options)};
+
+    if (options.sharedListener)
+    {
+        listeners.push_back(Server<>::openPort(options));
+
+        for (unsigned i = 1; i < options.threads; i++)
+            listeners.push_back(dup(listeners[0]));
+
+        return listeners;
+    }
+
+    for (unsigned i = 0; i < options.threads; i++)
+    {
+        listeners.push_back(Server<>::openPort(options));
+
+        if (!options.cpus.empty() && options.threads > 1)
+        {
+            cpus.push_back(options.cpus[i % options.cpus.size()]);
+            Cpu::prefer(listeners[i], cpus[i]);
+        }
+    }
+
+    if (!cpus.empty() && !Cpu::steer(listeners[0], cpus))
+        cerr << "Cannot attach the steering program, connections are steered with SO_INCOMING_CPU only\n";
+
+    return listeners;
+}
+
+/**
+ * @brief Creates the destination of the output: the segment log if a directory was given, or else the standard output.
+ *
+ * @param options The options of the server.
+ *
+ * @return The function returns the sink.
+ *
+ * @throws runtime_error If the log cannot be opened.
+ */
+static unique_ptr<Sink> openSink(const Options &options)
+{
+    if (options.logDir.empty())
+        return make_unique<TextSink>();
+
+    return make_unique<LogSink>(options.logDir, options.segmentSize);
+}
+
+/**
+ * @brief Runs an event loop on the calling thread.
+ *
+ * The thread is pinned to its CPU, if a list was given, before the server is constructed, so the memory of the loop is local to that CPU.
+ * The server is instantiated for the handler given in the options, so its hooks are bound at compile time.
+ *
+ * @param options The options of the server.
+ * @param writer The writer shared by all the loops.
+ * @param serverSock The listening socket of the loop, or -1 if it has an inbox.
+ * @param index The index of the loop.
+ * @param inbox The inbox of the loop, or null if it accepts its own connections.
+ */
+static void runLoop(const Options &options, Writer &writer, int serverSock, unsigned index, Inbox *inbox)
+{
+    int cpu = options.cpus.empty() ? -1 : options.cpus[index % options.cpus.size()];
+
+    if (cpu != -1)
+        Cpu::pin(cpu);
+
+    if (options.handler == Options::HASH)
+        Server<HashHandler>(options, writer, serverSock, cpu, inbox).run();
+    else
+        Server<PrintHandler>(options, writer, serverSock, cpu, inbox).run();
+}
+
+/**
+ * @brief Hands an accepted connection over to a loop through its inbox.
+ *
+ * In round-robin mode, the loops take turns. In least-loaded mode, the loop with the fewest connections waiting in its inbox
+ * or open gets it, and the turns only break ties. If the inbox of that loop is full, the next ones are tried in turn.
+ *
+ * @param options The options of the server.
+ * @param inboxes The inboxes of the loops.
+ * @param sock The accepted socket.
+ * @param next The loop whose turn it is, which is moved past the loop that gets the connection.
+ *
+ * @return The function returns true, or false if every inbox is full.
+ */
+static bool handOver(const Options &options, vector<unique_ptr<Inbox>> &inboxes, int sock, size_t &next)
+{
+    size_t chosen = next % inboxes.size();
+
+    if (options.acceptor == Inbox::LEAST_LOADED)
+    {
+        for (size_t i = 1; i < inboxes.size(); i++)
+        {
+            size_t index = (next + i) % inboxes.size();
+
+            if (inboxes[index]->load() < inboxes[chosen]->load())
+                chosen = index;
+        }
+    }
+
+    for (size_t i = 0; i < inboxes.size(); i++)
+    {
+        size_t index = (chosen + i) % inboxes.size();
+
+        if (inboxes[index]->push(sock))
+        {
+            inboxes[index]->notify();
+            next = index + 1;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Runs the acceptor thread, which accepts every connection and hands it over to the loops.
+ *
+ * The listening socket is made blocking, so the thread sleeps in accept() while there are no connections.
+ * While every inbox is full, the connection just accepted waits, and the next ones stay in the backlog.
+ *
+ * @param options The options of the server.
+ * @param serverSock The listening socket.
+ * @param inboxes The inboxes of the loops.
+ */
+static void runAcceptor(const Options &options, int serverSock, vector<unique_ptr<Inbox>> &inboxes)
+{
+    fcntl(serverSock, F_SETFL, fcntl(serverSock, F_GETFL) & ~O_NONBLOCK);
+    size_t next = 0;
+
+    while (true)
+    {
+        int sock = Server<>::acceptSocket(serverSock);
+
+        if (sock == -1)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            cerr << "Error accepting client" << endl;
+
+            // Out of descriptors or memory, the backlog stays full: back off instead of spinning.
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+                this_thread::sleep_for(chrono::milliseconds(ACCEPT_RETRY_MILLIS));
+
+            continue;
+        }
+
+        while (!handOver(options, inboxes, sock, next))
+            this_thread::sleep_for(chrono::milliseconds(RETRY_MILLIS));
+    }
 }
 
 /**
  * @brief The entry point of the TCP server application.
  *
- * The main function parses the command-line arguments, retrieves the port number,
- * creates an instance of the Server class, and runs the server.
+ * The main function parses the command-line arguments and starts one server per thread.
+ * Every server owns its listening socket, poll object and handler table, so the loops share nothing but the output.
+ * The listening sockets are opened up front, so that connections can be steered to the loop pinned to their CPU.
+ * Alternatively, a single acceptor thread accepts every connection and hands it over to a loop through the loop's inbox.
+ * All the servers hand their output over to a single writer thread, which prints it or appends it to the segment log.
+ * The metrics are started first, so that every thread inherits the blocked SIGUSR1 and only the metrics thread receives it.
+ * SIGINT and SIGTERM are blocked likewise, and the main thread waits for them while the loops run on their own threads.
+ * On either of them, the writer writes what is left in its queue and the segment log is closed before the process exits.
  *
  * @param argc The number of command-line arguments.
  * @param argv The array of command-line arguments.
@@ -58,7 +503,40 @@ static unsigned getPort(int argc, char *argv[])
  */
 int main(int argc, char **argv)
 {
-    unsigned port = getPort(argc, argv);
-    Server server(port);
-    server.run();
+    Options options = getOptions(argc, argv);
+    raiseFileLimit();
+
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, NULL);
+
+    Metrics::start(options.metricsPort);
+    vector<int> listeners = openListeners(options);
+    unique_ptr<Sink> sink = openSink(options);
+    Writer writer(options.outputQueue, *sink);
+    Metrics::watch(writer);
+    vector<unique_ptr<Inbox>> inboxes;
+    vector<thread> threads;
+
+    if (options.acceptor != Inbox::NONE)
+    {
+        for (unsigned i = 0; i < options.threads; i++)
+            inboxes.push_back(make_unique<Inbox>());
+
+        threads.emplace_back(runAcceptor, cref(options), listeners[0], ref(inboxes));
+        listeners.assign(options.threads, -1);
+    }
+
+    for (unsigned i = 0; i < options.threads; i++)
+        threads.emplace_back(runLoop, cref(options), ref(writer), listeners[i], i, inboxes.empty() ? nullptr : inboxes[i].get());
+
+    for (int sig; sigwait(&stopSignals, &sig) != 0;)
+        ;
+
+    // The loops never return, so the process exits without destroying what they use.
+    writer.stop();
+    sink.reset();
+    quick_exit(0);
 }
@@ -0,0 +1,305 @@
+/**
+ * @file metrics.cpp
+ * @brief This file contains the implementation of the metrics registry and its Prometheus text rendering.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#include <csignal>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include "metrics.hpp"
+#include "writer.hpp"
+
+#define ADMIN_BACKLOG 16
+#define ADMIN_TIMEOUT_SECONDS 1
+
+using namespace std;
+
+// The registry is only locked to add a loop and to render the metrics, never by the loops themselves.
+
+static std::mutex registryMutex;
+static vector<unique_ptr<LoopMetrics>> loops;
+static Histogram outputNanos;
+static atomic<Writer *> watched(nullptr);
+
+void Histogram::render(ostream &out, const string &name, const string &labels) const
+{
+    uint64_t counts[BUCKETS];
+    uint64_t total = 0;
+    uint64_t cumulative = 0;
+    size_t last = 0;
+    // The sum and the count take the same labels without the bucket bound.
+    string bare = labels.empty() ? labels : "{" + labels.substr(0, labels.size() - 1) + "}";
+
+    for (size_t i = 0; i < BUCKETS; i++)
+    {
+        counts[i] = buckets[i].load(memory_order_relaxed);
+        total += counts[i];
+
+        if (counts[i] > 0)
+            last = i;
+    }
+
+    for (size_t i = 0; i < BUCKETS; i++)
+    {
+        cumulative += counts[i];
+
+        // Sub-bucket 3 of each power ends right before the next power of two.
+        if (i < 2 || (i & SUB_MASK) == SUB_MASK)
+        {
+            uint64_t bound = i < SUB_COUNT ? i : (2ULL << ((i >> SUB_BITS) + 1)) - 1;
+            out << name << "_bucket{" << labels << "le=\"" << bound << "\"} " << cumulative << '\n';
+
+            if (i >= last && i > 0)
+                break;
+        }
+    }
+
+    out << name << "_bucket{" << labels << "le=\"+Inf\"} " << total << '\n';
+    out << name << "_sum" << bare << ' ' << sum.load(memory_order_relaxed) << '\n';
+    out << name << "_count" << bare << ' ' << total << '\n';
+}
+
+/**
+ * @brief Writes a counter of every event loop.
+ *
+ * @param out The output stream.
+ * @param name The name of the metric.
+ * @param help The description of the metric.
+ * @param type The type of the metric.
+ * @param value A function that gets the value from the metrics of a loop.
+ */
+template <typename F>
+static void renderLoops(ostream &out, const char *name, const char *help, const char *type, F value)
+{
+    out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << ' ' << type << '\n';
+
+    for (auto &loop : loops)
+        out << name << "{thread=\"" << loop->id << "\"} " << value(*loop) << '\n';
+}
+
+/**
+ * @brief Writes a histogram of every event loop.
+ *
+ * @param out The output stream.
+ * @param name The name of the metric.
+ * @param help The description of the metric.
+ * @param histogram The histogram in the metrics of a loop.
+ */
+static void renderHistogram(ostream &out, const char *name, const char *help, Histogram LoopMetrics::*histogram)
+{
+    out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << " histogram\n";
+
+    for (auto &loop : loops)
+        ((*loop).*histogram).render(out, name, "thread=\"" + to_string(loop->id) + "\",");
+}
+
+/**
+ * @brief Writes a metric of the writer.
+ *
+ * @param out The output stream.
+ * @param name The name of the metric.
+ * @param help The description of the metric.
+ * @param type The type of the metric.
+ * @param value The value.
+ */
+static void renderWriter(ostream &out, const char *name, const char *help, const char *type, unsigned long value)
+{
+    out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << ' ' << type << '\n' << name << ' ' << value << '\n';
+}
+
+// Gets the current time of the monotonic clock with nanosecond resolution.
+
+uint64_t Metrics::nanos()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Creates the metrics of the calling event loop and adds them to the registry.
+
+LoopMetrics &Metrics::add()
+{
+    lock_guard<std::mutex> lock(registryMutex);
+    loops.push_back(make_unique<LoopMetrics>());
+    loops.back()->id = loops.size() - 1;
+    return *loops.back();
+}
+
+// Records the time spent writing a batch of output.
+
+void Metrics::output(uint64_t nanos)
+{
+    outputNanos.record(nanos);
+}
+
+// Includes the statistics of a writer in the metrics.
+
+void Metrics::watch(Writer &writer)
+{
+    watched.store(&writer, memory_order_release);
+}
+
+// Writes all the metrics in the Prometheus text format.
+
+void Metrics::render(ostream &out)
+{
+    auto load = [](const atomic<uint64_t> &counter) { return counter.load(memory_order_relaxed); };
+
+    {
+        lock_guard<std::mutex> lock(registryMutex);
+
+        renderLoops(out, "server_connections_accepted_total", "Connections accepted.", "counter", [&](const LoopMetrics &m) { return load(m.accepted); });
+        renderLoops(out, "server_connections_closed_total", "Connections closed.", "counter", [&](const LoopMetrics &m) { return load(m.closed); });
+        renderLoops(out, "server_connections_active", "Connections open.", "gauge", [&](const LoopMetrics &m) { return load(m.accepted) - load(m.closed); });
+        renderLoops(out, "server_connections_remote_cpu_total", "Connections accepted by a pinned loop whose packets arrive on another CPU.", "counter", [&](const LoopMetrics &m) { return load(m.remoteCpu); });
+        renderLoops(out, "server_received_bytes_total", "Bytes received from the connections.", "counter", [&](const LoopMetrics &m) { return load(m.bytesReceived); });
+        renderLoops(out, "server_reads_total", "Reads that returned data.", "counter", [&](const LoopMetrics &m) { return load(m.reads); });
+        renderLoops(out, "server_records_total", "Records handed over in framing mode.", "counter", [&](const LoopMetrics &m) { return load(m.records); });
+        renderLoops(out, "server_resident_bytes", "Bytes held in memory by the buffers under the memory budget.", "gauge", [&](const LoopMetrics &m) { return load(m.residentBytes); });
+        renderLoops(out, "server_spills_total", "Buffers moved to spill files.", "counter", [&](const LoopMetrics &m) { return load(m.spills); });
+        renderLoops(out, "server_spilled_bytes_total", "Bytes written to spill files.", "counter", [&](const LoopMetrics &m) { return load(m.spilledBytes); });
+        renderLoops(out, "server_memory_bytes", "Memory held by the data received and not written yet.", "gauge", [&](const LoopMetrics &m) {
+            const ChunkPool *pool = m.pool.load(memory_order_acquire);
+            return pool != nullptr ? pool->memory() : 0;
+        });
+        renderLoops(out, "server_connections_paused", "Connections not read because the memory is over the high watermark.", "gauge", [&](const LoopMetrics &m) { return load(m.paused); });
+        renderLoops(out, "server_read_pauses_total", "Times a connection stopped being read because of the high watermark.", "counter", [&](const LoopMetrics &m) { return load(m.pauses); });
+        renderLoops(out, "server_poll_waits_total", "Waits for events.", "counter", [&](const LoopMetrics &m) { return load(m.waits); });
+        renderLoops(out, "server_poll_events_total", "Events returned by the waits.", "counter", [&](const LoopMetrics &m) { return load(m.events); });
+        renderLoops(out, "server_poll_spins_total", "Non-blocking waits made while busy polling.", "counter", [&](const LoopMetrics &m) { return load(m.spins); });
+        renderLoops(out, "server_poll_spin_wakeups_total", "Waits that found events while busy polling.", "counter", [&](const LoopMetrics &m) { return load(m.spinWakeups); });
+        renderLoops(out, "server_poll_sleeps_total", "Waits that blocked in the kernel.", "counter", [&](const LoopMetrics &m) { return load(m.sleeps); });
+        renderLoops(out, "server_poll_spin_nanoseconds_total", "Time spent busy polling.", "counter", [&](const LoopMetrics &m) { return load(m.spinNanos); });
+        renderLoops(out, "server_poll_spin_ratio", "Fraction of the wakeups served by busy polling instead of sleeping.", "gauge", [&](const LoopMetrics &m) {
+            uint64_t spun = load(m.spinWakeups), slept = load(m.sleeps);
+            return spun + slept > 0 ? (double)spun / (spun + slept) : 0.0;
+        });
+        renderLoops(out, "server_loop_budget_stops_total", "Iterations that left yielded connections for the next one because the loop budget ran out.", "counter", [&](const LoopMetrics &m) { return load(m.budgetStops); });
+        renderLoops(out, "server_frame_pool_hits_total", "Coroutine frames taken from the frame pool.", "counter", [&](const LoopMetrics &m) { return load(m.frameHits); });
+        renderLoops(out, "server_frame_pool_misses_total", "Coroutine frames that needed a new slab or were too large for the frame pool.", "counter", [&](const LoopMetrics &m) { return load(m.frameMisses); });
+        renderHistogram(out, "server_poll_events_per_wait", "Events returned by each wait.", &LoopMetrics::eventsPerWait);
+        renderHistogram(out, "server_loop_iteration_nanoseconds", "Time spent in each iteration of the event loop, excluding the wait.", &LoopMetrics::loopNanos);
+        renderHistogram(out, "server_read_bytes", "Bytes returned by each read.", &LoopMetrics::readBytes);
+    }
+
+    out << "# HELP server_output_write_nanoseconds Time spent writing each batch of output.\n# TYPE server_output_write_nanoseconds histogram\n";
+    outputNanos.render(out, "server_output_write_nanoseconds", "");
+
+    Writer *writer = watched.load(memory_order_acquire);
+
+    if (writer == nullptr)
+        return;
+
+    Writer::Stats stats = writer->stats();
+    renderWriter(out, "server_output_queue_depth", "Payloads waiting for the output writer.", "gauge", stats.depth);
+    renderWriter(out, "server_output_queue_max_depth", "Highest number of payloads waiting for the output writer.", "gauge", stats.maxDepth);
+    renderWriter(out, "server_output_held", "Payloads held by the loops because the output queue was full.", "gauge", stats.overflow);
+    renderWriter(out, "server_output_payloads_total", "Payloads written.", "counter", stats.payloads);
+    renderWriter(out, "server_output_bytes_total", "Bytes written.", "counter", stats.bytes);
+    renderWriter(out, "server_output_batches_total", "Batches written.", "counter", stats.batches);
+    renderWriter(out, "server_output_backpressure_total", "Payloads that found the output queue full.", "counter", stats.backpressure);
+}
+
+/**
+ * @brief Writes the metrics to the standard error on every SIGUSR1.
+ */
+static void signalRun()
+{
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+
+    for (int sig;;)
+        if (sigwait(&set, &sig) == 0)
+        {
+            ostringstream out;
+            Metrics::render(out);
+            cerr << out.str() << flush;
+        }
+}
+
+/**
+ * @brief Answers every connection to the admin port with the metrics.
+ *
+ * The request is read but not parsed: any request gets the metrics in an HTTP/1.0 response.
+ *
+ * @param serverSock The listening socket.
+ */
+static void adminRun(int serverSock)
+{
+    while (true)
+    {
+        int sock = accept(serverSock, NULL, NULL);
+
+        if (sock == -1)
+            continue;
+
+        timeval timeout = {ADMIN_TIMEOUT_SECONDS, 0};
+        char request[1024];
+        ostringstream out;
+
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        recv(sock, request, sizeof(request), 0);
+
+        Metrics::render(out);
+        string body = out.str();
+        string header = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + to_string(body.size()) + "\r\n\r\n";
+        send(sock, header.data(), header.size(), MSG_NOSIGNAL);
+        send(sock, body.data(), body.size(), MSG_NOSIGNAL);
+        close(sock);
+    }
+}
+
+// Starts serving the metrics.
+
+void Metrics::start(unsigned port)
+{
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+
+    if (pthread_sigmask(SIG_BLOCK, &set, NULL) != 0)
+        throw runtime_error("Error blocking SIGUSR1");
+
+    thread(signalRun).detach();
+
+    if (port == 0)
+        return;
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    int enable = 1;
+    sockaddr_in addr;
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = INADDR_ANY;
+
+    if (sock == -1)
+        throw runtime_error("Error opening socket");
+
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) == -1)
+        throw runtime_error("Error setting SO_REUSEADDR");
+
+    if (::bind(sock, (sockaddr *)&addr, sizeof(addr)) == -1)
+        throw runtime_error("Error binding metrics port");
+
+    if (listen(sock, ADMIN_BACKLOG) == -1)
+        throw runtime_error("Error listening on metrics port");
+
+    thread(adminRun, sock).detach();
+}
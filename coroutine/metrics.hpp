@@ -0,0 +1,165 @@
+/**
+ * @file metrics.hpp
+ * @brief This file contains the declaration of the Histogram, LoopMetrics and Metrics classes.
+ *
+ * Every event loop registers its own LoopMetrics, which only that loop updates, so the hot path needs neither locks
+ * nor atomic read-modify-write instructions: the counters are updated with relaxed loads and stores, which other
+ * threads may read at any time. Histograms use logarithmic buckets with four sub-buckets per power of two, so any
+ * recorded value is known within 25%.
+ *
+ * The metrics are rendered in the Prometheus text format, served on an optional admin port and written to the
+ * standard error when the process receives SIGUSR1.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+class ChunkPool;
+class Writer;
+
+/**
+ * @brief Adds a value to a counter owned by the calling thread.
+ *
+ * @param counter The counter.
+ * @param value The value to add.
+ */
+inline void metricsAdd(std::atomic<uint64_t> &counter, uint64_t value)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+class Histogram
+{
+public:
+    static constexpr int SUB_BITS = 2;
+    static constexpr size_t SUB_COUNT = 1 << SUB_BITS;
+    static constexpr size_t SUB_MASK = SUB_COUNT - 1;
+    static constexpr size_t BUCKETS = 64 << SUB_BITS;
+
+    /**
+     * @brief Records a value. Only the thread that owns the histogram may call this function.
+     *
+     * @param value The value to record.
+     */
+    void record(uint64_t value)
+    {
+        size_t index = value;
+
+        if (value >= SUB_COUNT)
+        {
+            int power = 63 - __builtin_clzll(value);
+            index = ((power - SUB_BITS + 1) << SUB_BITS) + ((value >> (power - SUB_BITS)) & SUB_MASK);
+        }
+
+        metricsAdd(buckets[index], 1);
+        metricsAdd(sum, value);
+    }
+
+    /**
+     * @brief Writes the buckets of the histogram in the Prometheus text format.
+     *
+     * The buckets are merged at every power of two, so the bounds are 0, 1, 3, 7, 15 and so on,
+     * up to the highest one that holds a value.
+     *
+     * @param out The output stream.
+     * @param name The name of the metric.
+     * @param labels The labels of the histogram, including the trailing comma, or an empty string.
+     */
+    void render(std::ostream &out, const std::string &name, const std::string &labels) const;
+
+private:
+    std::atomic<uint64_t> buckets[BUCKETS] = {};
+    std::atomic<uint64_t> sum = 0;
+};
+
+/**
+ * @brief Metrics of an event loop.
+ */
+struct LoopMetrics
+{
+    std::atomic<uint64_t> accepted = 0;      // Connections accepted.
+    std::atomic<uint64_t> closed = 0;        // Connections closed.
+    std::atomic<uint64_t> remoteCpu = 0;     // Connections accepted by a pinned loop whose packets arrive on another CPU.
+    std::atomic<uint64_t> bytesReceived = 0; // Bytes received from the connections.
+    std::atomic<uint64_t> reads = 0;         // Reads that returned data.
+    std::atomic<uint64_t> records = 0;       // Records handed over in framing mode.
+    std::atomic<uint64_t> residentBytes = 0; // Bytes held in memory by the buffers under the memory budget.
+    std::atomic<uint64_t> spills = 0;        // Buffers moved to spill files.
+    std::atomic<uint64_t> spilledBytes = 0;  // Bytes written to spill files.
+    std::atomic<uint64_t> paused = 0;        // Connections not read because the memory is over the high watermark.
+    std::atomic<uint64_t> pauses = 0;        // Times a connection stopped being read because of the high watermark.
+    std::atomic<const ChunkPool *> pool = nullptr; // The chunk pool of the loop, whose memory in use is reported, or nullptr.
+    std::atomic<uint64_t> waits = 0;         // Calls to Poll::wait().
+    std::atomic<uint64_t> events = 0;        // Events returned by Poll::wait().
+    std::atomic<uint64_t> spins = 0;         // Non-blocking waits made while busy polling.
+    std::atomic<uint64_t> spinWakeups = 0;   // Waits that found events while busy polling.
+    std::atomic<uint64_t> sleeps = 0;        // Waits that blocked in the kernel.
+    std::atomic<uint64_t> spinNanos = 0;     // Time spent busy polling.
+    std::atomic<uint64_t> budgetStops = 0;   // Iterations that left yielded connections for the next one because the loop budget ran out.
+    std::atomic<uint64_t> frameHits = 0;     // Coroutine frames taken from the loop's frame pool.
+    std::atomic<uint64_t> frameMisses = 0;   // Coroutine frames that needed a new slab or were too large for the pool.
+    Histogram eventsPerWait;
+    Histogram loopNanos;                     // Time spent in each iteration of the loop, excluding the wait.
+    Histogram readBytes;                     // Bytes returned by each read.
+    unsigned id = 0;
+};
+
+class Metrics
+{
+public:
+    /**
+     * @brief Gets the current time of the monotonic clock with nanosecond resolution.
+     *
+     * @return The function returns the time in nanoseconds.
+     */
+    static uint64_t nanos();
+
+    /**
+     * @brief Creates the metrics of the calling event loop and adds them to the registry.
+     *
+     * @return The function returns the metrics, which live until the process exits.
+     */
+    static LoopMetrics &add();
+
+    /**
+     * @brief Records the time spent writing a batch of output. Only the writer thread may call this function.
+     *
+     * @param nanos The time, in nanoseconds.
+     */
+    static void output(uint64_t nanos);
+
+    /**
+     * @brief Starts serving the metrics.
+     *
+     * This function blocks SIGUSR1 in the calling thread, so it must be called before any other thread is created,
+     * and starts a thread that writes the metrics to the standard error on every SIGUSR1. If a port is given,
+     * it also starts a thread that answers every connection to that port with the metrics in an HTTP response.
+     *
+     * @param port The admin port, or 0 to serve the metrics only on SIGUSR1.
+     *
+     * @throws runtime_error If the admin port cannot be opened.
+     */
+    static void start(unsigned port);
+
+    /**
+     * @brief Includes the statistics of a writer in the metrics.
+     *
+     * @param writer The writer. It must live until the process exits.
+     */
+    static void watch(Writer &writer);
+
+    /**
+     * @brief Writes all the metrics in the Prometheus text format.
+     *
+     * @param out The output stream.
+     */
+    static void render(std::ostream &out);
+};
@@ -0,0 +1,180 @@
+/**
+ * @file options.hpp
+ * @brief This file contains the declaration of the Options struct.
+ *
+ * The Options struct holds the settings given on the command line, which are shared by all the event loops.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 13, 2024
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "frame.hpp"
+#include "inbox.hpp"
+
+struct Options
+{
+    /**
+     * @brief What the event loops do with the data they receive.
+     */
+    enum Handler
+    {
+        PRINT, // The data is handed over to the writer as the other options say.
+        HASH,  // The data of every connection is counted and hashed, and a line with both is handed over when it closes.
+    };
+
+    /**
+     * @brief The port number on which the server will listen for incoming connections.
+     */
+    unsigned port = 0;
+
+    /**
+     * @brief The number of event loops, each one running on its own thread with its own listening socket.
+     */
+    unsigned threads = 1;
+
+    /**
+     * @brief Whether client sockets are registered edge-triggered and drained until EAGAIN on every wakeup.
+     */
+    bool edgeTriggered = false;
+
+    /**
+     * @brief The maximum number of bytes read from a socket without suspending, so one client cannot starve the others.
+     */
+    size_t readBudget = 65536;
+
+    /**
+     * @brief Whether all the event loops share a single listening socket, registered as exclusive, instead of one socket per loop.
+     */
+    bool sharedListener = false;
+
+    /**
+     * @brief The maximum number of connections accepted per wakeup of the listening socket.
+     */
+    unsigned acceptBudget = 64;
+
+    /**
+     * @brief How an acceptor thread hands the connections over to the event loops, or NONE to let every loop accept its own.
+     */
+    Inbox::Policy acceptor = Inbox::NONE;
+
+    /**
+     * @brief The maximum number of payloads waiting for the writer thread before the loops start holding them back.
+     */
+    size_t outputQueue = 1024;
+
+    /**
+     * @brief Whether the data of a connection is emitted in segments while it is open, instead of when it closes.
+     */
+    bool stream = false;
+
+    /**
+     * @brief In streaming mode, the number of buffered bytes of a connection that triggers a segment.
+     */
+    size_t flushBytes = 65536;
+
+    /**
+     * @brief In streaming mode, the age in milliseconds of the oldest buffered byte of a connection that triggers a segment.
+     */
+    int flushMillis = 1000;
+
+    /**
+     * @brief The time in milliseconds a connection may go without receiving data before it is shut down, or 0 for no limit.
+     */
+    unsigned idleTimeout = 0;
+
+    /**
+     * @brief The time in milliseconds a connection may stay open in total before it is shut down, or 0 for no limit.
+     */
+    unsigned lifetime = 0;
+
+    /**
+     * @brief The maximum number of events returned by each wait of an event loop.
+     */
+    int eventBatch = 1024;
+
+    /**
+     * @brief The time in microseconds an event loop spins on its poll set before blocking, or 0 to block right away.
+     */
+    unsigned busyPoll = 0;
+
+    /**
+     * @brief The SO_BUSY_POLL time in microseconds of the accepted sockets, or 0 to leave it unset.
+     */
+    unsigned socketBusyPoll = 0;
+
+    /**
+     * @brief The SO_RCVLOWAT of the accepted sockets in bytes, so that they are only reported readable once that much data arrived, or 0 to leave it unset.
+     */
+    int socketRcvLowat = 0;
+
+    /**
+     * @brief The CPUs to which the event loops are pinned in turn, or none to leave them unpinned.
+     */
+    std::vector<int> cpus;
+
+    /**
+     * @brief The port on which the metrics are served over HTTP, or 0 to only dump them on SIGUSR1.
+     */
+    unsigned metricsPort = 0;
+
+    /**
+     * @brief How the data of a connection is split into records, which are emitted as soon as they are complete.
+     */
+    Framer::Mode frame = Framer::NONE;
+
+    /**
+     * @brief In delimiter mode, the byte that ends every record.
+     */
+    char delimiter = '\n';
+
+    /**
+     * @brief The maximum size of a record. Connections that send a larger one are closed.
+     */
+    size_t maxRecord = 16777216;
+
+    /**
+     * @brief The bytes that the buffers may hold in memory in total before the largest ones spill to disk, or 0 for no limit.
+     */
+    size_t memoryBudget = 0;
+
+    /**
+     * @brief The directory where the spill files are created.
+     */
+    std::string spillDir = getenv("TMPDIR") != nullptr ? getenv("TMPDIR") : "/tmp";
+
+    /**
+     * @brief The memory held by the received data above which connections stop being read, or 0 for no limit.
+     */
+    size_t highWatermark = 0;
+
+    /**
+     * @brief The memory held by the received data below which the connections that stopped are read again.
+     */
+    size_t lowWatermark = 0;
+
+    /**
+     * @brief The bytes read in an iteration of a loop before the connections that yielded wait for the next one, or 0 for no limit.
+     */
+    size_t loopBudget = 1048576;
+
+    /**
+     * @brief The directory of the segment log where the payloads are written instead of the standard output, or empty to print them.
+     */
+    std::string logDir;
+
+    /**
+     * @brief The size at which the segments of the log roll over.
+     */
+    size_t segmentSize = 67108864;
+
+    /**
+     * @brief What the event loops do with the data they receive.
+     */
+    Handler handler = PRINT;
+};
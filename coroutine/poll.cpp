@@ -0,0 +1,64 @@
+/**
+ * @file poll.cpp
+ * @brief This file contains the busy-poll logic of the Poll class, shared by all the backends.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#include <chrono>
+#include "poll.hpp"
+
+using namespace std;
+
+/**
+ * @brief Gets the current time of the monotonic clock.
+ *
+ * @return The function returns the time in nanoseconds.
+ */
+static uint64_t nanos()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Waits for events on the poll set with the specified timeout.
+
+int Poll::wait(int timeout)
+{
+    if (timeout == 0)
+        return fetch(0);
+
+    if (spinNanos > 0)
+    {
+        uint64_t start = nanos();
+        uint64_t elapsed = 0;
+
+        do
+        {
+            int n = fetch(0);
+            statistics.spins++;
+
+            if (n != 0)
+            {
+                statistics.spinNanos += nanos() - start;
+                statistics.spinWakeups += n > 0;
+                return n;
+            }
+
+            elapsed = nanos() - start;
+        } while (elapsed < spinNanos && (timeout < 0 || elapsed < timeout * 1000000ULL));
+
+        statistics.spinNanos += elapsed;
+
+        if (timeout >= 0)
+        {
+            if (elapsed >= timeout * 1000000ULL)
+                return 0;
+
+            timeout -= elapsed / 1000000;
+        }
+    }
+
+    statistics.sleeps++;
+    return fetch(timeout);
+}
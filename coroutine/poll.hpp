@@ -12,15 +12,44 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <sys/uio.h>
+
 class Poll
 {
 public:
+    /**
+     * @brief Indicates whether the backend is completion-based.
+     *
+     * Readiness backends (epoll, kqueue) report sockets that can be read without blocking,
+     * so the caller performs the I/O afterwards. Completion backends (io_uring) perform the
+     * I/O submitted with recv() or accept() and report its result through result().
+     */
+#ifdef POLL_URING
+    static constexpr bool completion = true;
+#else
+    static constexpr bool completion = false;
+#endif
+
+    /**
+     * @brief Counters of the busy-poll mode.
+     */
+    struct Stats
+    {
+        unsigned long spins;       // Non-blocking waits made while spinning.
+        unsigned long spinWakeups; // Waits that found events while spinning.
+        unsigned long sleeps;      // Waits that blocked in the kernel.
+        unsigned long spinNanos;   // Time spent spinning, in nanoseconds.
+    };
+
     /**
      * @brief Constructs a Poll object with the specified size.
      *
-     * This constructor initializes the poll set with the specified size.
+     * This constructor initializes the poll set with the specified size. Busy polling is disabled.
+     * The size only bounds the events returned by each wait: any number of file descriptors can be added.
      *
-     * @param size The maximum number of file descriptors that can be added to the poll set.
+     * @param size The maximum number of events returned by each call to wait().
      */
     Poll(int size);
 
@@ -29,20 +58,70 @@ public:
      */
     ~Poll();
 
+    /**
+     * @brief Flag for add(): report the file descriptor only when it becomes ready, not while it stays ready.
+     */
+    static constexpr int EDGE = 1;
+
+    /**
+     * @brief Flag for add(): when several poll sets wait on the file descriptor, wake up only one of them per event.
+     */
+    static constexpr int EXCLUSIVE = 2;
+
     /**
      * @brief Adds the specified file descriptor to the poll set.
      *
      * This function adds the specified file descriptor to the poll set for monitoring I/O events.
+     * By default, events are level-triggered. With the EDGE flag, the caller must drain the file descriptor
+     * until it would block before waiting for it again.
      *
      * @param fd The file descriptor to be added to the poll set.
+     * @param flags A combination of the flags above, or 0.
+     */
+    void add(int fd, int flags = 0);
+
+    /**
+     * @brief Flag for modify(): stop reporting that the file descriptor is readable, until it is modified without this flag.
+     */
+    static constexpr int PAUSED = 4;
+
+    /**
+     * @brief Changes the events reported for a file descriptor already in the poll set.
+     *
+     * With the PAUSED flag, the file descriptor is no longer reported as readable, so the data that arrives stays in the kernel,
+     * and TCP flow control eventually stops the sender. Errors and hang-ups may still be reported.
+     * The flags replace the ones given to add(), except EXCLUSIVE, which cannot be changed.
+     * Completion backends only report the operations submitted, so this function does nothing on them.
+     *
+     * @param fd The file descriptor.
+     * @param flags A combination of the flags other than EXCLUSIVE, or 0.
+     */
+    void modify(int fd, int flags);
+
+    /**
+     * @brief Sets how long wait() spins before blocking.
+     *
+     * While spinning, the poll set is checked without blocking, so an event that arrives in the meantime is picked up
+     * without the cost of putting the thread to sleep and waking it up, at the price of the CPU time spent spinning.
+     *
+     * @param micros The spin time, in microseconds, or 0 to block right away.
      */
-    void add(int fd);
+    void spin(unsigned micros) { spinNanos = micros * 1000UL; }
+
+    /**
+     * @brief Retrieves the counters of the busy-poll mode.
+     *
+     * @return The function returns the counters.
+     */
+    const Stats &stats() const { return statistics; }
 
     /**
      * @brief Waits for events on the poll set with the specified timeout.
      *
      * This function waits for events on the poll set for the specified timeout period.
      * If an event occurs on any of the file descriptors in the poll set, the function returns the number of events.
+     * If a spin time is set, the poll set is checked without blocking until events arrive, the spin time passes
+     * or the timeout expires, and only then does the function block for the rest of the timeout.
      *
      * @param timeout The maximum time to wait for events, in milliseconds. If timeout is negative, the function will block indefinitely.
      *
@@ -61,8 +140,51 @@ public:
      */
     int operator[](int i);
 
+    /**
+     * @brief Submits an asynchronous vectored read on the specified socket.
+     *
+     * The data is received into the provided buffers, and a completion is reported on the next call to wait().
+     * Only available on completion backends.
+     *
+     * @param fd The socket from which data should be received.
+     * @param iov The buffers where the data will be stored. They must remain valid until the completion is reported.
+     * @param count The number of buffers.
+     */
+    void readv(int fd, const iovec *iov, int count);
+
+    /**
+     * @brief Submits an asynchronous accept on the specified listening socket.
+     *
+     * A completion is reported on the next call to wait(). Only available on completion backends.
+     *
+     * @param fd The listening socket.
+     */
+    void accept(int fd);
+
+    /**
+     * @brief Retrieves the result of the operation associated with the specified event index.
+     *
+     * Only available on completion backends.
+     *
+     * @param i The index of the event for which the result should be retrieved.
+     *
+     * @return The function returns the number of bytes received or the accepted socket, or a negated errno value on failure.
+     */
+    int result(int i);
+
 private:
+    /**
+     * @brief Waits for events once, without spinning. Every backend implements this function, and wait() builds on it.
+     *
+     * @param timeout The maximum time to wait for events, in milliseconds. If timeout is negative, the function will block indefinitely.
+     *
+     * @return The function returns the number of events that occurred on the poll set.
+     */
+    int fetch(int timeout);
+
     int size;
     int polld;
     void * events;
+    uint64_t spinNanos = 0;
+    Stats statistics = {};
 };
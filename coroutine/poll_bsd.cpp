@@ -33,16 +33,25 @@ Poll::~Poll()
     delete[] (struct kevent *)events;
 }
 
-void Poll::add(int fd)
+void Poll::add(int fd, int flags)
 {
     struct kevent request;
-    EV_SET(&request, fd, EVFILT_READ, EV_ADD, 0, 0, 0);
+    EV_SET(&request, fd, EVFILT_READ, EV_ADD | (flags & EDGE ? EV_CLEAR : 0), 0, 0, 0);
 
     if (kevent(polld, &request, 1, NULL, 0, NULL) < 0)
         throw runtime_error("Failed to add file descriptor to epoll");
 }
 
-int Poll::wait(int timeout)
+void Poll::modify(int fd, int flags)
+{
+    struct kevent request;
+    EV_SET(&request, fd, EVFILT_READ, (flags & PAUSED ? EV_DISABLE : EV_ENABLE) | (flags & EDGE ? EV_CLEAR : 0), 0, 0, 0);
+
+    if (kevent(polld, &request, 1, NULL, 0, NULL) < 0)
+        throw runtime_error("Failed to modify file descriptor in kqueue");
+}
+
+int Poll::fetch(int timeout)
 {
     struct timespec ts = { timeout / 1000, (timeout % 1000) * 1000000 };
     return kevent(polld, NULL, 0, (struct kevent *)events, size, timeout >= 0 ? &ts : NULL);
@@ -32,15 +32,25 @@ Poll::~Poll()
     delete[] (epoll_event *)events;
 }
 
-void Poll::add(int fd)
+void Poll::add(int fd, int flags)
 {
-    struct epoll_event request = {.events = EPOLLIN, .data = {.fd = fd}};
+    uint32_t events = EPOLLIN | (flags & EDGE ? (uint32_t)EPOLLET : 0) | (flags & EXCLUSIVE ? (uint32_t)EPOLLEXCLUSIVE : 0);
+    struct epoll_event request = {.events = events, .data = {.fd = fd}};
 
     if (epoll_ctl(polld, EPOLL_CTL_ADD, fd, &request) == -1)
         throw runtime_error("Failed to add file descriptor to epoll");
 }
 
-int Poll::wait(int timeout)
+void Poll::modify(int fd, int flags)
+{
+    uint32_t events = (flags & PAUSED ? 0 : (uint32_t)EPOLLIN) | (flags & EDGE ? (uint32_t)EPOLLET : 0);
+    struct epoll_event request = {.events = events, .data = {.fd = fd}};
+
+    if (epoll_ctl(polld, EPOLL_CTL_MOD, fd, &request) == -1)
+        throw runtime_error("Failed to modify file descriptor in epoll");
+}
+
+int Poll::fetch(int timeout)
 {
     return epoll_wait(polld, (epoll_event *)events, size, timeout);
 }
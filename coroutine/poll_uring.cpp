@@ -0,0 +1,245 @@
+/**
+ * @file poll_uring.cpp
+ * @brief This file contains the implementation of the Poll class, which provides an interface for asynchronous socket I/O using the io_uring mechanism.
+ *
+ * Unlike the epoll and kqueue backends, this backend is completion-based: receives and accepts are queued as
+ * submission entries, handed to the kernel in a single io_uring_enter() call together with the wait for completions,
+ * and their results are reported through the completion queue. No liburing is required; the rings are mapped directly.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#include "poll.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+using namespace std;
+
+struct Ring
+{
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned *sqArray;
+    io_uring_sqe *sqes;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned cqMask;
+    io_uring_cqe *cqes;
+    void *sqRing;
+    size_t sqRingSize;
+    void *cqRing;
+    size_t cqRingSize;
+    size_t sqesSize;
+    unsigned pending;
+    io_uring_cqe *events;
+};
+
+static int uringSetup(unsigned entries, io_uring_params *params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, const void *arg, size_t argSize)
+{
+    return syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize);
+}
+
+/**
+ * @brief Submits the pending entries and optionally waits for completions.
+ *
+ * @param polld The io_uring file descriptor.
+ * @param ring The ring state.
+ * @param minComplete The number of completions to wait for.
+ * @param timeout The maximum time to wait, in milliseconds. If negative, the call blocks indefinitely.
+ *
+ * @return The function returns 0 on success, or -1 on error.
+ */
+static int submit(int polld, Ring *ring, unsigned minComplete, int timeout)
+{
+    if (minComplete == 0 && ring->pending == 0)
+        return 0;
+
+    unsigned flags = minComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+    struct __kernel_timespec ts = {timeout / 1000, (timeout % 1000) * 1000000L};
+    io_uring_getevents_arg arg = {0, _NSIG / 8, 0, (__u64)&ts};
+    int result;
+
+    if (minComplete > 0 && timeout >= 0)
+        result = uringEnter(polld, ring->pending, minComplete, flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    else
+        result = uringEnter(polld, ring->pending, minComplete, flags, NULL, _NSIG / 8);
+
+    if (result >= 0)
+        ring->pending -= result;
+    else if (errno == ETIME)
+        return 0;
+
+    return result < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Gets a free submission queue entry, flushing the queue to the kernel if it is full.
+ *
+ * @param polld The io_uring file descriptor.
+ * @param ring The ring state.
+ *
+ * @return The function returns a zeroed submission queue entry.
+ */
+static io_uring_sqe *getEntry(int polld, Ring *ring)
+{
+    unsigned tail = *ring->sqTail;
+
+    while (tail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) == ring->sqEntries)
+        if (submit(polld, ring, 0, 0) == -1 && errno != EAGAIN && errno != EBUSY && errno != EINTR)
+            throw runtime_error("Failed to submit io_uring entries");
+
+    unsigned index = tail & ring->sqMask;
+    io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+
+    ring->sqArray[index] = index;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+    ring->pending++;
+
+    return sqe;
+}
+
+Poll::Poll(int size) : size(size)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = size * 2;
+
+    polld = uringSetup(size, &params);
+
+    if (polld == -1)
+        throw runtime_error("Failed to create io_uring instance");
+
+    if (!(params.features & IORING_FEAT_NODROP))
+    {
+        close(polld);
+        throw runtime_error("The kernel does not support io_uring without completion drops");
+    }
+
+    Ring *ring = new Ring();
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        ring->sqRingSize = ring->cqRingSize = max(ring->sqRingSize, ring->cqRingSize);
+
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, polld, IORING_OFF_SQ_RING);
+    ring->cqRing = params.features & IORING_FEAT_SINGLE_MMAP ? ring->sqRing : mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, polld, IORING_OFF_CQ_RING);
+    ring->sqes = (io_uring_sqe *)mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, polld, IORING_OFF_SQES);
+
+    if (ring->sqRing == MAP_FAILED || ring->cqRing == MAP_FAILED || ring->sqes == MAP_FAILED)
+    {
+        close(polld);
+        delete ring;
+        throw runtime_error("Failed to map io_uring queues");
+    }
+
+    char *sq = (char *)ring->sqRing;
+    ring->sqHead = (unsigned *)(sq + params.sq_off.head);
+    ring->sqTail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sqMask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sqEntries = *(unsigned *)(sq + params.sq_off.ring_entries);
+    ring->sqArray = (unsigned *)(sq + params.sq_off.array);
+
+    char *cq = (char *)ring->cqRing;
+    ring->cqHead = (unsigned *)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cqMask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    ring->events = new io_uring_cqe[size];
+    events = ring;
+}
+
+Poll::~Poll()
+{
+    Ring *ring = (Ring *)events;
+
+    munmap(ring->sqes, ring->sqesSize);
+
+    if (ring->cqRing != ring->sqRing)
+        munmap(ring->cqRing, ring->cqRingSize);
+
+    munmap(ring->sqRing, ring->sqRingSize);
+    close(polld);
+    delete[] ring->events;
+    delete ring;
+}
+
+void Poll::add(int fd, int flags)
+{
+    // Completion-based: there is no interest set, operations are submitted individually.
+}
+
+void Poll::modify(int fd, int flags)
+{
+    // A paused socket simply has no read submitted.
+}
+
+void Poll::readv(int fd, const iovec *iov, int count)
+{
+    io_uring_sqe *sqe = getEntry(polld, (Ring *)events);
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = fd;
+    sqe->addr = (__u64)iov;
+    sqe->len = count;
+    sqe->user_data = fd;
+}
+
+void Poll::accept(int fd)
+{
+    io_uring_sqe *sqe = getEntry(polld, (Ring *)events);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = fd;
+}
+
+int Poll::fetch(int timeout)
+{
+    Ring *ring = (Ring *)events;
+    unsigned head = *ring->cqHead;
+    bool ready = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE) != head;
+
+    // Queued entries are submitted in the same system call that waits for completions.
+    if (submit(polld, ring, ready ? 0 : 1, timeout) == -1)
+        return -1;
+
+    unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+    int n = 0;
+
+    for (; head != tail && n < size; head++, n++)
+        ring->events[n] = ring->cqes[head & ring->cqMask];
+
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+int Poll::operator[](int i)
+{
+    return ((Ring *)events)->events[i].user_data;
+}
+
+int Poll::result(int i)
+{
+    return ((Ring *)events)->events[i].res;
+}
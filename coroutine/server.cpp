@@ -9,20 +9,35 @@
  * @date July 13, 2024
  */
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <stdexcept>
-#include <string>
+#include <climits>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 
+#include "cpu.hpp"
 #include "server.hpp"
 #include "poll.hpp"
 
 using namespace std;
 
+// Identifiers of the connections, shared by all the servers.
+
+static atomic<unsigned long> connections(0);
+
+template <class Handler>
+Server<Handler>::Stream::Stream(ChunkPool &pool, int sock) : Connection<typename Handler::State>(pool, sock, connections.fetch_add(1, memory_order_relaxed) + 1), receiveSize(RECEIVE_INITIAL), paused(nullptr) {}
+
 // Destroys the Server object and frees the allocated memory.
 
-Server::~Server()
+template <class Handler>
+Server<Handler>::~Server()
 {
     if (serverSock != -1)
         close(serverSock);
@@ -33,16 +48,35 @@ Server::~Server()
 /**
  * @brief Runs the server, opening the port, binding it, and accepting client connections.
  *
- * This function initializes the server by opening the specified port, binding it to the server socket,
- * and then entering a loop to accept client connections. Once a client connection is accepted,
+ * This function initializes the server by opening the specified port, unless a listening socket or an inbox was given,
+ * and then entering a loop to accept client connections, or to take them from the inbox. Once a client connection is accepted,
  * the server will handle the client asynchronously using coroutines.
  *
  * @return void
  */
-void Server::run()
+template <class Handler>
+void Server<Handler>::run()
 {
-    openPort();
-    acceptClients();
+    if (serverSock == -1 && inbox == nullptr)
+        serverSock = openPort(options);
+
+    poll.spin(options.busyPoll);
+
+    // The watermarks are split evenly among the loops too, since each loop takes its chunks from its own pool.
+    highWatermark = (options.highWatermark + options.threads - 1) / options.threads;
+    lowWatermark = (options.lowWatermark + options.threads - 1) / options.threads;
+    metrics.pool.store(&chunks, memory_order_release);
+
+    if (inbox != nullptr)
+    {
+        poll.add(inbox->fd());
+
+        if constexpr (Poll::completion)
+            poll.readv(inbox->fd(), inbox->buffer(), 1);
+    }
+    else
+        acceptClients();
+
     loop();
 }
 
@@ -52,23 +86,36 @@ void Server::run()
  * This function creates a TCP socket, sets its address family to AF_INET,
  * and sets the socket type to SOCK_STREAM. It then attempts to open the socket,
  * binds it to the specified port, and listens for incoming connections.
+ * When several threads run with their own sockets, SO_REUSEPORT lets each one bind its own socket and the kernel balances connections among them.
+ * The socket is non-blocking, so that pending connections can be accepted in batches until the backlog is empty.
  * If any of these operations fail, a runtime_error is thrown with an appropriate error message.
  *
- * @return void
+ * @param options The options of the server.
+ *
+ * @return The function returns the listening socket.
  *
  * @throws runtime_error If an error occurs while opening, binding, or listening to the socket.
  */
-void Server::openPort()
+template <class Handler>
+int Server<Handler>::openPort(const Options &options)
 {
-    serverSock = socket(AF_INET, SOCK_STREAM, 0);
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
 
-    if (serverSock == -1)
+    if (sock == -1)
         throw runtime_error("Error opening socket");
 
-    bindPort();
+    int enable = 1;
+
+    if (options.threads > 1 && !options.sharedListener && options.acceptor == Inbox::NONE && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) == -1)
+        throw runtime_error("Error setting SO_REUSEPORT");
+
+    bindPort(sock, options.port);
 
-    if (listen(serverSock, TCP_BACKLOG) == -1)
+    if (listen(sock, TCP_BACKLOG) == -1)
         throw runtime_error("Error listening on port");
+
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+    return sock;
 }
 
 /**
@@ -79,49 +126,121 @@ void Server::openPort()
  * It then attempts to bind the server socket to the specified address and port.
  * If the binding operation fails, a runtime_error is thrown with an appropriate error message.
  *
+ * @param sock The socket to be bound.
+ * @param port The port number to bind the socket to.
+ *
  * @return void
  *
  * @throws runtime_error If an error occurs while binding the socket.
  */
-void Server::bindPort()
+template <class Handler>
+void Server<Handler>::bindPort(int sock, unsigned port)
 {
     struct sockaddr_in addr;
     addr.sin_family = AF_INET;
     addr.sin_port = htons(port);
     addr.sin_addr.s_addr = INADDR_ANY;
 
-    if (::bind(serverSock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    if (::bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
         throw runtime_error("Error binding socket");
 }
 
+/**
+ * @brief Accepts a pending connection on the specified listening socket.
+ *
+ * The accepted socket is non-blocking and close-on-exec. The call only blocks if the listening socket does.
+ *
+ * @param serverSock The listening socket.
+ *
+ * @return The function returns the accepted socket, or -1 on error.
+ */
+template <class Handler>
+int Server<Handler>::acceptSocket(int serverSock)
+{
+#ifdef __linux__
+    return accept4(serverSock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+    int sock = accept(serverSock, NULL, NULL);
+
+    if (sock != -1)
+    {
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+        fcntl(sock, F_SETFD, FD_CLOEXEC);
+    }
+
+    return sock;
+#endif
+}
+
+/**
+ * @brief Enables kernel busy polling on an accepted socket.
+ *
+ * With SO_BUSY_POLL, the kernel polls the device queue of the socket for up to the given time before sleeping,
+ * and SO_PREFER_BUSY_POLL asks it to keep polling instead of falling back to interrupts while the loop is busy.
+ * Raising SO_BUSY_POLL above net.core.busy_read requires CAP_NET_ADMIN, so a failure is reported once and ignored.
+ *
+ * @param sock The accepted socket.
+ */
+template <class Handler>
+void Server<Handler>::setBusyPoll(int sock)
+{
+#ifdef SO_BUSY_POLL
+    static thread_local bool warned = false;
+    int usec = options.socketBusyPoll;
+
+    if (setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) == -1 && !warned)
+    {
+        cerr << "Error setting SO_BUSY_POLL" << endl;
+        warned = true;
+    }
+
+#ifdef SO_PREFER_BUSY_POLL
+    int enable = 1;
+    setsockopt(sock, SOL_SOCKET, SO_PREFER_BUSY_POLL, &enable, sizeof(enable));
+#endif
+#endif
+}
+
 /**
  * @brief Accepts incoming client connections and handles them asynchronously using coroutines.
  *
  * This function continuously listens for incoming client connections on the server socket.
  * When a client connection is accepted, the function creates a new socket for the client,
  * adds it to the poll for asynchronous I/O, and then calls the handleClient function to handle the client connection.
+ * On readiness backends, every wakeup accepts connections until the backlog is empty or the accept budget runs out.
+ * If the listening socket is shared with other loops, it is registered as exclusive so that a connection wakes up only one of them.
  *
  * @return A coroutine task that can be awaited.
  *
  * @throws runtime_error If an error occurs while accepting a client connection.
  */
-Task Server::acceptClients()
+template <class Handler>
+Task Server<Handler>::acceptClients()
 {
-    poll.add(serverSock);
+    poll.add(serverSock, options.sharedListener ? Poll::EXCLUSIVE : 0);
 
     while (true)
     {
-        co_await SocketAwaitable(*this, serverSock);
+        int sock = co_await SocketAwaitable(*this, serverSock);
 
-        int sock = accept(serverSock, NULL, NULL);
+        for (unsigned accepted = 1; sock != -1; accepted++)
+        {
+            handleClient(sock);
+
+            if (Poll::completion || accepted == options.acceptBudget)
+                break;
 
-        if (sock == -1)
+            sock = acceptSocket(serverSock);
+        }
+
+        if (sock == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
         {
             cerr << "Error accepting client" << endl;
-            continue;
-        }
 
-        handleClient(sock);
+            // Out of descriptors or memory, the listening socket stays ready: back off instead of spinning.
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+                co_await sleep(ACCEPT_RETRY_MILLIS);
+        }
     }
 }
 
@@ -130,6 +249,15 @@ Task Server::acceptClients()
  *
  * This function accepts an incoming client connection on the specified socket,
  * adds the socket to the poll for asynchronous I/O, and then continuously receives data from the client.
+ * Every read is tried before suspending, so the socket is read until it would block before awaiting it again,
+ * and the coroutine yields to the rest of the loop each time it reads the configured budget without suspending.
+ * The data is received with readv() straight into the free space of a chunked buffer from the loop's pool,
+ * as much of it per read as adapt() settled on from the previous reads.
+ * The handler sees the connection when it starts, after every read that returns data, and once its socket is closed,
+ * and a connection whose data the handler rejects is closed.
+ * When the loop holds more memory than the high watermark, the connection that just read is paused: its socket stops
+ * reporting readable data and the coroutine waits until resumePaused() lets it go on.
+ * If the idle timeout or the lifetime of the connection expires, the socket is shut down and the connection ends as if the client closed it.
  * When the client disconnects or an error occurs during data reception, the function closes the socket and stops handling the client.
  *
  * @param sock The socket descriptor for the client connection.
@@ -138,63 +266,439 @@ Task Server::acceptClients()
  *
  * @throws runtime_error If an error occurs while accepting a client connection or receiving data.
  */
-Task Server::handleClient(int sock)
+template <class Handler>
+Task Server<Handler>::handleClient(int sock)
 {
-    poll.add(sock);
-    string buffer;
+    if (options.socketBusyPoll > 0)
+        setBusyPoll(sock);
+
+    if (options.socketRcvLowat > 0 && setsockopt(sock, SOL_SOCKET, SO_RCVLOWAT, &options.socketRcvLowat, sizeof(options.socketRcvLowat)) == -1)
+        cerr << "Error setting SO_RCVLOWAT" << endl;
+
+    int flags = options.edgeTriggered ? Poll::EDGE : 0;
+    poll.add(sock, flags);
+    Stream stream(chunks, sock);
+    size_t budget = options.readBudget;
+    ShutdownTimer idle(sock), lifetime(sock);
+    metricsAdd(metrics.accepted, 1);
+    openConnections++;
+
+    if (cpu != -1 && Cpu::incoming(sock) != cpu)
+        metricsAdd(metrics.remoteCpu, 1);
+
+    if (options.idleTimeout > 0)
+        timers.add(idle, TimerWheel::now() + options.idleTimeout);
+
+    if (options.lifetime > 0)
+        timers.add(lifetime, TimerWheel::now() + options.lifetime);
+
+    streams[sock] = &stream;
+
+    if constexpr (requires { handler.onAccept(stream); })
+        handler.onAccept(stream);
 
     for (auto active = true; active;)
     {
-        co_await SocketAwaitable(*this, sock);
+        // Drain the socket until it would block, yielding to other connections when the read budget runs out.
+        if (budget == 0)
+        {
+            co_await DeferAwaitable(*this);
+            budget = options.readBudget;
+        }
 
-        char data[BUFFER_LENGTH];
-        ssize_t bytesReceived = recv(sock, data, BUFFER_LENGTH - 1, 0);
+        SocketAwaitable receive(*this, sock, &stream.buffer, stream.receiveSize);
+        ssize_t bytesReceived = co_await receive;
+
+        if (!receive.completedInline())
+            budget = options.readBudget;
+
+        budget -= min<size_t>(budget, max<ssize_t>(bytesReceived, 0));
+
+        // The data was received in place, so it only needs to be committed.
+        stream.buffer.commit(max<ssize_t>(bytesReceived, 0));
+
+        if (bytesReceived > 0)
+        {
+            loopBytes += bytesReceived;
+            metricsAdd(metrics.reads, 1);
+            metricsAdd(metrics.bytesReceived, bytesReceived);
+            metrics.readBytes.record(bytesReceived);
+            adapt(sock, stream, bytesReceived, receive.reservation());
+
+            if (options.idleTimeout > 0)
+                timers.add(idle, TimerWheel::now() + options.idleTimeout);
+
+            if (!handler.onData(stream, bytesReceived))
+            {
+                close(sock);
+                metricsAdd(metrics.closed, 1);
+                break;
+            }
+        }
 
         switch (bytesReceived)
         {
         case -1:
-            cerr << "Error receiving data from client" << endl;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                cerr << "Error receiving data from client" << endl;
+
             break;
 
         case 0:
             close(sock);
+            metricsAdd(metrics.closed, 1);
             active = false;
             break;
+        }
 
-        default:
-            data[bytesReceived] = '\0';
-            buffer.append(data);
+        if (active && bytesReceived > 0 && throttled())
+        {
+            poll.modify(sock, flags | Poll::PAUSED);
+            metricsAdd(metrics.pauses, 1);
+            co_await PauseAwaitable(*this, stream);
+            poll.modify(sock, flags);
+            budget = options.readBudget;
         }
     }
 
-    cout << "[" << sock << "]: " << buffer << endl;
+    streams[sock] = nullptr;
+    openConnections--;
+
+    if (inbox != nullptr)
+        inbox->release();
+
+    handler.onClose(stream);
+}
+
+/**
+ * @brief Adapts the space reserved for the next read of a connection to the reads so far.
+ *
+ * A read that fills its space means that more data is waiting, so the space doubles, or grows at once to the bytes
+ * that FIONREAD reports in the socket, so bulk senders are read in fewer calls. The socket is only queried when
+ * the space grows, so it costs nothing once the space reaches its maximum. A read that fills less than a quarter
+ * halves the space, so a connection that goes quiet or sends little does not keep a spare chunk reserved
+ * for every read, which a pending receive of a completion backend holds until it completes.
+ *
+ * @param sock The socket of the connection.
+ * @param stream The data of the connection.
+ * @param received The bytes received by the last read.
+ * @param reserved The space reserved for the last read.
+ */
+template <class Handler>
+void Server<Handler>::adapt(int sock, Stream &stream, size_t received, size_t reserved)
+{
+    if (received == reserved && stream.receiveSize < RECEIVE_MAX)
+    {
+        int pending = 0;
+        ioctl(sock, FIONREAD, &pending);
+        stream.receiveSize = min<size_t>(max<size_t>(stream.receiveSize * 2, pending), RECEIVE_MAX);
+    }
+    else if (received < stream.receiveSize / 4)
+        stream.receiveSize = max<size_t>(stream.receiveSize / 2, RECEIVE_MIN);
+}
+
+/**
+ * @brief Checks whether the writer has nothing left to write, so waiting for it would not free any memory.
+ *
+ * If the handler hands data over on its own, as in streaming mode, waiting frees memory anyway.
+ *
+ * @return The function returns true if the memory of the loop can only be freed by reading more.
+ */
+template <class Handler>
+bool Server<Handler>::stalled()
+{
+    if constexpr (requires { handler.drains(); })
+        if (handler.drains())
+            return false;
+
+    return !writer.pending() && writer.stats().depth == 0;
+}
+
+/**
+ * @brief Checks whether the connection that just read must be paused because the loop is above the high watermark,
+ * or because the loop holds as many payloads as the writer queue takes.
+ *
+ * The last connection that is still reading is not paused if the writer is idle, because in accumulate and framing modes
+ * the memory is only freed once a connection ends or completes a record. The writer is not idle while the loop holds payloads.
+ *
+ * @return The function returns true if the connection must be paused.
+ */
+template <class Handler>
+bool Server<Handler>::throttled()
+{
+    if (writer.full())
+        return true;
+
+    if (highWatermark == 0 || chunks.memory() <= highWatermark)
+        return false;
+
+    return openConnections - paused.size() > 1 || !stalled();
+}
+
+/**
+ * @brief Resumes a paused connection ahead of the others, removing it from the list of paused connections.
+ *
+ * @param stream The data of the connection, which must be paused.
+ */
+template <class Handler>
+void Server<Handler>::unpause(Stream &stream)
+{
+    paused.erase(find(paused.begin(), paused.end(), &stream));
+    deferred.push_back(stream.paused);
+    stream.paused = nullptr;
+}
+
+/**
+ * @brief Resumes the paused connections once the memory of the loop falls below the low watermark,
+ * and the payloads held by the loop fit in the writer queue again.
+ *
+ * If every connection is paused and the writer is idle, the oldest one is resumed anyway, so that the loop does not stall.
+ * The connections run again on the next iteration of the loop.
+ */
+template <class Handler>
+void Server<Handler>::resumePaused()
+{
+    size_t count = 0;
+
+    if (writer.full())
+        return;
+
+    if (highWatermark == 0 || chunks.memory() < lowWatermark)
+        count = paused.size();
+    else if (!paused.empty() && paused.size() == openConnections && stalled())
+        count = 1;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        deferred.push_back(paused[i]->paused);
+        paused[i]->paused = nullptr;
+    }
+
+    paused.erase(paused.begin(), paused.begin() + count);
+}
+
+/**
+ * @brief Combines two poll timeouts, where a negative value means no timeout.
+ *
+ * @param a The first timeout, in milliseconds.
+ * @param b The second timeout, in milliseconds.
+ *
+ * @return The function returns the shortest of the two timeouts.
+ */
+static int earliest(int a, int b)
+{
+    return a < 0 ? b : b < 0 ? a : min(a, b);
 }
 
 /**
  * @brief Runs the server's main event loop, handling client connections asynchronously.
  *
- * This function continuously polls the server's poll object for active sockets.
- * When an active socket is detected, the function retrieves the corresponding coroutine handler,
- * removes the socket from the socketHandlers map, and resumes the coroutine to handle the client connection.
+ * This function continuously polls the server's poll object for active sockets, waiting once per batch of events.
+ * When an active socket is detected, the function retrieves the corresponding awaitable from the socketHandlers table,
+ * which is indexed by file descriptor and grows in pages, clears the slot, and resumes its coroutine to handle the client connection.
+ * Dispatching an event therefore costs neither a tree lookup nor an allocation.
+ * The events of the listening socket, or of the inbox if an acceptor thread hands the connections over, are dispatched
+ * before the others, so that accepting never waits behind a full batch.
+ * Coroutines that yielded are resumed after the events, as long as the bytes read in the iteration stay within the loop budget,
+ * and the wait does not block while there are any left.
+ * Payloads held back because the writer queue was full are retried at the end of every iteration,
+ * and then the connections paused by the high watermark are resumed if the memory of the loop went down.
+ * If the handler has work of its own, such as handing over the segments that got old in streaming mode,
+ * it runs before waiting, and the wait ends when the handler needs to run again.
+ * Likewise, the timer wheel is advanced before waiting, and the wait ends when the wheel needs to be advanced again.
+ * With busy polling, the wait spins on the poll set before blocking, so that events arriving soon are picked up without sleeping.
+ * The loop records its own metrics: the events returned by each wait, how many wakeups came from spinning rather than sleeping,
+ * the time spent on everything else, and the frame pool counters.
  *
  * @return void
  *
  * @note This function runs indefinitely until the server is stopped externally.
  */
-void Server::loop()
+template <class Handler>
+void Server<Handler>::loop()
 {
     while (true)
     {
-        for (auto i = 0; i < poll.wait(TIMEOUT_MILLIS); i++)
+        uint64_t start = Metrics::nanos();
+        int timeout = TIMEOUT_MILLIS;
+        loopBytes = 0;
+
+        if constexpr (requires { handler.onLoop(); })
+            timeout = earliest(timeout, handler.onLoop());
+
+        if (timers.size() > 0)
         {
-            int j = poll[i];
-            auto handler = socketHandlers[poll[i]];
-            socketHandlers.erase(poll[i]);
-            handler.resume();
+            uint64_t now = TimerWheel::now();
+            timers.advance(now);
+            timeout = earliest(timeout, timers.timeout(now));
         }
+
+        if (writer.pending() || !paused.empty())
+            timeout = earliest(timeout, RETRY_MILLIS);
+
+        if (!deferred.empty())
+            timeout = 0;
+
+        uint64_t waitStart = Metrics::nanos();
+        int nEvents = poll.wait(timeout);
+        start += Metrics::nanos() - waitStart;
+
+        metrics.spins.store(poll.stats().spins, memory_order_relaxed);
+        metrics.spinWakeups.store(poll.stats().spinWakeups, memory_order_relaxed);
+        metrics.sleeps.store(poll.stats().sleeps, memory_order_relaxed);
+        metrics.spinNanos.store(poll.stats().spinNanos, memory_order_relaxed);
+        metricsAdd(metrics.waits, 1);
+        metricsAdd(metrics.events, max(nEvents, 0));
+        metrics.eventsPerWait.record(max(nEvents, 0));
+
+        // New connections are accepted first, so that a batch full of busy connections does not hold them back.
+        int listener = inbox != nullptr ? inbox->fd() : serverSock;
+
+        for (auto i = 0; i < nEvents; i++)
+            if (poll[i] == listener)
+                dispatch(i);
+
+        for (auto i = 0; i < nEvents; i++)
+            if (poll[i] != listener)
+                dispatch(i);
+
+        resumeDeferred();
+        writer.flush();
+        resumePaused();
+        metrics.paused.store(paused.size(), memory_order_relaxed);
+
+        auto frames = FramePool::stats();
+        metrics.frameHits.store(frames.hits, memory_order_relaxed);
+        metrics.frameMisses.store(frames.misses, memory_order_relaxed);
+        metrics.loopNanos.record(Metrics::nanos() - start);
     }
 }
 
+/**
+ * @brief Resumes the coroutine that waits for an event of the last wait.
+ *
+ * On completion backends, the result of the operation is stored in the awaitable before resuming.
+ *
+ * @param i The index of the event.
+ */
+template <class Handler>
+void Server<Handler>::dispatch(int i)
+{
+    if (inbox != nullptr && poll[i] == inbox->fd())
+    {
+        receiveClients();
+        return;
+    }
+
+    SocketAwaitable **slot = socketHandlers.find(poll[i]);
+
+    if (slot == nullptr || *slot == nullptr)
+    {
+        // A paused socket still reports errors and hang-ups, so its connection runs to find out.
+        Stream **stream = streams.find(poll[i]);
+
+        if (stream != nullptr && *stream != nullptr && (*stream)->paused)
+            unpause(**stream);
+
+        return;
+    }
+
+    auto awaitable = *slot;
+    *slot = nullptr;
+
+    if constexpr (Poll::completion)
+        awaitable->result = poll.result(i);
+
+    awaitable->handle.resume();
+}
+
+/**
+ * @brief Starts handling the connections that the acceptor thread put in the inbox of the loop.
+ *
+ * The notifications are consumed first, so that a connection put in the meantime wakes the loop up again.
+ * On completion backends, the notifications were consumed by the completed read, and the next one is submitted afterwards.
+ */
+template <class Handler>
+void Server<Handler>::receiveClients()
+{
+    if constexpr (!Poll::completion)
+        inbox->drain();
+
+    for (int sock; (sock = inbox->pop()) != -1;)
+        handleClient(sock);
+
+    if constexpr (Poll::completion)
+        poll.readv(inbox->fd(), inbox->buffer(), 1);
+}
+
+/**
+ * @brief Resumes the coroutines that yielded before this iteration, in the order they yielded, while the loop budget lasts.
+ *
+ * At least one coroutine runs per iteration, and the ones left keep their place ahead of those that yield in this iteration,
+ * so a few heavy senders cannot delay the events of the other connections by more than the budget.
+ */
+template <class Handler>
+void Server<Handler>::resumeDeferred()
+{
+    size_t count = deferred.size();
+    size_t i = 0;
+
+    for (; i < count && (i == 0 || options.loopBudget == 0 || loopBytes < options.loopBudget); i++)
+    {
+        auto handle = deferred.front();
+        deferred.pop_front();
+        handle.resume();
+    }
+
+    if (i < count)
+        metricsAdd(metrics.budgetStops, 1);
+}
+
+/**
+ * @brief Reserves the space of the read in the buffer.
+ *
+ * @return The function returns the number of I/O vectors filled.
+ */
+template <class Handler>
+int Server<Handler>::SocketAwaitable::reserve()
+{
+    count = buffer->space(size, iov);
+    reserved = 0;
+
+    for (int i = 0; i < count; i++)
+        reserved += iov[i].iov_len;
+
+    return count;
+}
+
+/**
+ * @brief Tries to read from the socket without suspending the coroutine.
+ *
+ * The read is non-blocking. If it would block, the reserved space is released and the coroutine is suspended;
+ * otherwise, its result is kept for await_resume() in the same form as the completion backends report it.
+ * Accepts are never speculative, since acceptClients() already accepts in batches.
+ *
+ * @return The function returns true if the read completed, so the coroutine does not need to be suspended.
+ */
+template <class Handler>
+bool Server<Handler>::SocketAwaitable::await_ready()
+{
+    if (buffer == nullptr)
+        return false;
+
+    ssize_t n = ::readv(sock, iov, reserve());
+
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        buffer->commit(0);
+        return false;
+    }
+
+    result = n >= 0 ? n : -errno;
+    ready = true;
+    return true;
+}
+
 /**
  * @brief Suspends the coroutine until the specified socket becomes ready for I/O.
  *
@@ -208,7 +712,72 @@ void Server::loop()
  *
  * @note This function is part of the Server class and is used internally to handle asynchronous I/O operations.
  */
-void Server::SocketAwaitable::await_suspend(std::coroutine_handle<> h)
+template <class Handler>
+void Server<Handler>::SocketAwaitable::await_suspend(std::coroutine_handle<> h)
+{
+    handle = h;
+    server.socketHandlers[sock] = this;
+
+    if constexpr (Poll::completion)
+    {
+        if (buffer != nullptr)
+            server.poll.readv(sock, iov, reserve());
+        else
+            server.poll.accept(sock);
+    }
+}
+
+/**
+ * @brief Completes the operation after the coroutine is resumed.
+ *
+ * On readiness backends, this function performs the read or accept, which will not block because the socket is ready.
+ * On completion backends, and after a speculative read, it translates the stored result into the recv() and accept() convention.
+ *
+ * @return The function returns the number of bytes read or the accepted socket, or -1 on error.
+ */
+template <class Handler>
+ssize_t Server<Handler>::SocketAwaitable::await_resume()
 {
-    server.socketHandlers[sock] = h;
+    if (!Poll::completion && !ready)
+    {
+        if (buffer == nullptr)
+            return acceptSocket(sock);
+
+        return ::readv(sock, iov, reserve());
+    }
+
+    if (result < 0)
+    {
+        errno = -result;
+        return -1;
+    }
+
+    return result;
 }
+
+/**
+ * @brief Shuts the connection down when the timer expires.
+ *
+ * The pending or next read returns the end of the stream, so the coroutine that handles the connection
+ * hands its data over and closes the socket as usual.
+ */
+template <class Handler>
+void Server<Handler>::ShutdownTimer::expire()
+{
+    shutdown(sock, SHUT_RDWR);
+}
+
+/**
+ * @brief Suspends the coroutine until the deadline, adding the awaitable to the loop's timer wheel.
+ *
+ * @param h The coroutine handle representing the suspended coroutine.
+ */
+template <class Handler>
+void Server<Handler>::SleepAwaitable::await_suspend(std::coroutine_handle<> h)
+{
+    handle = h;
+    server.timers.add(*this, deadline);
+}
+
+template class Server<PrintHandler>;
+template class Server<HashHandler>;
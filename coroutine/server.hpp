@@ -4,6 +4,8 @@
  *
  * The Server class is responsible for managing the TCP server and handling client connections.
  * It provides methods for opening, binding, and running the server, as well as handling client connections asynchronously using coroutines.
+ * It is a template over the handler that decides what to do with the data received, whose hooks are called without virtual dispatch.
+ * The member functions are defined in server.cpp, which instantiates the server for the handlers in handler.hpp.
  *
  * @author Vikman Fernandez-Castro
  * @date July 7, 2024
@@ -11,25 +13,47 @@
 
 #pragma once
 
-#include <map>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "buffer.hpp"
+#include "handler.hpp"
+#include "inbox.hpp"
+#include "metrics.hpp"
+#include "options.hpp"
 #include "poll.hpp"
+#include "table.hpp"
 #include "task.hpp"
+#include "wheel.hpp"
+#include "writer.hpp"
 
 #define TCP_BACKLOG 2048
-#define BUFFER_LENGTH 4096
+#define RECEIVE_MIN 1024
+#define RECEIVE_INITIAL 4096
+#define RECEIVE_MAX 65536
 #define TIMEOUT_MILLIS -1
+#define RETRY_MILLIS 1
+#define ACCEPT_RETRY_MILLIS 100
 
+template <class Handler = PrintHandler>
 class Server
 {
 public:
     /**
-     * @brief Constructs a Server object with the specified port number.
+     * @brief Constructs a Server object with the specified options.
      *
-     * This constructor initializes the server with the specified port number.
+     * This constructor initializes the server with the port number and settings given on the command line,
+     * registers the metrics of its loop and constructs its handler. The server must be constructed on the thread that runs it.
      *
-     * @param port The port number on which the server will listen for incoming connections.
+     * @param options The options of the server. The object must outlive the server.
+     * @param writer The writer to which the handler hands the data over. It may be shared by several servers.
+     * @param serverSock A listening socket to be owned by the server, or -1 to open the port on run().
+     * @param cpu The CPU to which the calling thread is pinned, or -1 if it is not pinned.
+     * @param inbox The inbox through which an acceptor thread hands the connections over, instead of a listening socket, or null.
      */
-    Server(unsigned int port) : port(port), serverSock(-1), poll(TCP_BACKLOG) {}
+    Server(const Options &options, Writer &writer, int serverSock = -1, int cpu = -1, Inbox *inbox = nullptr) : options(options), writer(writer), serverSock(serverSock), cpu(cpu), inbox(inbox), poll(options.eventBatch), openConnections(0), highWatermark(0), lowWatermark(0), loopBytes(0), metrics(Metrics::add()), handler(options, writer, chunks, metrics) {}
 
     /**
      * @brief Destroys the Server object and frees the allocated memory.
@@ -43,28 +67,203 @@ public:
      */
     void run();
 
+    /**
+     * @brief Opens a non-blocking listening socket on the port given in the options.
+     *
+     * @param options The options of the server.
+     *
+     * @return The function returns the listening socket.
+     */
+    static int openPort(const Options &options);
+
+    /**
+     * @brief Accepts a pending connection on the specified listening socket, which is non-blocking and close-on-exec.
+     *
+     * @param serverSock The listening socket.
+     *
+     * @return The function returns the accepted socket, or -1 on error.
+     */
+    static int acceptSocket(int serverSock);
+
 private:
-    void openPort();
-    void bindPort();
+    static void bindPort(int sock, unsigned port);
+
+    /**
+     * @brief Connection with the data received and not consumed by the handler yet.
+     */
+    struct Stream : Connection<typename Handler::State>
+    {
+        Stream(ChunkPool &pool, int sock);
+        size_t receiveSize;             // The number of bytes reserved for the next read, adapted to the reads of the connection.
+        std::coroutine_handle<> paused; // The coroutine of the connection while the high watermark stops it, or null.
+    };
+
+    void setBusyPoll(int sock);
     Task acceptClients();
     Task handleClient(int sock);
     void loop();
+    void dispatch(int i);
+    void adapt(int sock, Stream &stream, size_t received, size_t reserved);
+    void receiveClients();
+    void resumeDeferred();
+    bool stalled();
+    bool throttled();
+    void unpause(Stream &stream);
+    void resumePaused();
 
+    /**
+     * @brief Awaitable that reads data from a socket into the free space of a buffer, or accepts a connection if no buffer is given.
+     *
+     * Reads are speculative: await_ready() first tries a non-blocking read, and the coroutine is only suspended if it would block,
+     * so a connection that already has data waiting skips the round trip through the poll object.
+     * On readiness backends, the coroutine is resumed when the socket is ready and the operation runs in await_resume(),
+     * so the space is only reserved once there is data to receive.
+     * On completion backends, the operation is submitted in await_suspend() and await_resume() returns its result.
+     * In all cases, the result follows the convention of readv() and accept(): -1 and errno on error.
+     * The bytes received must be committed to the buffer afterwards.
+     */
     class SocketAwaitable
     {
     public:
-        SocketAwaitable(Server &server, int sock) : server(server), sock(sock) {}
-        bool await_ready() { return false; }
+        SocketAwaitable(Server &server, int sock, Buffer *buffer = nullptr, size_t size = RECEIVE_INITIAL) : server(server), sock(sock), buffer(buffer), size(size), reserved(0), count(0), result(0), ready(false) {}
+        bool await_ready();
         void await_suspend(std::coroutine_handle<> h);
-        void await_resume() {}
+        ssize_t await_resume();
+
+        /**
+         * @brief Checks whether the operation completed without suspending the coroutine.
+         *
+         * @return The function returns true if the speculative read succeeded or failed with an error other than EAGAIN.
+         */
+        bool completedInline() const { return ready; }
+
+        /**
+         * @brief Gets the space reserved in the buffer for the read, which may be less than requested if it spans too many chunks.
+         *
+         * @return The function returns the number of bytes.
+         */
+        size_t reservation() const { return reserved; }
 
     private:
+        friend class Server;
+        int reserve();
         Server &server;
         int sock;
+        Buffer *buffer;
+        size_t size;
+        size_t reserved;
+        iovec iov[2];
+        int count;
+        int result;
+        bool ready;
+        std::coroutine_handle<> handle;
+    };
+
+    /**
+     * @brief Timer that shuts a connection down when it expires, so that its coroutine reads the end of the stream and closes it.
+     */
+    class ShutdownTimer : public TimerWheel::Timer
+    {
+    public:
+        ShutdownTimer(int sock) : sock(sock) {}
+
+    protected:
+        void expire() override;
+
+    private:
+        int sock;
+    };
+
+    /**
+     * @brief Awaitable that suspends the coroutine until a deadline of the loop's timer wheel.
+     */
+    class SleepAwaitable : public TimerWheel::Timer
+    {
+    public:
+        SleepAwaitable(Server &server, uint64_t deadline) : server(server), deadline(deadline) {}
+        bool await_ready() { return deadline <= TimerWheel::now(); }
+        void await_suspend(std::coroutine_handle<> h);
+        void await_resume() {}
+
+    protected:
+        void expire() override { handle.resume(); }
+
+    private:
+        Server &server;
+        uint64_t deadline;
+        std::coroutine_handle<> handle;
+    };
+
+    /**
+     * @brief Suspends the coroutine for the specified time.
+     *
+     * @param millis The time to sleep, in milliseconds.
+     *
+     * @return The function returns an awaitable.
+     */
+    SleepAwaitable sleep(unsigned millis) { return SleepAwaitable(*this, TimerWheel::now() + millis); }
+
+    /**
+     * @brief Suspends the coroutine until the specified time.
+     *
+     * @param deadline The time, in milliseconds of the monotonic clock, at which the coroutine is resumed.
+     *
+     * @return The function returns an awaitable.
+     */
+    SleepAwaitable until(uint64_t deadline) { return SleepAwaitable(*this, deadline); }
+
+    /**
+     * @brief Awaitable that suspends the coroutine of a connection until the memory of the loop falls below the low watermark.
+     */
+    class PauseAwaitable
+    {
+    public:
+        PauseAwaitable(Server &server, Stream &stream) : server(server), stream(stream) {}
+        bool await_ready() { return false; }
+        void await_resume() {}
+
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            stream.paused = h;
+            server.paused.push_back(&stream);
+        }
+
+    private:
+        Server &server;
+        Stream &stream;
+    };
+
+    /**
+     * @brief Awaitable that suspends the coroutine until the next iteration of the loop, letting other coroutines run.
+     */
+    class DeferAwaitable
+    {
+    public:
+        DeferAwaitable(Server &server) : server(server) {}
+        bool await_ready() { return false; }
+        void await_suspend(std::coroutine_handle<> h) { server.deferred.push_back(h); }
+        void await_resume() {}
+
+    private:
+        Server &server;
     };
 
-    unsigned int port;
+    const Options &options;
+    Writer &writer;
     int serverSock;
+    int cpu;
+    Inbox *inbox;
     Poll poll;
-    std::map<int, std::coroutine_handle<>> socketHandlers;
+    ChunkPool chunks;
+    FdTable<SocketAwaitable *> socketHandlers;
+    FdTable<Stream *> streams;
+    std::vector<Stream *> paused;
+    size_t openConnections;
+    size_t highWatermark;
+    size_t lowWatermark;
+    TimerWheel timers;
+    std::deque<std::coroutine_handle<>> deferred;
+    size_t loopBytes;
+    LoopMetrics &metrics;
+    Handler handler;
 };
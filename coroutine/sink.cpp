@@ -0,0 +1,210 @@
+/**
+ * @file sink.cpp
+ * @brief This file contains the implementation of the TextSink class.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#include "sink.hpp"
+
+using namespace std;
+
+/**
+ * @brief Writes a vector of buffers completely, retrying after partial writes.
+ *
+ * The buffers are written with writev() in batches of up to IOV_MAX entries.
+ *
+ * @param fd The file descriptor to write to.
+ * @param iov The vector of buffers. It is modified to track the progress.
+ */
+static void writeAll(int fd, vector<iovec> &iov)
+{
+    for (size_t i = 0; i < iov.size();)
+    {
+        ssize_t written = writev(fd, &iov[i], min<size_t>(iov.size() - i, IOV_MAX));
+
+        if (written == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            cerr << "Error writing data" << endl;
+            return;
+        }
+
+        for (; i < iov.size() && (size_t)written >= iov[i].iov_len; i++)
+            written -= iov[i].iov_len;
+
+        if (i < iov.size())
+        {
+            iov[i].iov_base = (char *)iov[i].iov_base + written;
+            iov[i].iov_len -= written;
+        }
+    }
+}
+
+/**
+ * @brief Writes a vector of buffers to the standard output and empties the vector.
+ *
+ * @param iov The vector of buffers.
+ *
+ * @return The function returns the number of bytes written.
+ */
+static size_t writeOut(vector<iovec> &iov)
+{
+    size_t total = 0;
+
+    for (auto &entry : iov)
+        total += entry.iov_len;
+
+    writeAll(STDOUT_FILENO, iov);
+    iov.clear();
+    return total;
+}
+
+/**
+ * @brief Copies the data of a spill file to the standard output.
+ *
+ * On Linux, the data goes from the page cache to the output with sendfile(), without passing through user space.
+ * If the output does not support it, for example because it was opened for appending, the file is read and written instead.
+ *
+ * @param fd The spill file.
+ * @param size The size of the data in the file.
+ *
+ * @return The function returns the number of bytes written.
+ */
+static size_t sendFile(int fd, size_t size)
+{
+    off_t offset = 0;
+
+#ifdef __linux__
+    while ((size_t)offset < size)
+    {
+        ssize_t sent = sendfile(STDOUT_FILENO, fd, &offset, size - offset);
+
+        if (sent > 0 || (sent == -1 && errno == EINTR))
+            continue;
+
+        if (sent == -1 && errno != EINVAL && errno != ENOSYS)
+            cerr << "Error sending spill file" << endl;
+
+        break;
+    }
+#endif
+
+    while ((size_t)offset < size)
+    {
+        static char data[65536];
+        ssize_t length = pread(fd, data, min(size - offset, sizeof(data)), offset);
+
+        if (length <= 0)
+        {
+            cerr << "Error reading spill file" << endl;
+            break;
+        }
+
+        vector<iovec> iov = {{data, (size_t)length}};
+        writeAll(STDOUT_FILENO, iov);
+        offset += length;
+    }
+
+    return offset;
+}
+
+/**
+ * @brief Adds the buffers of a record to a vector of buffers, one per chunk that it spans.
+ *
+ * The size of the last chunk of the payload may still grow while it is written, so it is never read.
+ *
+ * @param payload The payload that holds the record.
+ * @param record The record.
+ * @param iov The vector.
+ */
+static void addRecord(const Writer::Payload &payload, const Writer::Record &record, vector<iovec> &iov)
+{
+    auto chunk = record.chunk;
+    size_t offset = record.offset;
+
+    for (size_t remaining = record.length; remaining > 0;)
+    {
+        size_t length = chunk != payload.tail ? min(chunk->size - offset, remaining) : remaining;
+        iov.push_back({chunk->data + offset, length});
+        remaining -= length;
+
+        // The link of the last chunk may be changing, so it is only followed if the record goes on.
+        if (remaining > 0)
+        {
+            chunk = chunk->next;
+            offset = 0;
+        }
+    }
+}
+
+/**
+ * @brief Writes a batch of payloads with as few system calls as possible.
+ *
+ * Every record of a payload is written with its own header, which tells the connection and the number of the record.
+ * The buffers gathered before a spill file are written first, and the file is copied after them.
+ */
+size_t TextSink::write(vector<Writer::Payload> &batch)
+{
+    size_t total = 0;
+    size_t count = 0;
+
+    for (auto &payload : batch)
+        count += payload.records.size();
+
+    // The headers are formatted before any of them is referenced, so that they do not move.
+    headers.resize(max(headers.size(), count));
+    count = 0;
+
+    for (auto &payload : batch)
+        for (size_t i = 0; i < payload.records.size(); i++)
+        {
+            bool partial = payload.partial && i + 1 == payload.records.size();
+            headers[count++] = "[" + to_string(payload.sock) + " conn=" + to_string(payload.connection) + " rec=" + to_string(payload.sequence + i) + (partial ? " partial" : "") + "]: ";
+        }
+
+    count = 0;
+
+    for (auto &payload : batch)
+    {
+        if (!payload.records.empty())
+        {
+            for (auto &record : payload.records)
+            {
+                iov.push_back({headers[count].data(), headers[count].size()});
+                addRecord(payload, record, iov);
+                iov.push_back({(void *)payload.trailer, strlen(payload.trailer)});
+                count++;
+            }
+
+            continue;
+        }
+
+        iov.push_back({payload.header.data(), payload.header.size()});
+
+        for (auto chunk = payload.head; chunk != nullptr; chunk = chunk->next)
+            iov.push_back({chunk->data, chunk->size});
+
+        if (payload.file != -1)
+        {
+            total += writeOut(iov);
+            total += sendFile(payload.file, payload.fileSize);
+        }
+
+        iov.push_back({(void *)payload.trailer, strlen(payload.trailer)});
+    }
+
+    return total + writeOut(iov);
+}
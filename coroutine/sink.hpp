@@ -0,0 +1,45 @@
+/**
+ * @file sink.hpp
+ * @brief This file contains the declaration of the Sink interface and the TextSink class.
+ *
+ * A sink is the destination of the payloads that the writer thread takes from its queue. Sinks are only called
+ * from the writer thread, so they need no synchronization, and the writer releases the chunks and spill files
+ * of the payloads once the sink is done with them.
+ * The text sink prints every payload on the standard output after its header, with writev() and sendfile().
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+#include "writer.hpp"
+
+class Sink
+{
+public:
+    virtual ~Sink() = default;
+
+    /**
+     * @brief Writes a batch of payloads.
+     *
+     * @param batch The payloads.
+     *
+     * @return The function returns the number of bytes written.
+     */
+    virtual size_t write(std::vector<Writer::Payload> &batch) = 0;
+};
+
+class TextSink : public Sink
+{
+public:
+    size_t write(std::vector<Writer::Payload> &batch) override;
+
+private:
+    std::vector<iovec> iov;
+    std::vector<std::string> headers;
+};
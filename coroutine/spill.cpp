@@ -0,0 +1,108 @@
+/**
+ * @file spill.cpp
+ * @brief This file contains the implementation of the SpillFile class.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "spill.hpp"
+
+using namespace std;
+
+SpillFile::SpillFile(const string &dir) : map(nullptr), mapOffset(0), length(0)
+{
+    string path = dir + "/server-spill-XXXXXX";
+    vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+
+#ifdef __linux__
+    fd = mkostemp(name.data(), O_CLOEXEC);
+#else
+    fd = mkstemp(name.data());
+
+    if (fd != -1)
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+#endif
+
+    if (fd == -1)
+        throw runtime_error("Error creating spill file in " + dir);
+
+    unlink(name.data());
+}
+
+SpillFile::~SpillFile()
+{
+    unmap();
+
+    if (fd != -1)
+        close(fd);
+}
+
+bool SpillFile::space(size_t size, iovec &iov)
+{
+    if (map == nullptr || length == mapOffset + SEGMENT)
+    {
+        // Segments start at a page boundary, so the first one may begin before the end of the data written so far.
+        size_t offset = length - length % sysconf(_SC_PAGESIZE);
+
+        unmap();
+
+        if (ftruncate(fd, offset + SEGMENT) == -1)
+            return false;
+
+        void *segment = mmap(nullptr, SEGMENT, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+
+        if (segment == MAP_FAILED)
+            return false;
+
+        map = (char *)segment;
+        mapOffset = offset;
+    }
+
+    iov = {map + (length - mapOffset), min(size, mapOffset + SEGMENT - length)};
+    return true;
+}
+
+void SpillFile::write(const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        iovec iov;
+
+        if (!space(size, iov))
+            throw runtime_error("Error mapping spill file");
+
+        memcpy(iov.iov_base, data, iov.iov_len);
+        commit(iov.iov_len);
+        data += iov.iov_len;
+        size -= iov.iov_len;
+    }
+}
+
+int SpillFile::release()
+{
+    unmap();
+    int released = fd;
+    fd = -1;
+    return released;
+}
+
+/**
+ * @brief Unmaps the current segment, if any.
+ */
+void SpillFile::unmap()
+{
+    if (map != nullptr)
+        munmap(map, SEGMENT);
+
+    map = nullptr;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file spill.hpp
+ * @brief This file contains the declaration of the SpillFile class.
+ *
+ * A spill file holds the data of a connection that does not fit in the memory budget of its event loop.
+ * The file is created in a temporary directory and unlinked right away, so it disappears when it is closed.
+ * Data is written through a memory-mapped segment at the end of the file, which is remapped as it fills up,
+ * so receives land in the page cache directly and only one segment per file is mapped at a time.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <sys/uio.h>
+
+class SpillFile
+{
+public:
+    static constexpr size_t SEGMENT = 1 << 20;
+
+    /**
+     * @brief Creates an unlinked spill file in the specified directory.
+     *
+     * @param dir The directory.
+     *
+     * @throws runtime_error If the file cannot be created.
+     */
+    SpillFile(const std::string &dir);
+    SpillFile(const SpillFile &) = delete;
+    SpillFile &operator=(const SpillFile &) = delete;
+
+    /**
+     * @brief Unmaps the current segment and closes the file, unless it was released.
+     */
+    ~SpillFile();
+
+    /**
+     * @brief Gets free space at the end of the file, mapping a new segment if the current one is full.
+     *
+     * @param size The number of bytes to reserve. Fewer bytes may be reserved if they would cross the end of the segment.
+     * @param iov Output parameter that receives the space.
+     *
+     * @return The function returns true, or false if the segment could not be mapped.
+     */
+    bool space(size_t size, iovec &iov);
+
+    /**
+     * @brief Marks the given number of bytes at the end of the file as used.
+     *
+     * @param size The number of bytes written to the space returned by space().
+     */
+    void commit(size_t size) { length += size; }
+
+    /**
+     * @brief Appends data to the file.
+     *
+     * @param data The data.
+     * @param size The size of the data.
+     *
+     * @throws runtime_error If a segment cannot be mapped.
+     */
+    void write(const char *data, size_t size);
+
+    /**
+     * @brief Unmaps the current segment and gives the file descriptor up to the caller, who must close it.
+     *
+     * @return The function returns the file descriptor.
+     */
+    int release();
+
+    size_t size() const { return length; }
+
+private:
+    void unmap();
+
+    int fd;
+    char *map;
+    size_t mapOffset; // The position of the mapped segment in the file.
+    size_t length;    // The number of bytes of data in the file.
+};
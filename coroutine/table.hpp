@@ -0,0 +1,63 @@
+/**
+ * @file table.hpp
+ * @brief This file contains the declaration of the FdTable class.
+ *
+ * An FdTable maps file descriptors to values. The values are stored in pages of PAGE_ENTRIES,
+ * allocated on first use and never freed nor moved, so the table grows with the highest descriptor in use
+ * while a lookup stays two array accesses, and references to values remain valid as the table grows.
+ * The kernel hands out the lowest free descriptors, so the pages in use stay dense.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+template <typename T>
+class FdTable
+{
+public:
+    static constexpr size_t PAGE_BITS = 10;
+    static constexpr size_t PAGE_ENTRIES = 1 << PAGE_BITS;
+
+    /**
+     * @brief Gets the value of a descriptor, allocating its page if needed.
+     *
+     * @param fd The file descriptor.
+     *
+     * @return The function returns a reference to the value. Values that were never written are value-initialized.
+     */
+    T &operator[](size_t fd)
+    {
+        size_t page = fd >> PAGE_BITS;
+
+        if (page >= pages.size())
+            pages.resize(std::max(page + 1, pages.size() * 2));
+
+        if (pages[page] == nullptr)
+            pages[page] = std::make_unique<T[]>(PAGE_ENTRIES);
+
+        return pages[page][fd & (PAGE_ENTRIES - 1)];
+    }
+
+    /**
+     * @brief Looks up the value of a descriptor without allocating it.
+     *
+     * @param fd The file descriptor.
+     *
+     * @return The function returns a pointer to the value, or nullptr if its page has not been allocated.
+     */
+    T *find(size_t fd) const
+    {
+        size_t page = fd >> PAGE_BITS;
+        return page < pages.size() && pages[page] != nullptr ? &pages[page][fd & (PAGE_ENTRIES - 1)] : nullptr;
+    }
+
+private:
+    std::vector<std::unique_ptr<T[]>> pages;
+};
@@ -5,6 +5,7 @@
  * The Task struct is used to represent asynchronous tasks or coroutines.
  * It provides the necessary components for creating and managing coroutines,
  * allowing for non-blocking I/O operations and asynchronous programming.
+ * The frames of the coroutines are allocated from a thread-local pool instead of the global heap.
  *
  * @author Vikman Fernandez-Castro
  * @date July 13, 2024
@@ -14,13 +15,154 @@
 
 #include <iostream>
 #include <coroutine>
+#include <cstddef>
+#include <new>
+#include <vector>
 
 using namespace std;
 
+/**
+ * @brief Allocator for coroutine frames.
+ *
+ * Every connection starts a coroutine whose frame would otherwise be allocated with the global operator new.
+ * Frames are rounded up to size classes of FRAME_GRANULARITY bytes, and each class keeps a free list of frames,
+ * refilled by carving slabs of FRAME_SLAB bytes. The free lists are thread-local, so each event loop has its own
+ * pool and never takes a lock. A coroutine is always destroyed by the thread that created it.
+ * Frames larger than the biggest class fall back to the global operator new.
+ */
+class FramePool
+{
+public:
+    static constexpr size_t FRAME_GRANULARITY = 64;
+    static constexpr size_t FRAME_CLASSES = 64;
+    static constexpr size_t FRAME_SLAB = 65536;
+
+    /**
+     * @brief Counters of the calling thread's pool.
+     */
+    struct Stats
+    {
+        unsigned long hits;   // Frames taken from a free list.
+        unsigned long misses; // Frames that needed a new slab or were too large for the pool.
+    };
+
+    /**
+     * @brief Allocates a coroutine frame.
+     *
+     * @param size The size of the frame.
+     *
+     * @return The function returns a pointer to the frame.
+     */
+    static void *allocate(size_t size)
+    {
+        size_t index = (size - 1) / FRAME_GRANULARITY;
+
+        if (index >= FRAME_CLASSES)
+        {
+            arena.stats.misses++;
+            return ::operator new(size);
+        }
+
+        if (arena.free[index] == nullptr)
+        {
+            arena.refill(index);
+            arena.stats.misses++;
+        }
+        else
+            arena.stats.hits++;
+
+        Block *block = arena.free[index];
+        arena.free[index] = block->next;
+        return block;
+    }
+
+    /**
+     * @brief Returns a coroutine frame to the pool.
+     *
+     * @param ptr The frame.
+     * @param size The size of the frame, as given to allocate().
+     */
+    static void release(void *ptr, size_t size)
+    {
+        size_t index = (size - 1) / FRAME_GRANULARITY;
+
+        if (index >= FRAME_CLASSES)
+        {
+            ::operator delete(ptr);
+            return;
+        }
+
+        Block *block = (Block *)ptr;
+        block->next = arena.free[index];
+        arena.free[index] = block;
+    }
+
+    /**
+     * @brief Retrieves the counters of the calling thread's pool.
+     *
+     * @return The function returns a snapshot of the counters.
+     */
+    static Stats stats() { return arena.stats; }
+
+private:
+    struct Block
+    {
+        Block *next;
+    };
+
+    struct Arena
+    {
+        Block *free[FRAME_CLASSES] = {};
+        std::vector<void *> slabs;
+        Stats stats = {0, 0};
+
+        ~Arena()
+        {
+            for (auto slab : slabs)
+                ::operator delete(slab);
+        }
+
+        void refill(size_t index)
+        {
+            size_t size = (index + 1) * FRAME_GRANULARITY;
+            char *slab = (char *)::operator new(FRAME_SLAB);
+            slabs.push_back(slab);
+
+            for (size_t offset = 0; offset + size <= FRAME_SLAB; offset += size)
+            {
+                Block *block = (Block *)(slab + offset);
+                block->next = free[index];
+                free[index] = block;
+            }
+        }
+    };
+
+    static thread_local Arena arena;
+};
+
+inline thread_local FramePool::Arena FramePool::arena;
+
 struct Task
 {
     struct promise_type
     {
+        /**
+         * @brief Allocates the coroutine frame from the calling thread's frame pool.
+         *
+         * @param size The size of the frame.
+         *
+         * @return The function returns a pointer to the frame.
+         */
+        static void *operator new(size_t size) { return FramePool::allocate(size); }
+
+        /**
+         * @brief Returns the coroutine frame to the frame pool.
+         *
+         * @param ptr The frame.
+         * @param size The size of the frame.
+         */
+        static void operator delete(void *ptr, size_t size) { FramePool::release(ptr, size); }
+
         /**
          * @brief Returns a Task object representing the coroutine.
          *
@@ -0,0 +1,190 @@
+/**
+ * @file wheel.cpp
+ * @brief This file contains the implementation of the TimerWheel class.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#include <chrono>
+#include <climits>
+#include "wheel.hpp"
+
+using namespace std;
+
+TimerWheel::Timer::~Timer()
+{
+    TimerWheel::cancel(*this);
+}
+
+TimerWheel::TimerWheel() : current(now()), count(0), counts() {}
+
+uint64_t TimerWheel::now()
+{
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void TimerWheel::add(Timer &timer, uint64_t deadline)
+{
+    cancel(timer);
+
+    uint64_t span = ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+    timer.expires = deadline < current ? current : deadline - current > span ? current + span : deadline;
+    timer.wheel = this;
+    count++;
+    insert(timer);
+}
+
+void TimerWheel::cancel(Timer &timer)
+{
+    if (timer.wheel == nullptr)
+        return;
+
+    timer.prev->next = timer.next;
+    timer.next->prev = timer.prev;
+    timer.prev = timer.next = &timer;
+    timer.wheel->counts[timer.level]--;
+    timer.wheel->count--;
+    timer.wheel = nullptr;
+}
+
+/**
+ * @brief Links a timer into the slot that corresponds to its deadline.
+ *
+ * The level is the lowest one whose turn covers the distance to the deadline.
+ *
+ * @param timer The timer, which must not be linked.
+ */
+void TimerWheel::insert(Timer &timer)
+{
+    uint64_t delta = timer.expires - current;
+    int level = 0;
+
+    while (level < WHEEL_LEVELS - 1 && delta >= (uint64_t)1 << (WHEEL_BITS * (level + 1)))
+        level++;
+
+    Link &slot = slots[level][(timer.expires >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)];
+    timer.level = level;
+    timer.prev = slot.prev;
+    timer.next = &slot;
+    slot.prev->next = &timer;
+    slot.prev = &timer;
+    counts[level]++;
+}
+
+/**
+ * @brief Moves the timers of the current slot of a level to the levels below it.
+ *
+ * @param level The level, which must be above the lowest one.
+ */
+void TimerWheel::cascade(int level)
+{
+    Link &slot = slots[level][(current >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)];
+
+    while (slot.next != &slot)
+    {
+        Timer &timer = static_cast<Timer &>(*slot.next);
+        slot.next = timer.next;
+        timer.next->prev = &slot;
+        counts[level]--;
+        insert(timer);
+    }
+}
+
+void TimerWheel::advance(uint64_t time)
+{
+    while (current <= time)
+    {
+        int empty = 0;
+
+        while (empty < WHEEL_LEVELS && counts[empty] == 0)
+            empty++;
+
+        if (empty == WHEEL_LEVELS)
+        {
+            current = time + 1;
+            return;
+        }
+
+        Link expired;
+
+        if (empty == 0)
+        {
+            // Take the timers of the current tick out of the wheel, so the ones added while they expire go to later ticks.
+            Link &slot = slots[0][current & (WHEEL_SLOTS - 1)];
+
+            if (slot.next != &slot)
+            {
+                expired.next = slot.next;
+                expired.prev = slot.prev;
+                expired.next->prev = &expired;
+                expired.prev->next = &expired;
+                slot.next = slot.prev = &slot;
+            }
+
+            current++;
+        }
+        else
+        {
+            // The lower levels are empty, so skip straight to the next turn of the lowest level with timers.
+            uint64_t step = (uint64_t)1 << (WHEEL_BITS * empty);
+            uint64_t next = (current / step + 1) * step;
+
+            if (next > time + 1)
+            {
+                current = time + 1;
+                return;
+            }
+
+            current = next;
+        }
+
+        // Move the timers down when levels complete a turn, starting from the highest one.
+        int level = 0;
+
+        while (level < WHEEL_LEVELS - 1 && (current & (((uint64_t)1 << (WHEEL_BITS * (level + 1))) - 1)) == 0)
+            level++;
+
+        for (; level > 0; level--)
+            cascade(level);
+
+        // The expired timers are still pending until their turn comes, so the callbacks may cancel them.
+        while (expired.next != &expired)
+        {
+            Timer &timer = static_cast<Timer &>(*expired.next);
+            cancel(timer);
+            timer.expire();
+        }
+    }
+}
+
+int TimerWheel::timeout(uint64_t time) const
+{
+    if (count == 0)
+        return -1;
+
+    uint64_t next;
+
+    if (counts[0] > 0)
+    {
+        next = current;
+
+        while (slots[0][next & (WHEEL_SLOTS - 1)].next == &slots[0][next & (WHEEL_SLOTS - 1)])
+            next++;
+    }
+    else
+    {
+        int level = 1;
+
+        while (counts[level] == 0)
+            level++;
+
+        uint64_t step = (uint64_t)1 << (WHEEL_BITS * level);
+        next = (current / step + 1) * step;
+    }
+
+    if (next <= time)
+        return 0;
+
+    return next - time > INT_MAX ? INT_MAX : (int)(next - time);
+}
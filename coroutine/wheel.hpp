@@ -0,0 +1,124 @@
+/**
+ * @file wheel.hpp
+ * @brief This file contains the declaration of the TimerWheel class.
+ *
+ * The TimerWheel class keeps the timers of an event loop in a hierarchical timing wheel with a resolution of one millisecond.
+ * Every level has WHEEL_SLOTS slots, and each slot of a level spans a whole turn of the level below it, so adding and
+ * cancelling a timer take constant time. As time advances, the timers of a slot are moved down one level when the level
+ * below completes a turn, and they expire when their slot in the lowest level is reached.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+
+class TimerWheel
+{
+    struct Link
+    {
+        Link *prev = this;
+        Link *next = this;
+    };
+
+public:
+    /**
+     * @brief Timer that can be added to a wheel. Subclasses define what happens when it expires.
+     */
+    class Timer : private Link
+    {
+    public:
+        Timer() = default;
+        Timer(const Timer &) = delete;
+        Timer &operator=(const Timer &) = delete;
+
+        /**
+         * @brief Destroys the timer, removing it from its wheel if it is pending.
+         */
+        virtual ~Timer();
+
+        /**
+         * @brief Checks whether the timer is in a wheel.
+         *
+         * @return The function returns true if the timer is pending.
+         */
+        bool pending() const { return wheel != nullptr; }
+
+    protected:
+        /**
+         * @brief Called by the wheel when the timer expires. The timer is no longer pending at that point.
+         */
+        virtual void expire() = 0;
+
+    private:
+        friend class TimerWheel;
+        TimerWheel *wheel = nullptr;
+        uint64_t expires = 0;
+        int level = 0;
+    };
+
+    /**
+     * @brief Constructs an empty wheel starting at the current time.
+     */
+    TimerWheel();
+
+    /**
+     * @brief Gets the current time of the monotonic clock.
+     *
+     * @return The function returns the time in milliseconds.
+     */
+    static uint64_t now();
+
+    /**
+     * @brief Adds a timer to the wheel, removing it first from any wheel it was in.
+     *
+     * Deadlines further away than the span of the wheel are clamped to it.
+     *
+     * @param timer The timer. It must stay alive until it expires or is cancelled.
+     * @param deadline The time, in milliseconds of the monotonic clock, at which the timer expires.
+     */
+    void add(Timer &timer, uint64_t deadline);
+
+    /**
+     * @brief Removes a timer from the wheel. Nothing happens if the timer is not pending.
+     *
+     * @param timer The timer.
+     */
+    static void cancel(Timer &timer);
+
+    /**
+     * @brief Advances the wheel to the specified time, expiring the timers whose deadline has passed.
+     *
+     * @param time The current time, in milliseconds.
+     */
+    void advance(uint64_t time);
+
+    /**
+     * @brief Computes how long the event loop may wait before the wheel needs to be advanced.
+     *
+     * The result may be shorter than the time to the next deadline when timers have to be moved down a level first.
+     *
+     * @param time The current time, in milliseconds.
+     *
+     * @return The function returns the number of milliseconds to wait, or -1 if the wheel is empty.
+     */
+    int timeout(uint64_t time) const;
+
+    size_t size() const { return count; }
+
+private:
+    void insert(Timer &timer);
+    void cascade(int level);
+
+    uint64_t current; // The next tick to be processed.
+    size_t count;
+    size_t counts[WHEEL_LEVELS];
+    Link slots[WHEEL_LEVELS][WHEEL_SLOTS];
+};
@@ -0,0 +1,188 @@
+/**
+ * @file writer.cpp
+ * @brief This file contains the implementation of the Writer class.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#include <algorithm>
+#include <deque>
+#include <unistd.h>
+#include "metrics.hpp"
+#include "sink.hpp"
+#include "writer.hpp"
+
+#define WRITER_BATCH 64
+
+using namespace std;
+
+// Payloads held by the calling loop while the queue is full.
+
+static thread_local deque<Writer::Payload> overflow;
+
+Writer::Writer(size_t capacity, Sink &sink) : sink(sink), queue(capacity), head(0), count(0), maxDepth(0), stopping(false), overflowed(0), payloads(0), bytes(0), batches(0), backpressure(0)
+{
+    thread = std::thread(&Writer::run, this);
+}
+
+// Stops the writer thread, if it was not stopped yet.
+
+Writer::~Writer()
+{
+    if (thread.joinable())
+        stop();
+}
+
+// Writes the payloads left in the queue and stops the writer thread.
+
+void Writer::stop()
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    cond.notify_one();
+    thread.join();
+}
+
+/**
+ * @brief Main loop of the writer thread.
+ *
+ * The thread takes up to WRITER_BATCH payloads from the queue at once and hands them to the sink together.
+ * Once it is asked to stop, it goes on until the queue is empty.
+ */
+void Writer::run()
+{
+    vector<Payload> batch;
+
+    while (true)
+    {
+        {
+            unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [this] { return count > 0 || stopping; });
+
+            if (count == 0)
+                return;
+
+            size_t n = min<size_t>(count, WRITER_BATCH);
+
+            for (size_t i = 0; i < n; i++)
+                batch.push_back(std::move(queue[(head + i) % queue.size()]));
+
+            head = (head + n) % queue.size();
+            count -= n;
+        }
+
+        writeBatch(batch);
+        batch.clear();
+    }
+}
+
+/**
+ * @brief Passes a batch of payloads to the sink and releases their chunks and spill files.
+ *
+ * @param batch The payloads.
+ */
+void Writer::writeBatch(vector<Payload> &batch)
+{
+    uint64_t start = Metrics::nanos();
+    size_t total = sink.write(batch);
+    Metrics::output(Metrics::nanos() - start);
+
+    for (auto &payload : batch)
+    {
+        if (!payload.records.empty())
+            payload.pool->releaseRemote(payload.head, payload.tail);
+        else if (payload.head != nullptr)
+            payload.pool->putRemote(payload.head, payload.tail);
+
+        if (payload.file != -1)
+            close(payload.file);
+    }
+
+    payloads.fetch_add(batch.size(), memory_order_relaxed);
+    bytes.fetch_add(total, memory_order_relaxed);
+    batches.fetch_add(1, memory_order_relaxed);
+}
+
+/**
+ * @brief Tries to add a payload to the queue.
+ *
+ * @param payload The payload. It is moved from only if it was queued.
+ *
+ * @return The function returns true if the payload was queued, or false if the queue is full.
+ */
+bool Writer::tryPush(Payload &payload)
+{
+    lock_guard<std::mutex> lock(mutex);
+
+    if (count == queue.size())
+        return false;
+
+    queue[(head + count) % queue.size()] = std::move(payload);
+    maxDepth = max(maxDepth, ++count);
+
+    if (count == 1)
+        cond.notify_one();
+
+    return true;
+}
+
+// Hands a payload over to the writer.
+
+void Writer::submit(Payload &&payload)
+{
+    if (overflow.empty() && tryPush(payload))
+        return;
+
+    overflow.push_back(std::move(payload));
+    overflowed.fetch_add(1, memory_order_relaxed);
+    backpressure.fetch_add(1, memory_order_relaxed);
+}
+
+// Moves the payloads held by the calling thread into the queue, as long as there is room.
+
+void Writer::flush()
+{
+    while (!overflow.empty() && tryPush(overflow.front()))
+    {
+        overflow.pop_front();
+        overflowed.fetch_sub(1, memory_order_relaxed);
+    }
+}
+
+// Checks whether the calling thread holds payloads waiting for room in the queue.
+
+bool Writer::pending() const
+{
+    return !overflow.empty();
+}
+
+// Checks whether the calling thread holds as many payloads as the queue takes.
+
+bool Writer::full() const
+{
+    return overflow.size() >= queue.size();
+}
+
+// Retrieves the statistics of the writer.
+
+Writer::Stats Writer::stats()
+{
+    Stats stats;
+
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stats.depth = count;
+        stats.maxDepth = maxDepth;
+    }
+
+    stats.overflow = overflowed.load(memory_order_relaxed);
+    stats.payloads = payloads.load(memory_order_relaxed);
+    stats.bytes = bytes.load(memory_order_relaxed);
+    stats.batches = batches.load(memory_order_relaxed);
+    stats.backpressure = backpressure.load(memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,153 @@
+/**
+ * @file writer.hpp
+ * @brief This file contains the declaration of the Writer class.
+ *
+ * The Writer class prints the completed payloads on a dedicated thread, so that a slow standard output
+ * never stalls the event loops. The loops hand the payloads over through a bounded queue, and the writer
+ * passes them in batches to its sink, returning the chunks to the pools they came from.
+ * While the queue is full, every loop holds its payloads in order, and once it holds as many as the queue takes,
+ * it stops reading until the writer catches up, so a slow output pushes back on the clients instead of filling the memory.
+ * A payload either owns a chain of chunks, or holds records: views into chunks that it shares with a buffer.
+ * The data of a payload may also be in a spill file, which the writer closes once the sink has copied it.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 14, 2024
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "buffer.hpp"
+
+class Sink;
+
+class Writer
+{
+public:
+    /**
+     * @brief View of a record in a chain of chunks.
+     */
+    struct Record
+    {
+        ChunkPool::Chunk *chunk; // The chunk where the record starts.
+        size_t offset;           // The position of the record in its first chunk.
+        size_t length;           // The size of the record, which may continue in the following chunks.
+    };
+
+    /**
+     * @brief Data to be written: a header, a chain of chunks and a trailer, or a sequence of records with a header and a trailer each.
+     */
+    struct Payload
+    {
+        ChunkPool *pool = nullptr;              // The pool that owns the chunks.
+        ChunkPool::Chunk *head = nullptr;       // The first chunk of the data.
+        ChunkPool::Chunk *tail = nullptr;       // The last chunk of the data.
+        std::string header;                     // Text written before the data.
+        const char *trailer = "";               // Text written after the data. It must be a string literal.
+        std::vector<Record> records;            // The records. If there are any, the payload holds a reference to every chunk from head to tail.
+        int sock = -1;                          // The socket the records came from.
+        unsigned long connection = 0;           // The identifier of the connection the data came from.
+        unsigned long sequence = 0;             // The number of the first record, or of the segment in streaming mode, in the connection.
+        bool partial = false;                   // Whether the last record was cut short by the end of the connection.
+        int file = -1;                          // A spill file with the data, written after the chunks, or -1 if there is none.
+        size_t fileSize = 0;                    // The size of the data in the spill file.
+    };
+
+    /**
+     * @brief Statistics of the writer.
+     */
+    struct Stats
+    {
+        size_t depth;               // The number of payloads in the queue.
+        size_t maxDepth;            // The highest number of payloads in the queue so far.
+        size_t overflow;            // The number of payloads held by the loops because the queue was full.
+        unsigned long payloads;     // The number of payloads written.
+        unsigned long bytes;        // The number of bytes written.
+        unsigned long batches;      // The number of batches written.
+        unsigned long backpressure; // The number of payloads that found the queue full.
+    };
+
+    /**
+     * @brief Constructs a Writer object and starts its thread.
+     *
+     * @param capacity The maximum number of payloads in the queue, and in the overflow of every loop.
+     * @param sink The destination of the payloads. It must outlive the writer.
+     */
+    Writer(size_t capacity, Sink &sink);
+    Writer(const Writer &) = delete;
+    Writer &operator=(const Writer &) = delete;
+
+    /**
+     * @brief Stops the writer thread, if it was not stopped yet.
+     */
+    ~Writer();
+
+    /**
+     * @brief Writes the payloads left in the queue and stops the writer thread.
+     *
+     * The payloads submitted afterwards, or still held by the loops, are not written.
+     */
+    void stop();
+
+    /**
+     * @brief Hands a payload over to the writer.
+     *
+     * This function never blocks. If the queue is full, or earlier payloads from the calling thread are still waiting,
+     * the payload is held by the calling thread in arrival order until flush() finds room for it.
+     *
+     * @param payload The payload. The writer takes ownership of its chunks, or of its references to them.
+     */
+    void submit(Payload &&payload);
+
+    /**
+     * @brief Moves the payloads held by the calling thread into the queue, as long as there is room.
+     */
+    void flush();
+
+    /**
+     * @brief Checks whether the calling thread holds payloads waiting for room in the queue.
+     *
+     * @return The function returns true if there are payloads waiting.
+     */
+    bool pending() const;
+
+    /**
+     * @brief Checks whether the calling thread holds as many payloads as the queue takes, so it must stop reading.
+     *
+     * @return The function returns true if the overflow of the calling thread is full.
+     */
+    bool full() const;
+
+    /**
+     * @brief Retrieves the statistics of the writer.
+     *
+     * @return The function returns a snapshot of the statistics.
+     */
+    Stats stats();
+
+private:
+    bool tryPush(Payload &payload);
+    void run();
+    void writeBatch(std::vector<Payload> &batch);
+
+    Sink &sink;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<Payload> queue;
+    size_t head;
+    size_t count;
+    size_t maxDepth;
+    bool stopping;
+    std::atomic<size_t> overflowed;
+    std::atomic<unsigned long> payloads;
+    std::atomic<unsigned long> bytes;
+    std::atomic<unsigned long> batches;
+    std::atomic<unsigned long> backpressure;
+    std::thread thread;
+};
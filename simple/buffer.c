@@ -1,10 +1,29 @@
 /**
  * @file buffer.c
- * @brief This file contains functions for managing a buffer array.
+ * @brief This file contains functions for managing a buffer table.
  *
- * The buffer array is used to store and manipulate data associated with different sockets.
+ * The buffer table is used to store and manipulate data associated with different sockets.
+ * It is indexed by socket and grows as needed, so there is no limit on the number of connections.
  * The functions provided in this file allow for creating, appending data to, and dumping the contents of the buffer.
  *
+ * Every buffer is a chain of fixed-size chunks, so appending never moves the data already stored.
+ * Chunks come from a per-thread pool, so a busy event loop reuses the same memory instead of calling
+ * the allocator for every receive. When a buffer is dumped, its chunks are handed over to the output writer,
+ * which returns them to the pool once written.
+ *
+ * In streaming mode, the buffers that hold data are also queued in the order they received their first byte,
+ * so the ones that reached the age threshold are found at the front of the queue without scanning the table.
+ * The entries of the buffers that were handed over in the meantime are recognized by their segment number and skipped.
+ *
+ * In framing mode, every complete record is handed over as soon as its last byte is committed, as a view into the
+ * chunks that hold it, so the data is never copied. The chunks are shared by the buffer and the payloads through
+ * reference counts: the buffer releases a chunk once all its records are handed over, and the writer once it wrote them.
+ * The search for a delimiter resumes where the previous one stopped, so every byte is scanned once.
+ *
+ * When the data is kept until the connection closes, every event loop may limit the bytes its buffers hold in memory.
+ * The buffers that hold data are linked in a list, and whenever the total goes over the budget, the largest ones
+ * are moved to spill files, which receive the rest of their data directly. The writer then sends the files.
+ *
  * @author Vikman Fernandez-Castro
  * @date July 7, 2024
 */
@@ -12,21 +31,265 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include "buffer.h"
+#include "chunk.h"
+#include "frame.h"
+#include "metrics.h"
+#include "spill.h"
+#include "table.h"
+#include "wheel.h"
+#include "writer.h"
 
 typedef struct buffer_t
 {
-    char *data;
-    size_t size;
+    chunk_t *head;
+    chunk_t *tail;
+    chunk_t *spare; // Chunk reserved by bufferSpace() to receive the data that does not fit in the tail.
+    size_t size;    // The number of bytes not handed over yet, from the offset of the head on.
+    size_t offset;  // In framing mode, the number of bytes of the head already handed over as records.
+    unsigned long conn;     // The identifier of the connection.
+    unsigned long sequence; // The number of the next segment, or record in framing mode, of the connection.
+    chunk_t *scan;          // In delimiter mode, the chunk where the search for the delimiter resumes, or NULL to start over.
+    size_t scanOffset;      // The position in that chunk where the search resumes.
+    size_t scanned;         // The number of bytes of the current record already searched.
+    size_t prefix;          // In length-prefix mode, the size of the prefix of the current record, or 0 if it is not decoded yet.
+    size_t needed;          // The size of the current record with its prefix.
+    int sock;               // The socket associated with the buffer.
+    int resident;           // Whether the buffer is linked in the list of buffers that hold data in memory.
+    struct buffer_t *prev;  // The previous buffer in that list.
+    struct buffer_t *next;  // The next buffer in that list.
+    int spilled;            // Whether the data was moved to a spill file, which receives the rest of it.
+    spill_t spill;
 } buffer_t;
 
-static buffer_t *buffer;
-static size_t buffer_size;
+typedef struct batch_t
+{
+    record_t *records;
+    size_t count;
+    size_t capacity;
+    chunk_t *first; // The first chunk referenced by the records.
+    chunk_t *last;  // The last chunk referenced by the records.
+} batch_t;
+
+typedef struct aging_t
+{
+    int sock;
+    unsigned long conn;
+    unsigned long sequence; // The segment that must be handed over at the deadline.
+    uint64_t deadline;      // The time, in milliseconds, at which the segment reaches the age threshold.
+} aging_t;
+
+typedef struct aging_queue_t
+{
+    aging_t *entries;
+    size_t head;
+    size_t count;
+    size_t capacity;
+} aging_queue_t;
+
+static atomic_ulong connections;
+
+// Every event loop has its own buffer table and chunk pool.
+
+static _Thread_local table_t buffers;
+static _Thread_local chunk_pool_t pool;
+static _Thread_local size_t flush_bytes;
+static _Thread_local int flush_millis;
+static _Thread_local aging_queue_t aging;
+static _Thread_local frame_mode_t frame_mode;
+static _Thread_local char frame_delimiter;
+static _Thread_local size_t frame_max;
+static _Thread_local batch_t batch;
+static _Thread_local size_t spill_budget;
+static _Thread_local const char *spill_dir;
+static _Thread_local size_t resident_bytes;
+static _Thread_local buffer_t *residents;
+static _Thread_local metrics_t *spill_metrics;
+
+/**
+ * @brief Queues the current segment of the buffer associated with the given socket to be handed over when it gets old.
+ *
+ * @param sock The socket associated with the buffer.
+ *
+ * @return This function does not return a value.
+ */
+static void agingPush(int sock)
+{
+    if (aging.count == aging.capacity)
+    {
+        size_t capacity = aging.capacity > 0 ? aging.capacity * 2 : 64;
+        aging_t *entries = malloc(capacity * sizeof(aging_t));
+
+        if (entries == NULL)
+        {
+            perror("malloc");
+            abort();
+        }
+
+        for (size_t i = 0; i < aging.count; i++)
+            entries[i] = aging.entries[(aging.head + i) % aging.capacity];
+
+        free(aging.entries);
+        aging.entries = entries;
+        aging.head = 0;
+        aging.capacity = capacity;
+    }
+
+    buffer_t *b = tableAt(&buffers, sock);
+    aging_t *entry = &aging.entries[(aging.head + aging.count++) % aging.capacity];
+    entry->sock = sock;
+    entry->conn = b->conn;
+    entry->sequence = b->sequence;
+    entry->deadline = wheelNow() + flush_millis;
+}
+
+/**
+ * @brief Links a buffer in the list of buffers that hold data in memory.
+ *
+ * @param b The buffer.
+ *
+ * @return This function does not return a value.
+ */
+static void residentAdd(buffer_t *b)
+{
+    b->resident = 1;
+    b->prev = NULL;
+    b->next = residents;
+
+    if (residents != NULL)
+        residents->prev = b;
+
+    residents = b;
+}
+
+/**
+ * @brief Unlinks a buffer from the list of buffers that hold data in memory, and takes its data out of the total.
+ *
+ * @param b The buffer.
+ *
+ * @return This function does not return a value.
+ */
+static void residentRemove(buffer_t *b)
+{
+    if (b->prev != NULL)
+        b->prev->next = b->next;
+    else
+        residents = b->next;
+
+    if (b->next != NULL)
+        b->next->prev = b->prev;
+
+    b->resident = 0;
+    resident_bytes -= b->size;
+    atomic_store_explicit(&spill_metrics->residentBytes, resident_bytes, memory_order_relaxed);
+}
+
+/**
+ * @brief Moves the data of a buffer to a new spill file and returns its chunks to the pool.
+ *
+ * @param b The buffer, which must hold data in memory.
+ *
+ * @return The function returns 0 on success, or -1 if the file could not be created or written, and the data stays in memory.
+ */
+static int bufferSpill(buffer_t *b)
+{
+    if (spillOpen(&b->spill, spill_dir) < 0)
+        return -1;
+
+    for (chunk_t *chunk = b->head; chunk != NULL; chunk = chunk->next)
+    {
+        if (spillWrite(&b->spill, chunk->data, chunk->size) < 0)
+        {
+            spillUnmap(&b->spill);
+            close(b->spill.fd);
+            return -1;
+        }
+    }
+
+    metricsAdd(&spill_metrics->spills, 1);
+    metricsAdd(&spill_metrics->spilledBytes, b->size);
+    residentRemove(b);
+    chunkPut(&pool, b->head, b->tail);
+    b->head = NULL;
+    b->tail = NULL;
+    b->size = 0;
+    b->spilled = 1;
+    return 0;
+}
+
+/**
+ * @brief Moves the largest buffers to spill files until the data held in memory fits in the budget.
+ *
+ * If a spill file cannot be created, spilling is disabled, so that the error is not retried on every receive.
+ *
+ * @return This function does not return a value.
+ */
+static void enforceBudget()
+{
+    while (resident_bytes > spill_budget)
+    {
+        buffer_t *largest = residents;
+
+        for (buffer_t *b = residents; b != NULL; b = b->next)
+            if (b->size > largest->size)
+                largest = b;
+
+        if (bufferSpill(largest) < 0)
+        {
+            perror("Cannot spill a buffer to disk, spilling is disabled");
+            spill_budget = 0;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Hands the data of the buffer associated with the given socket over to the output writer.
+ *
+ * In streaming mode, the data is tagged with the connection identifier and the segment number.
+ * The chunks, or the spill file, are owned by the writer afterwards, and the buffer is left empty.
+ *
+ * @param sock The socket associated with the buffer, which must hold data.
+ *
+ * @return This function does not return a value.
+ */
+static void bufferEmit(int sock)
+{
+    buffer_t *b = tableAt(&buffers, sock);
+    payload_t payload = {.pool = &pool, .head = b->head, .tail = b->tail, .trailer = "\"\n", .sock = sock, .conn = b->conn};
+
+    if (flush_bytes > 0)
+    {
+        payload.sequence = b->sequence++;
+        payload.headerLength = snprintf(payload.header, sizeof(payload.header), "[%d conn=%lu seq=%lu]: \"", sock, b->conn, payload.sequence);
+    }
+    else
+        payload.headerLength = snprintf(payload.header, sizeof(payload.header), "[%d]: \"", sock);
+
+    if (b->spilled)
+    {
+        spillUnmap(&b->spill);
+        payload.file = b->spill.fd;
+        payload.fileSize = b->spill.size;
+        b->spilled = 0;
+    }
+    else if (b->resident)
+        residentRemove(b);
+
+    writerSubmit(&payload);
+
+    b->head = NULL;
+    b->tail = NULL;
+    b->size = 0;
+}
 
 /**
  * @brief Clears the buffer associated with the given socket.
  *
- * This function frees the memory allocated for the buffer data and resets the size to 0.
- * After calling this function, the buffer will be empty and ready for reuse.
+ * This function releases the chunks of the buffer, which go back to the pool unless records handed over still use them,
+ * and resets the size to 0. After calling this function, the buffer will be empty and ready for reuse.
  *
  * @param sock The socket associated with the buffer to be cleared.
  *
@@ -34,41 +297,517 @@ static size_t buffer_size;
  */
 static void bufferClear(int sock)
 {
-    free(buffer[sock].data);
-    buffer[sock].data = NULL;
-    buffer[sock].size = 0;
+    buffer_t *b = tableAt(&buffers, sock);
+    chunk_t *next;
+
+    for (chunk_t *chunk = b->head; chunk != NULL; chunk = next)
+    {
+        next = chunk->next;
+        chunkRelease(&pool, chunk);
+    }
+
+    if (b->spare != NULL)
+        chunkPut(&pool, b->spare, b->spare);
+
+    b->head = NULL;
+    b->tail = NULL;
+    b->spare = NULL;
+    b->size = 0;
+    b->offset = 0;
+    b->scan = NULL;
+    b->scanned = 0;
+    b->prefix = 0;
+}
+
+/**
+ * @brief Adds a record of a buffer to the batch of records to be handed over, taking a reference to the chunks it spans.
+ *
+ * The records of a batch are consecutive, so the batch references a single chain of chunks.
+ *
+ * @param b The buffer.
+ * @param skip The position of the record, counted from the first byte not handed over yet.
+ * @param length The size of the record.
+ *
+ * @return This function does not return a value.
+ */
+static void batchAdd(buffer_t *b, size_t skip, size_t length)
+{
+    chunk_t *chunk = b->head;
+    size_t offset = b->offset + skip;
+
+    while (offset >= chunk->size && chunk->next != NULL)
+    {
+        offset -= chunk->size;
+        chunk = chunk->next;
+    }
+
+    chunk_t *end = chunk;
+
+    for (size_t remaining = offset + length; remaining > end->size; end = end->next)
+        remaining -= end->size;
+
+    if (batch.count == batch.capacity)
+    {
+        batch.capacity = batch.capacity > 0 ? batch.capacity * 2 : 16;
+        batch.records = realloc(batch.records, batch.capacity * sizeof(record_t));
+
+        if (batch.records == NULL)
+        {
+            perror("realloc");
+            abort();
+        }
+    }
+
+    batch.records[batch.count++] = (record_t){chunk, offset, length};
+
+    if (batch.last != end)
+    {
+        for (chunk_t *c = batch.last != NULL ? batch.last->next : chunk;; c = c->next)
+        {
+            chunkRetain(c);
+
+            if (c == end)
+                break;
+        }
+    }
+
+    if (batch.first == NULL)
+        batch.first = chunk;
+
+    batch.last = end;
+}
+
+/**
+ * @brief Hands the batch of records over to the output writer.
+ *
+ * @param sock The socket associated with the buffer the records come from.
+ * @param partial Whether the last record was cut short by the end of the connection.
+ *
+ * @return This function does not return a value.
+ */
+static void batchSubmit(int sock, int partial)
+{
+    if (batch.count == 0)
+        return;
+
+    buffer_t *b = tableAt(&buffers, sock);
+    payload_t payload = {.pool = &pool, .head = batch.first, .tail = batch.last, .trailer = "\"\n"};
+    payload.records = batch.records;
+    payload.recordCount = batch.count;
+    payload.sock = sock;
+    payload.conn = b->conn;
+    payload.sequence = b->sequence;
+    payload.partial = partial;
+    b->sequence += batch.count;
+    writerSubmit(&payload);
+
+    batch = (batch_t){0};
+}
+
+/**
+ * @brief Marks the given number of bytes at the front of a buffer as handed over.
+ *
+ * The chunks left behind are released. The last chunk is kept even if it was handed over entirely, since it receives the next data.
+ *
+ * @param b The buffer.
+ * @param size The number of bytes.
+ *
+ * @return This function does not return a value.
+ */
+static void bufferConsume(buffer_t *b, size_t size)
+{
+    b->offset += size;
+    b->size -= size;
+
+    while (b->head != b->tail && b->offset >= b->head->size)
+    {
+        chunk_t *next = b->head->next;
+        b->offset -= b->head->size;
+        chunkRelease(&pool, b->head);
+        b->head = next;
+    }
+}
+
+/**
+ * @brief Searches a buffer for the delimiter that ends its current record, resuming where the previous search stopped.
+ *
+ * @param b The buffer, which must hold data.
+ *
+ * @return The function returns the size of the record without its delimiter, or -1 if the buffer does not hold the delimiter yet.
+ */
+static ssize_t findDelimiter(buffer_t *b)
+{
+    if (b->scan == NULL)
+    {
+        b->scan = b->head;
+        b->scanOffset = b->offset;
+    }
+
+    while (1)
+    {
+        size_t length = b->scan->size - b->scanOffset;
+        size_t found = frameFind(b->scan->data + b->scanOffset, length, frame_delimiter);
+
+        if (found < length)
+        {
+            size_t size = b->scanned + found;
+            b->scan = NULL;
+            b->scanned = 0;
+            return size;
+        }
+
+        b->scanned += length;
+        b->scanOffset += length;
+
+        if (b->scan->next == NULL)
+            return -1;
+
+        b->scan = b->scan->next;
+        b->scanOffset = 0;
+    }
+}
+
+/**
+ * @brief Decodes the length prefix of the current record of a buffer.
+ *
+ * @param b The buffer, which must hold data.
+ * @param value Output parameter that receives the length of the record, without the prefix.
+ *
+ * @return The function returns the size of the prefix, 0 if the buffer does not hold all of it yet, or -1 if it is not valid.
+ */
+static int readPrefix(buffer_t *b, uint64_t *value)
+{
+    unsigned char prefix[FRAME_PREFIX_MAX];
+    size_t length = 0;
+    chunk_t *chunk = b->head;
+    size_t offset = b->offset;
+
+    while (length < FRAME_PREFIX_MAX && length < b->size)
+    {
+        if (offset == chunk->size)
+        {
+            chunk = chunk->next;
+            offset = 0;
+            continue;
+        }
+
+        prefix[length++] = chunk->data[offset++];
+    }
+
+    return frameLength(frame_mode, prefix, length, value);
+}
+
+/**
+ * @brief Hands the complete records of the buffer associated with the given socket over to the output writer.
+ *
+ * The records are handed over in a single payload, as views into the chunks of the buffer.
+ *
+ * @param sock The socket associated with the buffer.
+ * @param records Output parameter that receives the number of records handed over, including those before a record that is not valid.
+ *
+ * @return The function returns 0, or -1 if a record is not valid or too large.
+ */
+static int bufferFrame(int sock, size_t *records)
+{
+    buffer_t *b = tableAt(&buffers, sock);
+    int result = 0;
+
+    while (b->size > 0)
+    {
+        size_t skip = 0;
+        size_t length;
+        size_t delimiter = 0;
+
+        if (frame_mode == FRAME_DELIMITER)
+        {
+            ssize_t size = findDelimiter(b);
+
+            if (size < 0)
+            {
+                if (b->scanned > frame_max)
+                    result = -1;
+
+                break;
+            }
+
+            if ((size_t)size > frame_max)
+            {
+                result = -1;
+                break;
+            }
+
+            length = size;
+            delimiter = 1;
+        }
+        else
+        {
+            if (b->prefix == 0)
+            {
+                uint64_t value;
+                int n = readPrefix(b, &value);
+
+                if (n == 0)
+                    break;
+
+                if (n < 0 || value > frame_max)
+                {
+                    result = -1;
+                    break;
+                }
+
+                b->prefix = n;
+                b->needed = n + value;
+            }
+
+            if (b->size < b->needed)
+                break;
+
+            skip = b->prefix;
+            length = b->needed - b->prefix;
+            b->prefix = 0;
+        }
+
+        batchAdd(b, skip, length);
+        bufferConsume(b, skip + length + delimiter);
+    }
+
+    *records = batch.count;
+    batchSubmit(sock, 0);
+    return result;
 }
 
-// Creates a buffer array of the specified size.
+// Creates the buffer table of the calling thread.
 
-void bufferCreate(size_t size)
+void bufferCreate(size_t flushBytes, int flushMillis)
 {
-    buffer = calloc(size, sizeof(buffer_t));
-    buffer_size = size;
+    tableInit(&buffers, sizeof(buffer_t));
+    flush_bytes = flushBytes;
+    flush_millis = flushMillis;
+}
+
+// Sets how the calling thread splits the data of its connections into records.
+
+void bufferFraming(frame_mode_t mode, char delimiter, size_t maxRecord)
+{
+    frame_mode = mode;
+    frame_delimiter = delimiter;
+    frame_max = maxRecord;
+}
+
+// Limits the bytes that the buffers of the calling thread hold in memory.
+
+void bufferSpilling(size_t budget, const char *dir, metrics_t *metrics)
+{
+    spill_budget = budget;
+    spill_dir = dir;
+    spill_metrics = metrics;
+}
+
+// Starts a new connection on the buffer associated with the given socket.
+
+void bufferOpen(int sock)
+{
+    buffer_t *b = tableAt(&buffers, sock);
+    b->conn = atomic_fetch_add_explicit(&connections, 1, memory_order_relaxed) + 1;
+    b->sequence = 0;
+    b->sock = sock;
+    b->offset = 0;
+    b->scan = NULL;
+    b->scanned = 0;
+    b->prefix = 0;
 }
 
 // Appends data to the buffer associated with the given socket.
 
 void bufferAppend(int sock, const char *data, size_t size)
 {
-    if (sock >= buffer_size)
-        return;
+    while (size > 0)
+    {
+        struct iovec iov[2];
+        int count = bufferSpace(sock, size, iov);
+        size_t length = 0;
 
-    buffer[sock].data = realloc(buffer[sock].data, buffer[sock].size + size);
-    memcpy(buffer[sock].data + buffer[sock].size, data, size);
-    buffer[sock].size += size;
+        for (int i = 0; i < count; i++)
+        {
+            memcpy(iov[i].iov_base, data + length, iov[i].iov_len);
+            length += iov[i].iov_len;
+        }
+
+        if (count == 0)
+            return;
+
+        size_t records;
+        bufferCommit(sock, length, &records);
+        data += length;
+        size -= length;
+    }
+}
+
+// Gets free space at the end of the buffer associated with the given socket.
+
+int bufferSpace(int sock, size_t size, struct iovec iov[2])
+{
+    if (size == 0)
+        return 0;
+
+    buffer_t *b = tableAt(&buffers, sock);
+    int count = 0;
+
+    if (b->spilled)
+    {
+        count = spillSpace(&b->spill, size, iov);
+
+        if (count == 0)
+            perror("Cannot extend a spill file");
+
+        return count;
+    }
+
+    if (b->tail != NULL && b->tail->size < sizeof(b->tail->data))
+    {
+        size_t available = sizeof(b->tail->data) - b->tail->size;
+        iov[count].iov_base = b->tail->data + b->tail->size;
+        iov[count].iov_len = available < size ? available : size;
+        size -= iov[count++].iov_len;
+    }
+
+    if (size > 0)
+    {
+        if (b->spare == NULL)
+            b->spare = chunkGet(&pool);
+
+        iov[count].iov_base = b->spare->data;
+        iov[count++].iov_len = size < sizeof(b->spare->data) ? size : sizeof(b->spare->data);
+    }
+
+    return count;
+}
+
+// Marks the given number of bytes at the end of the buffer as used.
+
+int bufferCommit(int sock, size_t size, size_t *records)
+{
+    buffer_t *b = tableAt(&buffers, sock);
+    *records = 0;
+
+    if (b->spilled)
+    {
+        spillCommit(&b->spill, size);
+        metricsAdd(&spill_metrics->spilledBytes, size);
+        return 0;
+    }
+
+    if (spill_budget > 0 && size > 0)
+    {
+        if (!b->resident)
+            residentAdd(b);
+
+        resident_bytes += size;
+    }
+
+    if (flush_bytes > 0 && b->size == 0 && size > 0)
+        agingPush(sock);
+
+    b->size += size;
+
+    if (b->tail != NULL)
+    {
+        size_t available = sizeof(b->tail->data) - b->tail->size;
+        size_t length = size < available ? size : available;
+        b->tail->size += length;
+        size -= length;
+    }
+
+    if (b->spare != NULL)
+    {
+        if (size > 0)
+        {
+            if (b->tail != NULL)
+                b->tail->next = b->spare;
+            else
+                b->head = b->spare;
+
+            b->tail = b->spare;
+            b->tail->size = size;
+        }
+        else
+            chunkPut(&pool, b->spare, b->spare);
+
+        b->spare = NULL;
+    }
+
+    if (frame_mode != FRAME_NONE)
+        return bufferFrame(sock, records);
+
+    if (flush_bytes > 0 && b->size >= flush_bytes)
+        bufferEmit(sock);
+
+    if (spill_budget > 0 && resident_bytes > spill_budget)
+        enforceBudget();
+
+    atomic_store_explicit(&spill_metrics->residentBytes, resident_bytes, memory_order_relaxed);
+    return 0;
 }
 
-// Prints the contents of the buffer associated with the given socket and clears the buffer.
+// Hands the contents of the buffer associated with the given socket over to the output writer and clears the buffer.
 
 void bufferDump(int sock)
 {
-    if (sock >= buffer_size)
+    buffer_t *b = tableFind(&buffers, sock);
+
+    if (b == NULL || (b->head == NULL && !b->spilled))
         return;
 
-    if (buffer[sock].data != NULL)
+    if (frame_mode != FRAME_NONE)
+    {
+        if (b->size > 0)
+        {
+            batchAdd(b, 0, b->size);
+            batchSubmit(sock, 1);
+        }
+    }
+    else
+        bufferEmit(sock);
+
+    bufferClear(sock);
+}
+
+// Hands over the buffers whose oldest byte reached the age threshold in streaming mode.
+
+int bufferExpire()
+{
+    uint64_t now = 0;
+
+    for (; aging.count > 0; aging.head = (aging.head + 1) % aging.capacity, aging.count--)
     {
-        printf("[%d]: \"%.*s\"\n", sock, (int)buffer[sock].size, buffer[sock].data);
-        bufferClear(sock);
+        aging_t *entry = &aging.entries[aging.head];
+        buffer_t *b = tableAt(&buffers, entry->sock);
+
+        if (b->conn != entry->conn || b->sequence != entry->sequence || b->head == NULL)
+            continue;
+
+        if (now == 0)
+            now = wheelNow();
+
+        if (entry->deadline > now)
+            return entry->deadline - now;
+
+        bufferEmit(entry->sock);
     }
+
+    return -1;
+}
+
+// Reports the memory held by the data of the calling thread in the specified metrics.
+
+void bufferWatch(metrics_t *metrics)
+{
+    atomic_store_explicit(&metrics->pool, &pool, memory_order_release);
+}
+
+// Gets the memory held by the data received by the calling thread and not written yet.
+
+size_t bufferMemory()
+{
+    return chunkUsed(&pool);
 }
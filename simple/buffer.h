@@ -2,7 +2,13 @@
  * @file buffer.h
  * @brief This file contains declarations for functions related to buffer management.
  *
- * The buffer.h file provides functions to create, append data to, and dump the contents of a buffer array.
+ * The buffer.h file provides functions to create, append data to, and dump the contents of a buffer table.
+ * The table is indexed by socket and grows as connections arrive, so any socket has a buffer.
+ * Each buffer is a chain of fixed-size chunks taken from a per-thread pool.
+ * In streaming mode, a buffer is handed over to the output writer as a tagged segment whenever it grows past a size
+ * threshold or its oldest byte gets older than an age threshold, so the memory held per connection stays bounded.
+ * In framing mode, the data is split into records, and every record is handed over as soon as it is complete.
+ * Otherwise, the buffers that do not fit in the memory budget of the thread are moved to spill files on disk.
  *
  * @author Vikman Fernandez-Castro
  * @date July 7, 2024
@@ -11,52 +17,149 @@
 #pragma once
 
 #include <stddef.h>
+#include <sys/uio.h>
+#include "frame.h"
+#include "metrics.h"
 
 /**
- * @brief Creates a buffer array of the specified size.
+ * @brief Creates the buffer table of the calling thread.
  *
- * This function initializes the buffer array with the given size. Each element in the array is a buffer_t structure,
- * which contains a pointer to the buffer data and its size. The memory for the buffer array is allocated using calloc,
- * ensuring that all elements are initialized to zero.
+ * This function initializes the calling thread's buffer table. Each entry in the table is a buffer_t structure,
+ * which contains the chain of chunks holding the buffer data and its size. The entries are allocated in zeroed pages
+ * the first time a socket in their range is used.
  *
- * @param size The size of the buffer array to be created. This value should be greater than zero.
+ * @param flushBytes In streaming mode, the number of buffered bytes that triggers a segment, or 0 to accumulate the data until the connection closes.
+ * @param flushMillis In streaming mode, the age in milliseconds of the oldest buffered byte that triggers a segment.
  *
- * @return This function does not return a value. Upon successful creation of the buffer array, the global variables
- * 'buffer' and 'buffer_size' will be updated accordingly.
+ * @return This function does not return a value.
+ */
+void bufferCreate(size_t flushBytes, int flushMillis);
+
+/**
+ * @brief Sets how the calling thread splits the data of its connections into records.
+ *
+ * In framing mode, the records are handed over to the output writer as soon as they are complete, without copying them,
+ * in the format "[sock conn=id rec=n]: \"record\"". The delimiters and length prefixes are not printed.
+ *
+ * @param mode The framing mode, or FRAME_NONE to hand the data over when the connection closes or in segments.
+ * @param delimiter In delimiter mode, the byte that ends every record.
+ * @param maxRecord The maximum size of a record. A connection that exceeds it is not valid.
+ *
+ * @return This function does not return a value.
+ */
+void bufferFraming(frame_mode_t mode, char delimiter, size_t maxRecord);
+
+/**
+ * @brief Limits the bytes that the buffers of the calling thread hold in memory while they accumulate data until the connection closes.
+ *
+ * Whenever the buffers hold more than the budget, the largest ones are moved to spill files, which receive the rest
+ * of their data directly and are sent to the output by the writer when the connection closes.
+ *
+ * @param budget The maximum number of bytes held in memory, or 0 for no limit.
+ * @param dir The directory where the spill files are created.
+ * @param metrics The metrics of the calling thread, which count the spills and the bytes held in memory.
+ *
+ * @return This function does not return a value.
  */
-void bufferCreate(size_t size);
+void bufferSpilling(size_t budget, const char *dir, metrics_t *metrics);
+
+/**
+ * @brief Starts a new connection on the buffer associated with the given socket.
+ *
+ * This function gives the connection an identifier that is unique in the process and restarts its segment numbering.
+ *
+ * @param sock The socket of the new connection.
+ *
+ * @return This function does not return a value.
+ */
+void bufferOpen(int sock);
 
 /**
  * @brief Appends data to the buffer associated with the given socket.
  *
- * This function reallocates memory for the buffer data to accommodate the new data,
- * then copies the provided data into the buffer. The size of the buffer is updated accordingly.
+ * This function copies the provided data into the free space of the last chunk of the buffer,
+ * linking new chunks from the pool as they fill up. The data already stored is never moved.
+ * The size of the buffer is updated accordingly.
  *
  * @param sock The socket associated with the buffer to which data will be appended.
- *             This value should be a valid index within the buffer array.
  * @param data A pointer to the data to be appended to the buffer.
  * @param size The size of the data to be appended to the buffer.
  *
  * @return This function does not return a value.
- *
- * @note If the provided socket index is out of bounds (greater than or equal to buffer_size),
- *       the function will return without performing any action.
  */
 void bufferAppend(int sock, const char *data, size_t size);
 
+/**
+ * @brief Gets free space at the end of the buffer associated with the given socket.
+ *
+ * This function describes up to the given number of free bytes as I/O vectors, so that data can be received
+ * in place with readv(): the free space of the last chunk of the buffer, followed by an overflow region in a
+ * spare chunk from the pool if the last chunk has less room than requested. The data written there becomes part
+ * of the buffer after calling bufferCommit().
+ *
+ * @param sock The socket associated with the buffer.
+ * @param size The number of bytes to reserve. Fewer bytes may be reserved if they would span more than two chunks.
+ * @param iov Output array that receives the I/O vectors.
+ *
+ * @return The function returns the number of I/O vectors filled, or 0 if the size is 0.
+ */
+int bufferSpace(int sock, size_t size, struct iovec iov[2]);
+
+/**
+ * @brief Marks the given number of bytes at the end of the buffer as used.
+ *
+ * This function must be called after every call to bufferSpace(), even with zero bytes, so that
+ * the overflow chunk is either linked to the buffer or returned to the pool.
+ * In streaming mode, the buffer is handed over as a segment if it reaches the size threshold.
+ * In framing mode, the records completed by the new data are handed over.
+ *
+ * @param sock The socket associated with the buffer.
+ * @param size The number of bytes written to the space returned by bufferSpace(). It must not exceed the size reserved there.
+ * @param records Output parameter that receives the number of records handed over, including those before a record that is not valid.
+ *
+ * @return The function returns 0, or -1 if the data of the connection is not valid in framing mode.
+ */
+int bufferCommit(int sock, size_t size, size_t *records);
+
 /**
  * @brief Prints the contents of the buffer associated with the given socket and clears the buffer.
  *
- * This function checks if the provided socket index is within bounds. If it is, it then checks if the buffer
- * associated with the given socket contains any data. If data is present, it prints the data to the standard output
- * in the format "[sock]: \"data\"". After printing the data, the function clears the buffer by calling the
- * bufferClear() function.
+ * This function checks if the buffer associated with the given socket contains any data. If data is present, it hands the chunks over to the
+ * output writer, which prints them to the standard output in the format "[sock]: \"data\"" on its own thread.
+ * In streaming mode, the remaining data is printed as the last segment, in the format "[sock conn=id seq=n]: \"data\"".
+ * In framing mode, the data of an incomplete record is printed as the last record, in the format "[sock conn=id rec=n partial]: \"data\"".
+ * The buffer is left empty and ready for reuse.
  *
- * @param sock The socket associated with the buffer to be dumped. This value should be a valid index within the buffer array.
+ * @param sock The socket associated with the buffer to be dumped.
  *
  * @return This function does not return a value.
- *
- * @note If the provided socket index is out of bounds (greater than or equal to buffer_size),
- *       the function will return without performing any action.
  */
 void bufferDump(int sock);
+
+/**
+ * @brief Hands over the buffers whose oldest byte reached the age threshold in streaming mode.
+ *
+ * @return The function returns the number of milliseconds until the next buffer reaches the threshold, or -1 if no buffer holds data.
+ */
+int bufferExpire();
+
+/**
+ * @brief Reports the memory held by the data of the calling thread in the specified metrics.
+ *
+ * The metrics read the counter of the thread's chunk pool, so the value stays current while the writer releases the data.
+ *
+ * @param metrics The metrics of the calling thread.
+ *
+ * @return This function does not return a value.
+ */
+void bufferWatch(metrics_t *metrics);
+
+/**
+ * @brief Gets the memory held by the data received by the calling thread and not written yet.
+ *
+ * The data counts from the moment it is received until the writer writes it or it moves to a spill file,
+ * in whole chunks, so the value is the memory taken from the thread's chunk pool.
+ *
+ * @return The function returns the number of bytes.
+ */
+size_t bufferMemory();
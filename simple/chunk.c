@@ -0,0 +1,119 @@
+/**
+ * @file chunk.c
+ * @brief This file contains the implementation of the chunk pool.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "chunk.h"
+
+#define SLAB_CHUNKS 64
+
+/**
+ * @brief Counts the chunks of a chain.
+ *
+ * @param head The first chunk of the chain.
+ * @param tail The last chunk of the chain.
+ *
+ * @return The function returns the number of chunks.
+ */
+static size_t chainLength(const chunk_t *head, const chunk_t *tail)
+{
+    size_t count = 1;
+
+    for (; head != tail; head = head->next)
+        count++;
+
+    return count;
+}
+
+// Takes an empty chunk from the pool.
+
+chunk_t *chunkGet(chunk_pool_t *pool)
+{
+    if (pool->free == NULL)
+        pool->free = atomic_exchange_explicit(&pool->remote, NULL, memory_order_acquire);
+
+    if (pool->free == NULL)
+    {
+        chunk_t *slab = malloc(SLAB_CHUNKS * sizeof(chunk_t));
+
+        if (slab == NULL)
+        {
+            perror("malloc");
+            abort();
+        }
+
+        for (int i = 0; i < SLAB_CHUNKS; i++)
+            slab[i].next = i + 1 < SLAB_CHUNKS ? &slab[i + 1] : NULL;
+
+        pool->free = slab;
+    }
+
+    chunk_t *chunk = pool->free;
+    pool->free = chunk->next;
+    chunk->next = NULL;
+    chunk->size = 0;
+    atomic_store_explicit(&chunk->refs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&pool->used, 1, memory_order_relaxed);
+    return chunk;
+}
+
+// Returns a chain of chunks to the pool from the owner thread.
+
+void chunkPut(chunk_pool_t *pool, chunk_t *head, chunk_t *tail)
+{
+    atomic_fetch_sub_explicit(&pool->used, chainLength(head, tail), memory_order_relaxed);
+    tail->next = pool->free;
+    pool->free = head;
+}
+
+// Returns a chain of chunks to the pool from any thread.
+
+void chunkPutRemote(chunk_pool_t *pool, chunk_t *head, chunk_t *tail)
+{
+    atomic_fetch_sub_explicit(&pool->used, chainLength(head, tail), memory_order_relaxed);
+    chunk_t *top = atomic_load_explicit(&pool->remote, memory_order_relaxed);
+
+    do
+        tail->next = top;
+    while (!atomic_compare_exchange_weak_explicit(&pool->remote, &top, head, memory_order_release, memory_order_relaxed));
+}
+
+// Releases a reference to a chunk from the owner thread.
+
+void chunkRelease(chunk_pool_t *pool, chunk_t *chunk)
+{
+    if (atomic_fetch_sub_explicit(&chunk->refs, 1, memory_order_acq_rel) == 1)
+        chunkPut(pool, chunk, chunk);
+}
+
+// Releases a reference to every chunk of a chain from any thread.
+
+void chunkReleaseRemote(chunk_pool_t *pool, chunk_t *head, chunk_t *tail)
+{
+    chunk_t *first = NULL;
+    chunk_t *last = NULL;
+    chunk_t *next;
+
+    for (chunk_t *chunk = head; chunk != NULL; chunk = next)
+    {
+        // Once released, the chunk may be recycled by another holder, so its link is read first.
+        next = chunk != tail ? chunk->next : NULL;
+
+        if (atomic_fetch_sub_explicit(&chunk->refs, 1, memory_order_acq_rel) == 1)
+        {
+            chunk->next = first;
+            first = chunk;
+
+            if (last == NULL)
+                last = chunk;
+        }
+    }
+
+    if (first != NULL)
+        chunkPutRemote(pool, first, last);
+}
@@ -0,0 +1,120 @@
+/**
+ * @file chunk.h
+ * @brief This file contains the declaration of the chunk_t and chunk_pool_t data structures and related functions.
+ *
+ * Chunks are fixed-size blocks of memory that hold the data received from the connections.
+ * Every event loop owns a pool that carves chunks from slabs and recycles them through a free list.
+ * Other threads, such as the output writer, may also return chunks to a pool without locking.
+ * A chunk may be shared by a buffer and the records handed over from it, so it also counts its references,
+ * and it goes back to the pool when the last one is released.
+ * The pool counts the chunks taken from it and not returned yet, so that its owner knows how much memory its data holds.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define CHUNK_SIZE 16384
+
+typedef struct chunk_t
+{
+    struct chunk_t *next;
+    size_t size;
+    atomic_size_t refs; // The number of references, 1 when the chunk is taken from the pool.
+    char data[CHUNK_SIZE - sizeof(struct chunk_t *) - 2 * sizeof(size_t)];
+} chunk_t;
+
+typedef struct chunk_pool_t
+{
+    chunk_t *free;            // Chunks available to the owner thread.
+    _Atomic(chunk_t *) remote; // Chunks returned by other threads.
+    atomic_size_t used;        // Chunks taken from the pool and not returned yet.
+} chunk_pool_t;
+
+/**
+ * @brief Takes an empty chunk from the pool.
+ *
+ * If the pool has no free chunks, it first collects the chunks returned by other threads,
+ * and then allocates a new slab of chunks. Only the owner thread may call this function.
+ *
+ * @param pool The chunk pool.
+ *
+ * @return The function returns an empty chunk.
+ */
+chunk_t *chunkGet(chunk_pool_t *pool);
+
+/**
+ * @brief Returns a chain of chunks to the pool from the owner thread.
+ *
+ * @param pool The chunk pool.
+ * @param head The first chunk of the chain.
+ * @param tail The last chunk of the chain.
+ *
+ * @return This function does not return a value.
+ */
+void chunkPut(chunk_pool_t *pool, chunk_t *head, chunk_t *tail);
+
+/**
+ * @brief Returns a chain of chunks to the pool from any thread.
+ *
+ * The chain is pushed to a lock-free list that the owner thread collects when it runs out of free chunks.
+ *
+ * @param pool The chunk pool.
+ * @param head The first chunk of the chain.
+ * @param tail The last chunk of the chain.
+ *
+ * @return This function does not return a value.
+ */
+void chunkPutRemote(chunk_pool_t *pool, chunk_t *head, chunk_t *tail);
+
+/**
+ * @brief Gets the memory held by the chunks taken from the pool and not returned yet, by any thread.
+ *
+ * @param pool The chunk pool.
+ *
+ * @return The function returns the number of bytes.
+ */
+static inline size_t chunkUsed(const chunk_pool_t *pool)
+{
+    return atomic_load_explicit(&pool->used, memory_order_relaxed) * CHUNK_SIZE;
+}
+
+/**
+ * @brief Adds a reference to a chunk. Only a thread that already holds a reference may call this function.
+ *
+ * @param chunk The chunk.
+ *
+ * @return This function does not return a value.
+ */
+static inline void chunkRetain(chunk_t *chunk)
+{
+    atomic_fetch_add_explicit(&chunk->refs, 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Releases a reference to a chunk from the owner thread, returning the chunk to the pool if it was the last one.
+ *
+ * @param pool The chunk pool.
+ * @param chunk The chunk.
+ *
+ * @return This function does not return a value.
+ */
+void chunkRelease(chunk_pool_t *pool, chunk_t *chunk);
+
+/**
+ * @brief Releases a reference to every chunk of a chain from any thread, returning to the pool those that were the last one.
+ *
+ * The links between the chunks of the chain must not change while it is released, but the last chunk may still be
+ * linked to others by the owner thread, so its link is not followed.
+ *
+ * @param pool The chunk pool.
+ * @param head The first chunk of the chain.
+ * @param tail The last chunk of the chain.
+ *
+ * @return This function does not return a value.
+ */
+void chunkReleaseRemote(chunk_pool_t *pool, chunk_t *head, chunk_t *tail);
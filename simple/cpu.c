@@ -0,0 +1,153 @@
+/**
+ * @file cpu.c
+ * @brief This file contains the implementation of the functions that bind event loops and connections to CPUs.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "cpu.h"
+
+#ifdef __linux__
+#include <sched.h>
+#include <linux/filter.h>
+#endif
+
+#define die(msg)     \
+    {                \
+        perror(msg); \
+        abort();     \
+    }
+
+// Parses a list of CPUs.
+
+int cpuParse(const char *list, int **cpus)
+{
+    int count = 0;
+    int capacity = 0;
+
+    *cpus = NULL;
+
+    for (const char *p = list;; p++)
+    {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+
+        if (end == p || first < 0)
+            break;
+
+        if (*end == '-')
+        {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+
+            if (end == p || last < first)
+                break;
+        }
+
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            if (count == capacity)
+            {
+                capacity = capacity > 0 ? capacity * 2 : 16;
+                *cpus = realloc(*cpus, capacity * sizeof(int));
+
+                if (*cpus == NULL)
+                    die("realloc");
+            }
+
+            (*cpus)[count++] = cpu;
+        }
+
+        if (*end == '\0')
+            return count;
+
+        if (*end != ',')
+            break;
+
+        p = end;
+    }
+
+    free(*cpus);
+    *cpus = NULL;
+    return -1;
+}
+
+// Pins the calling thread to the specified CPU.
+
+void cpuPin(int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    if (error != 0)
+        fprintf(stderr, "Cannot pin thread to CPU %d\n", cpu);
+#endif
+}
+
+// Makes the kernel prefer a listening socket for the connections whose packets are processed on the specified CPU.
+
+void cpuPrefer(int sock, int cpu)
+{
+#ifdef SO_INCOMING_CPU
+    if (setsockopt(sock, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) < 0)
+        perror("setsockopt: SO_INCOMING_CPU");
+#endif
+}
+
+// Attaches a program to a SO_REUSEPORT group that sends every connection to the socket of the CPU that received it.
+
+int cpuSteer(int sock, const int *cpus, unsigned count)
+{
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+    // Load the CPU, return the index of the first socket on it, or fall back to the CPU modulo the number of sockets.
+    unsigned length = 2 * count + 3;
+    struct sock_filter *code = malloc(length * sizeof(struct sock_filter));
+
+    if (code == NULL)
+        return -1;
+
+    code[0] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU);
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        code[1 + 2 * i] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, cpus[i], 0, 1);
+        code[2 + 2 * i] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, i);
+    }
+
+    code[length - 2] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, count);
+    code[length - 1] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_A, 0);
+
+    struct sock_fprog program = {.len = length, .filter = code};
+    int result = setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program));
+    free(code);
+    return result < 0 ? -1 : 0;
+#else
+    return -1;
+#endif
+}
+
+// Gets the CPU on which the kernel processed the last packet of a socket.
+
+int cpuIncoming(int sock)
+{
+#ifdef SO_INCOMING_CPU
+    int cpu;
+    socklen_t length = sizeof(cpu);
+
+    if (getsockopt(sock, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &length) == 0)
+        return cpu;
+#endif
+
+    return -1;
+}
@@ -0,0 +1,67 @@
+/**
+ * @file cpu.h
+ * @brief This file contains the declaration of the functions that bind event loops and connections to CPUs.
+ *
+ * An event loop can be pinned to a CPU, and the connections can be steered to the loop that runs on the CPU
+ * where the kernel processes their packets, so that receiving and handling the data stay in the same cache.
+ * Connections are steered by the kernel when they are accepted, either with a classic BPF program attached to
+ * the SO_REUSEPORT group of the listening sockets, or with SO_INCOMING_CPU on every listening socket.
+ * These features are only available on Linux. Elsewhere, the functions do nothing.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#pragma once
+
+/**
+ * @brief Parses a list of CPUs, such as "0-3,8,10-11".
+ *
+ * @param list The list.
+ * @param cpus Output parameter that receives an array with the CPUs, allocated with malloc().
+ *
+ * @return The function returns the number of CPUs, or -1 if the list is not valid.
+ */
+int cpuParse(const char *list, int **cpus);
+
+/**
+ * @brief Pins the calling thread to the specified CPU.
+ *
+ * @param cpu The CPU.
+ *
+ * @return This function does not return a value.
+ */
+void cpuPin(int cpu);
+
+/**
+ * @brief Makes the kernel prefer a listening socket for the connections whose packets are processed on the specified CPU.
+ *
+ * @param sock The listening socket, which belongs to a SO_REUSEPORT group.
+ * @param cpu The CPU.
+ *
+ * @return This function does not return a value.
+ */
+void cpuPrefer(int sock, int cpu);
+
+/**
+ * @brief Attaches a program to a SO_REUSEPORT group that sends every connection to the socket of the CPU that received it.
+ *
+ * The sockets of the group are numbered in the order they started listening. The connections received on the CPU
+ * of a socket go to that socket, and the rest are spread among all the sockets by CPU number.
+ *
+ * @param sock Any listening socket of the group.
+ * @param cpus The CPU of every socket of the group, in order.
+ * @param count The number of sockets.
+ *
+ * @return The function returns 0 on success, or -1 on error.
+ */
+int cpuSteer(int sock, const int *cpus, unsigned count);
+
+/**
+ * @brief Gets the CPU on which the kernel processed the last packet of a socket.
+ *
+ * @param sock The socket.
+ *
+ * @return The function returns the CPU, or -1 if it is not known.
+ */
+int cpuIncoming(int sock);
@@ -0,0 +1,177 @@
+/**
+ * @file frame.c
+ * @brief This file contains the implementation of the functions that split a stream into records.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "frame.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define FRAME_AVX2
+#endif
+
+/**
+ * @brief Searches a block of data for a delimiter one byte at a time.
+ *
+ * @param data The data.
+ * @param length The size of the data.
+ * @param delimiter The delimiter.
+ *
+ * @return The function returns the position of the first delimiter, or the size of the data if there is none.
+ */
+static size_t findScalar(const char *data, size_t length, char delimiter)
+{
+    for (size_t i = 0; i < length; i++)
+        if (data[i] == delimiter)
+            return i;
+
+    return length;
+}
+
+#ifdef __SSE2__
+/**
+ * @brief Searches a block of data for a delimiter 16 bytes at a time.
+ *
+ * @param data The data.
+ * @param length The size of the data.
+ * @param delimiter The delimiter.
+ *
+ * @return The function returns the position of the first delimiter, or the size of the data if there is none.
+ */
+static size_t findSse2(const char *data, size_t length, char delimiter)
+{
+    __m128i pattern = _mm_set1_epi8(delimiter);
+    size_t i = 0;
+
+    for (; i + 16 <= length; i += 16)
+    {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i)), pattern));
+
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + findScalar(data + i, length - i, delimiter);
+}
+#endif
+
+#ifdef FRAME_AVX2
+/**
+ * @brief Searches a block of data for a delimiter 32 bytes at a time.
+ *
+ * The function is compiled for AVX2 regardless of the target of the build, so it must only run on CPUs that support it.
+ *
+ * @param data The data.
+ * @param length The size of the data.
+ * @param delimiter The delimiter.
+ *
+ * @return The function returns the position of the first delimiter, or the size of the data if there is none.
+ */
+__attribute__((target("avx2"))) static size_t findAvx2(const char *data, size_t length, char delimiter)
+{
+    __m256i pattern = _mm256_set1_epi8(delimiter);
+    size_t i = 0;
+
+    for (; i + 32 <= length; i += 32)
+    {
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i)), pattern));
+
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + findScalar(data + i, length - i, delimiter);
+}
+#endif
+
+// Parses a framing mode.
+
+int frameParse(const char *spec, frame_mode_t *mode, char *delimiter)
+{
+    if (strcmp(spec, "newline") == 0)
+    {
+        *mode = FRAME_DELIMITER;
+        *delimiter = '\n';
+    }
+    else if (strcmp(spec, "u32") == 0)
+        *mode = FRAME_U32;
+    else if (strcmp(spec, "varint") == 0)
+        *mode = FRAME_VARINT;
+    else if (strncmp(spec, "delimiter:", 10) == 0 && strlen(spec + 10) == 1)
+    {
+        *mode = FRAME_DELIMITER;
+        *delimiter = spec[10];
+    }
+    else if (strncmp(spec, "delimiter:", 10) == 0 && spec[10] != '\0')
+    {
+        char *end;
+        unsigned long value = strtoul(spec + 10, &end, 0);
+
+        if (*end != '\0' || value > 255)
+            return -1;
+
+        *mode = FRAME_DELIMITER;
+        *delimiter = (char)value;
+    }
+    else
+        return -1;
+
+    return 0;
+}
+
+// Searches a block of data for a delimiter.
+
+size_t frameFind(const char *data, size_t length, char delimiter)
+{
+#ifdef FRAME_AVX2
+    if (__builtin_cpu_supports("avx2"))
+        return findAvx2(data, length, delimiter);
+#endif
+#ifdef __SSE2__
+    return findSse2(data, length, delimiter);
+#else
+    return findScalar(data, length, delimiter);
+#endif
+}
+
+// Decodes the length prefix of a record.
+
+int frameLength(frame_mode_t mode, const unsigned char *data, size_t length, uint64_t *value)
+{
+    if (mode == FRAME_U32)
+    {
+        if (length < 4)
+            return 0;
+
+        *value = (uint64_t)data[0] << 24 | (uint64_t)data[1] << 16 | (uint64_t)data[2] << 8 | data[3];
+        return 4;
+    }
+
+    uint64_t result = 0;
+
+    for (size_t i = 0; i < length && i < FRAME_PREFIX_MAX; i++)
+    {
+        // The tenth byte holds the top bit of a 64-bit length only.
+        if (i == FRAME_PREFIX_MAX - 1 && data[i] > 1)
+            return -1;
+
+        result |= (uint64_t)(data[i] & 0x7f) << (7 * i);
+
+        if ((data[i] & 0x80) == 0)
+        {
+            *value = result;
+            return i + 1;
+        }
+    }
+
+    return length < FRAME_PREFIX_MAX ? 0 : -1;
+}
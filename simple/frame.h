@@ -0,0 +1,61 @@
+/**
+ * @file frame.h
+ * @brief This file contains the declaration of the functions that split a stream into records.
+ *
+ * A connection may carry a sequence of records instead of a single message. Records are either terminated by a
+ * delimiter byte, such as a newline, or preceded by their length, as a 32-bit big-endian integer or as a varint
+ * (7 bits per byte, least significant group first, with the high bit set on every byte but the last).
+ * The delimiter is searched 32 or 16 bytes at a time with AVX2 or SSE2 where the CPU supports them.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FRAME_PREFIX_MAX 10
+
+typedef enum frame_mode_t
+{
+    FRAME_NONE,      // The data of a connection is not split.
+    FRAME_DELIMITER, // Every record ends with a delimiter byte.
+    FRAME_U32,       // Every record starts with its length as a 32-bit big-endian integer.
+    FRAME_VARINT,    // Every record starts with its length as a varint.
+} frame_mode_t;
+
+/**
+ * @brief Parses a framing mode: "newline", "u32", "varint" or "delimiter:C", where C is a character or a byte such as "0x1e".
+ *
+ * @param spec The mode.
+ * @param mode Output parameter that receives the mode.
+ * @param delimiter Output parameter that receives the delimiter, in delimiter mode.
+ *
+ * @return The function returns 0 on success, or -1 if the mode is not valid.
+ */
+int frameParse(const char *spec, frame_mode_t *mode, char *delimiter);
+
+/**
+ * @brief Searches a block of data for a delimiter.
+ *
+ * @param data The data.
+ * @param length The size of the data.
+ * @param delimiter The delimiter.
+ *
+ * @return The function returns the position of the first delimiter, or the size of the data if there is none.
+ */
+size_t frameFind(const char *data, size_t length, char delimiter);
+
+/**
+ * @brief Decodes the length prefix of a record.
+ *
+ * @param mode The framing mode, FRAME_U32 or FRAME_VARINT.
+ * @param data The first bytes of the record.
+ * @param length The number of bytes available, at most FRAME_PREFIX_MAX are used.
+ * @param value Output parameter that receives the length of the record, without the prefix.
+ *
+ * @return The function returns the size of the prefix, 0 if more bytes are needed, or -1 if the prefix is not valid.
+ */
+int frameLength(frame_mode_t mode, const unsigned char *data, size_t length, uint64_t *value);
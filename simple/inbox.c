@@ -0,0 +1,129 @@
+/**
+ * @file inbox.c
+ * @brief This file contains the implementation of the inbox through which the acceptor thread hands connections over.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "inbox.h"
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#define die(msg)     \
+    {                \
+        perror(msg); \
+        abort();     \
+    }
+
+// Initializes an empty inbox and opens its notification descriptors.
+
+void inboxInit(inbox_t *inbox)
+{
+    atomic_init(&inbox->head, 0);
+    atomic_init(&inbox->tail, 0);
+    atomic_init(&inbox->closed, 0);
+
+#ifdef __linux__
+    inbox->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (inbox->fd < 0)
+        die("eventfd");
+
+    inbox->notifyFd = inbox->fd;
+#else
+    int fds[2];
+
+    if (pipe(fds) < 0)
+        die("pipe");
+
+    for (int i = 0; i < 2; i++)
+    {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    inbox->fd = fds[0];
+    inbox->notifyFd = fds[1];
+#endif
+}
+
+// Puts a socket in the inbox.
+
+int inboxPush(inbox_t *inbox, int sock)
+{
+    size_t tail = atomic_load_explicit(&inbox->tail, memory_order_relaxed);
+
+    if (tail - atomic_load_explicit(&inbox->head, memory_order_acquire) == INBOX_CAPACITY)
+        return -1;
+
+    inbox->socks[tail % INBOX_CAPACITY] = sock;
+    atomic_store_explicit(&inbox->tail, tail + 1, memory_order_release);
+    return 0;
+}
+
+// Wakes up the loop of the inbox.
+
+void inboxNotify(inbox_t *inbox)
+{
+    uint64_t one = 1;
+
+    // A full pipe already holds a notification, and an eventfd only fails if its counter overflows.
+    while (write(inbox->notifyFd, &one, sizeof(one)) < 0 && errno == EINTR)
+        ;
+}
+
+// Takes the oldest socket out of the inbox.
+
+int inboxPop(inbox_t *inbox)
+{
+    size_t head = atomic_load_explicit(&inbox->head, memory_order_relaxed);
+
+    if (head == atomic_load_explicit(&inbox->tail, memory_order_acquire))
+        return -1;
+
+    int sock = inbox->socks[head % INBOX_CAPACITY];
+    atomic_store_explicit(&inbox->head, head + 1, memory_order_release);
+    return sock;
+}
+
+// Consumes the pending notifications.
+
+void inboxDrain(inbox_t *inbox)
+{
+#ifdef __linux__
+    // Reading an eventfd resets its counter.
+    uint64_t value;
+
+    while (read(inbox->fd, &value, sizeof(value)) < 0 && errno == EINTR)
+        ;
+#else
+    char data[256];
+
+    for (ssize_t n; (n = read(inbox->fd, data, sizeof(data))) > 0 || (n < 0 && errno == EINTR);)
+        ;
+#endif
+}
+
+// Counts a connection handed over through the inbox as closed.
+
+void inboxRelease(inbox_t *inbox)
+{
+    atomic_fetch_add_explicit(&inbox->closed, 1, memory_order_relaxed);
+}
+
+// Gets the number of connections handed over through the inbox that are still waiting or open.
+
+size_t inboxLoad(inbox_t *inbox)
+{
+    return atomic_load_explicit(&inbox->tail, memory_order_relaxed) - atomic_load_explicit(&inbox->closed, memory_order_relaxed);
+}
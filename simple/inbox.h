@@ -0,0 +1,105 @@
+/**
+ * @file inbox.h
+ * @brief This file contains the declaration of the inbox_t data structure and related functions.
+ *
+ * An inbox hands accepted connections over from the acceptor thread to one event loop. It is a bounded ring of sockets
+ * with a single producer and a single consumer, so both sides only touch their own index and no lock is taken.
+ * After putting a socket, the acceptor writes to a notification descriptor (an eventfd on Linux, a pipe elsewhere)
+ * that the loop keeps in its poll set, so an idle loop wakes up, and a busy one takes every waiting socket at once.
+ * The inbox also counts the connections it handed over that the loop has closed, so the acceptor knows the load of the loop.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define INBOX_CAPACITY 1024
+
+typedef enum inbox_policy_t
+{
+    INBOX_NONE,         // Every loop accepts its own connections.
+    INBOX_ROUND_ROBIN,  // The acceptor thread hands the connections over to the loops in turn.
+    INBOX_LEAST_LOADED, // The acceptor thread hands every connection over to the loop with the fewest open ones.
+} inbox_policy_t;
+
+typedef struct inbox_t
+{
+    _Alignas(64) atomic_size_t head;   // The number of sockets taken, written by the loop.
+    _Alignas(64) atomic_size_t tail;   // The number of sockets put, written by the acceptor.
+    _Alignas(64) atomic_size_t closed; // The number of connections handed over that the loop has closed.
+    int socks[INBOX_CAPACITY];
+    int fd;       // The descriptor that the loop polls for notifications.
+    int notifyFd; // The descriptor that the acceptor writes the notifications to.
+} inbox_t;
+
+/**
+ * @brief Initializes an empty inbox and opens its notification descriptors.
+ *
+ * @param inbox The inbox.
+ *
+ * @return This function does not return a value.
+ */
+void inboxInit(inbox_t *inbox);
+
+/**
+ * @brief Puts a socket in the inbox. Only the acceptor thread may call this function.
+ *
+ * @param inbox The inbox.
+ * @param sock The socket.
+ *
+ * @return The function returns 0 on success, or -1 if the inbox is full.
+ */
+int inboxPush(inbox_t *inbox, int sock);
+
+/**
+ * @brief Wakes up the loop of the inbox. Only the acceptor thread may call this function.
+ *
+ * @param inbox The inbox.
+ *
+ * @return This function does not return a value.
+ */
+void inboxNotify(inbox_t *inbox);
+
+/**
+ * @brief Takes the oldest socket out of the inbox. Only the loop of the inbox may call this function.
+ *
+ * @param inbox The inbox.
+ *
+ * @return The function returns the socket, or -1 if the inbox is empty.
+ */
+int inboxPop(inbox_t *inbox);
+
+/**
+ * @brief Consumes the pending notifications. Only the loop of the inbox may call this function.
+ *
+ * The notifications must be consumed before the inbox is emptied, so that a socket put in between is not missed:
+ * at worst, its notification wakes the loop up once more with nothing to take.
+ *
+ * @param inbox The inbox.
+ *
+ * @return This function does not return a value.
+ */
+void inboxDrain(inbox_t *inbox);
+
+/**
+ * @brief Counts a connection handed over through the inbox as closed. Only the loop of the inbox may call this function.
+ *
+ * @param inbox The inbox.
+ *
+ * @return This function does not return a value.
+ */
+void inboxRelease(inbox_t *inbox);
+
+/**
+ * @brief Gets the number of connections handed over through the inbox that are still waiting or open.
+ * Only the acceptor thread may call this function.
+ *
+ * @param inbox The inbox.
+ *
+ * @return The function returns the number of connections.
+ */
+size_t inboxLoad(inbox_t *inbox);
@@ -0,0 +1,413 @@
+/**
+ * @file log.c
+ * @brief This file contains the implementation of the segment log sink.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "log.h"
+
+static const char *dir;
+static size_t segmentSize;
+static uint64_t first;    // The number of the first record of the current segment in the log.
+static int fd = -1;       // The current segment, or -1 if there is none.
+static int indexFd = -1;  // The index of the current segment.
+static char *map;         // The mapping of the current segment.
+static uint64_t *offsets; // The mapping of the index of the current segment.
+static size_t capacity;   // The size of the current segment.
+static size_t length;     // The bytes of records in the current segment.
+static size_t count;      // The number of records in the current segment.
+
+/**
+ * @brief Computes the size of a record in a segment, including its header and padding.
+ *
+ * @param size The size of the data of the record.
+ *
+ * @return The function returns the size of the record.
+ */
+static size_t recordSize(size_t size)
+{
+    return (sizeof(log_header_t) + size + 7) & ~(size_t)7;
+}
+
+/**
+ * @brief Computes the size of the index of a segment, which has room for as many records without data as the segment.
+ *
+ * @param size The size of the segment.
+ *
+ * @return The function returns the size of the index.
+ */
+static size_t indexSize(size_t size)
+{
+    return size / sizeof(log_header_t) * sizeof(uint64_t);
+}
+
+/**
+ * @brief Builds the path of a file of a segment.
+ *
+ * @param path Output parameter that receives the path.
+ * @param size The size of the path buffer.
+ * @param number The number of the first record of the segment in the log.
+ * @param extension The extension of the file: "log" for the records, or "idx" for the index.
+ *
+ * @return This function does not return a value.
+ */
+static void segmentPath(char *path, size_t size, uint64_t number, const char *extension)
+{
+    snprintf(path, size, "%s/%020llu.%s", dir, (unsigned long long)number, extension);
+}
+
+/**
+ * @brief Copies a record out of the chunks it spans.
+ *
+ * The size of the last chunk of the payload may still grow while it is copied, so it is never read.
+ *
+ * @param payload The payload that holds the record.
+ * @param record The record.
+ * @param data The destination.
+ *
+ * @return This function does not return a value.
+ */
+static void copyRecord(const payload_t *payload, const record_t *record, char *data)
+{
+    chunk_t *chunk = record->chunk;
+    size_t offset = record->offset;
+
+    for (size_t remaining = record->length; remaining > 0;)
+    {
+        size_t size = chunk != payload->tail && chunk->size - offset < remaining ? chunk->size - offset : remaining;
+        memcpy(data, chunk->data + offset, size);
+        data += size;
+        remaining -= size;
+
+        // The link of the last chunk may be changing, so it is only followed if the record goes on.
+        if (remaining > 0)
+        {
+            chunk = chunk->next;
+            offset = 0;
+        }
+    }
+}
+
+/**
+ * @brief Reads the data of a spill file.
+ *
+ * @param file The spill file.
+ * @param data The destination.
+ * @param size The size of the data in the file.
+ *
+ * @return This function does not return a value.
+ */
+static void readFile(int file, char *data, size_t size)
+{
+    for (size_t offset = 0; offset < size;)
+    {
+        ssize_t n = pread(file, data + offset, size - offset, offset);
+
+        if (n <= 0)
+        {
+            if (n < 0 && errno == EINTR)
+                continue;
+
+            perror("pread");
+            return;
+        }
+
+        offset += n;
+    }
+}
+
+/**
+ * @brief Closes the current segment and its index, truncating them to their records.
+ *
+ * @return This function does not return a value.
+ */
+static void segmentClose()
+{
+    if (map != NULL)
+        munmap(map, capacity);
+
+    if (offsets != NULL)
+        munmap(offsets, indexSize(capacity));
+
+    if (fd >= 0 && ftruncate(fd, length) < 0)
+        perror("ftruncate");
+
+    if (indexFd >= 0 && ftruncate(indexFd, count * sizeof(uint64_t)) < 0)
+        perror("ftruncate");
+
+    if (fd >= 0)
+        close(fd);
+
+    if (indexFd >= 0)
+        close(indexFd);
+
+    first += count;
+    fd = -1;
+    indexFd = -1;
+    map = NULL;
+    offsets = NULL;
+    length = 0;
+    count = 0;
+}
+
+/**
+ * @brief Opens a new segment and its index, numbered after the records of the previous segments.
+ *
+ * The segment is preallocated, so that the pages of the mapping never run out of disk space while they are written,
+ * and the index is extended without allocating, since it only grows with the records.
+ *
+ * @param size The size of the segment.
+ *
+ * @return The function returns 0 on success, or -1 if the segment could not be opened.
+ */
+static int segmentOpen(size_t size)
+{
+    char path[4096];
+
+    segmentPath(path, sizeof(path), first, "log");
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    segmentPath(path, sizeof(path), first, "idx");
+    indexFd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    capacity = size;
+
+#ifdef __linux__
+    int allocated = fd >= 0 && posix_fallocate(fd, 0, capacity) == 0;
+#else
+    int allocated = fd >= 0 && ftruncate(fd, capacity) == 0;
+#endif
+
+    if (allocated && indexFd >= 0 && ftruncate(indexFd, indexSize(capacity)) == 0)
+    {
+        void *segment = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        void *entries = mmap(NULL, indexSize(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, indexFd, 0);
+        map = segment != MAP_FAILED ? segment : NULL;
+        offsets = entries != MAP_FAILED ? entries : NULL;
+
+        if (map != NULL && offsets != NULL)
+            return 0;
+    }
+
+    segmentPath(path, sizeof(path), first, "log");
+    fprintf(stderr, "Error opening log segment %s\n", path);
+    segmentClose();
+    return -1;
+}
+
+/**
+ * @brief Starts a record at the end of the current segment, writing its header.
+ *
+ * If the record does not fit, the segment rolls over. A record larger than the segment size gets a segment of its own.
+ *
+ * @param header The header of the record.
+ *
+ * @return The function returns the space for the data of the record, or NULL if no segment could be opened.
+ */
+static char *logAppend(const log_header_t *header)
+{
+    size_t size = recordSize(header->length);
+
+    if (fd >= 0 && length + size > capacity)
+        segmentClose();
+
+    if (fd < 0 && segmentOpen(size > segmentSize ? size : segmentSize) < 0)
+        return NULL;
+
+    memcpy(map + length, header, sizeof(*header));
+    return map + length + sizeof(*header);
+}
+
+/**
+ * @brief Ends the record started by logAppend(), adding it to the index.
+ *
+ * @return This function does not return a value.
+ */
+static void logCommit()
+{
+    length += recordSize(((log_header_t *)(map + length))->length);
+    offsets[count++] = length;
+}
+
+/**
+ * @brief Finds the last segment of the log, so that the next one is numbered after its records.
+ *
+ * The index of a segment that was not closed keeps its preallocated size, and the entries after the last record are zero,
+ * so the records are counted up to the first entry that does not grow. Both files are then truncated to those records.
+ *
+ * @return The function returns 0 on success, or -1 if the directory cannot be read.
+ */
+static int recover()
+{
+    DIR *d = opendir(dir);
+    struct dirent *entry;
+    int found = 0;
+    uint64_t last = 0;
+
+    if (d == NULL)
+        return -1;
+
+    while ((entry = readdir(d)) != NULL)
+    {
+        char *end;
+        uint64_t number = strtoull(entry->d_name, &end, 10);
+
+        if (end == entry->d_name + 20 && strcmp(end, ".log") == 0 && (!found || number > last))
+        {
+            last = number;
+            found = 1;
+        }
+    }
+
+    closedir(d);
+
+    if (!found)
+        return 0;
+
+    char path[4096];
+    uint64_t *entries = NULL;
+    size_t entryCount = 0;
+    size_t records = 0;
+    struct stat st;
+
+    segmentPath(path, sizeof(path), last, "idx");
+    int file = open(path, O_RDWR | O_CLOEXEC);
+
+    if (file >= 0 && fstat(file, &st) == 0 && st.st_size > 0)
+    {
+        entryCount = st.st_size / sizeof(uint64_t);
+        entries = malloc(entryCount * sizeof(uint64_t));
+
+        if (entries == NULL || pread(file, entries, entryCount * sizeof(uint64_t), 0) != (ssize_t)(entryCount * sizeof(uint64_t)))
+            entryCount = 0;
+    }
+
+    while (records < entryCount && entries[records] > (records > 0 ? entries[records - 1] : 0))
+        records++;
+
+    if (file >= 0)
+    {
+        if (ftruncate(file, records * sizeof(uint64_t)) < 0)
+            perror("ftruncate");
+
+        close(file);
+    }
+
+    segmentPath(path, sizeof(path), last, "log");
+
+    if (truncate(path, records > 0 ? entries[records - 1] : 0) < 0)
+        perror("truncate");
+
+    free(entries);
+    first = last + records;
+    return 0;
+}
+
+/**
+ * @brief Appends a batch of payloads to the log, one record per record of a payload, or per payload if it has none.
+ *
+ * @param sink The log sink.
+ * @param batch The payloads.
+ * @param n The number of payloads.
+ *
+ * @return The function returns the number of bytes written.
+ */
+static size_t logWrite(sink_t *sink, payload_t *batch, size_t n)
+{
+    struct timespec now;
+    (void)sink;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    log_header_t header = {.flags = LOG_VALID, .timestamp = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec};
+    size_t total = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        payload_t *payload = &batch[i];
+        char *data;
+
+        header.connection = payload->conn;
+
+        if (payload->records != NULL)
+        {
+            for (size_t j = 0; j < payload->recordCount; j++)
+            {
+                header.flags = LOG_VALID | (payload->partial && j + 1 == payload->recordCount ? LOG_PARTIAL : 0);
+                header.length = payload->records[j].length;
+                header.sequence = payload->sequence + j;
+
+                if ((data = logAppend(&header)) != NULL)
+                {
+                    copyRecord(payload, &payload->records[j], data);
+                    logCommit();
+                    total += recordSize(header.length);
+                }
+            }
+
+            continue;
+        }
+
+        header.flags = LOG_VALID;
+        header.length = payload->fileSize;
+        header.sequence = payload->sequence;
+
+        for (chunk_t *chunk = payload->head; chunk != NULL; chunk = chunk->next)
+            header.length += chunk->size;
+
+        if ((data = logAppend(&header)) != NULL)
+        {
+            for (chunk_t *chunk = payload->head; chunk != NULL; chunk = chunk->next)
+            {
+                memcpy(data, chunk->data, chunk->size);
+                data += chunk->size;
+            }
+
+            if (payload->fileSize > 0)
+                readFile(payload->file, data, payload->fileSize);
+
+            logCommit();
+            total += recordSize(header.length);
+        }
+    }
+
+    return total;
+}
+
+/**
+ * @brief Closes the current segment of the log, once the writer has stopped.
+ *
+ * @param sink Unused.
+ *
+ * @return This function does not return a value.
+ */
+static void logClose(sink_t *sink)
+{
+    (void)sink;
+    segmentClose();
+}
+
+static sink_t sink = {.write = logWrite, .close = logClose};
+
+// Opens the segment log in the specified directory.
+
+sink_t *logOpen(const char *logDir, size_t size)
+{
+    dir = logDir;
+    segmentSize = size;
+
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST)
+        return NULL;
+
+    return recover() == 0 ? &sink : NULL;
+}
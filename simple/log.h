@@ -0,0 +1,47 @@
+/**
+ * @file log.h
+ * @brief This file contains the declaration of the segment log sink.
+ *
+ * The segment log sink appends the payloads to a log of segment files instead of printing them. A segment is
+ * preallocated and memory-mapped when it is opened, so appending a record is a copy into the page cache.
+ * Every record starts with a fixed header that tells its length, connection, sequence number and timestamp,
+ * and is padded to 8 bytes. Next to every segment, an index file holds the offset where each record ends,
+ * so record N of a segment starts where record N - 1 ends, and is found without scanning the segment.
+ * The files of a segment are named after the number of its first record in the log, and a segment rolls over
+ * once the next record does not fit in its size. When the log is opened, it continues after the last segment.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sink.h"
+
+#define LOG_VALID 1   // The header belongs to a record. The unused space of a segment is zero.
+#define LOG_PARTIAL 2 // The record was cut short by the end of the connection.
+
+typedef struct log_header_t
+{
+    uint32_t flags;      // LOG_VALID, and LOG_PARTIAL if the record is incomplete.
+    uint32_t reserved;   // Zero.
+    uint64_t length;     // The size of the data after the header.
+    uint64_t connection; // The identifier of the connection in the process.
+    uint64_t sequence;   // The number of the record, or of the segment in streaming mode, in the connection.
+    uint64_t timestamp;  // The time when the record was written, in nanoseconds since the Unix epoch.
+} log_header_t;
+
+/**
+ * @brief Opens the segment log in the specified directory, creating the directory if it does not exist.
+ *
+ * If the last segment was not closed, it is truncated after its last record.
+ * Only one log can be open at a time.
+ *
+ * @param dir The directory.
+ * @param segmentSize The size at which segments roll over.
+ *
+ * @return The function returns the sink, or NULL if the directory cannot be created or read.
+ */
+sink_t *logOpen(const char *dir, size_t segmentSize);
@@ -9,32 +9,278 @@
  * @date July 7, 2024
  */
 
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <sys/resource.h>
+#include "cpu.h"
+#include "options.h"
 #include "server.h"
 
-static unsigned getPort(int argc, char *argv[])
+#define MAX_THREADS 1024 // The largest number of event loops.
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [--threads N] [--shared-listener] [--accept-budget N] [--acceptor round-robin|least-loaded] [--edge-triggered] [--read-budget BYTES] [--loop-budget BYTES] [--output-queue N] [--stream] [--flush-bytes BYTES] [--flush-millis MS] [--idle-timeout MS] [--lifetime MS] [--event-batch N] [--busy-poll USEC] [--socket-busy-poll USEC] [--socket-rcvlowat BYTES] [--cpus LIST] [--metrics-port PORT] [--frame newline|u32|varint|delimiter:C] [--max-record BYTES] [--memory-budget BYTES] [--spill-dir DIR] [--high-watermark BYTES] [--low-watermark BYTES] [--log-dir DIR] [--segment-size BYTES] <port>\n", program);
+    exit(1);
+}
+
+/**
+ * @brief Parses the numeric value of an option, and exits with an error message if it is not valid.
+ *
+ * The value must be a decimal number, with no sign or trailing characters, between the given bounds.
+ *
+ * @param text The value as given on the command line.
+ * @param min The smallest value allowed.
+ * @param max The largest value allowed.
+ * @param error The message printed if the value is not valid.
+ *
+ * @return The function returns the value.
+ */
+static unsigned long long parseNumber(const char *text, unsigned long long min, unsigned long long max, const char *error)
 {
-    if (argc != 2)
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 10);
+
+    if (*text < '0' || *text > '9' || *end != '\0' || errno == ERANGE || value < min || value > max)
     {
-        fprintf(stderr, "Usage: %s <port>\n", argv[0]);
+        fprintf(stderr, "%s\n", error);
         exit(1);
     }
 
-    unsigned port = strtoul(argv[1], NULL, 10);
+    return value;
+}
+
+static options_t getOptions(int argc, char *argv[])
+{
+    static const struct option longOptions[] = {
+        {"threads", required_argument, NULL, 't'},
+        {"shared-listener", no_argument, NULL, 's'},
+        {"accept-budget", required_argument, NULL, 'a'},
+        {"acceptor", required_argument, NULL, 'A'},
+        {"edge-triggered", no_argument, NULL, 'e'},
+        {"read-budget", required_argument, NULL, 'b'},
+        {"loop-budget", required_argument, NULL, 'u'},
+        {"output-queue", required_argument, NULL, 'q'},
+        {"stream", no_argument, NULL, 'm'},
+        {"flush-bytes", required_argument, NULL, 'l'},
+        {"flush-millis", required_argument, NULL, 'w'},
+        {"idle-timeout", required_argument, NULL, 'i'},
+        {"lifetime", required_argument, NULL, 'L'},
+        {"event-batch", required_argument, NULL, 'E'},
+        {"busy-poll", required_argument, NULL, 'B'},
+        {"socket-busy-poll", required_argument, NULL, 'S'},
+        {"socket-rcvlowat", required_argument, NULL, 'R'},
+        {"cpus", required_argument, NULL, 'c'},
+        {"metrics-port", required_argument, NULL, 'M'},
+        {"frame", required_argument, NULL, 'f'},
+        {"max-record", required_argument, NULL, 'r'},
+        {"memory-budget", required_argument, NULL, 'g'},
+        {"spill-dir", required_argument, NULL, 'd'},
+        {"high-watermark", required_argument, NULL, 'H'},
+        {"low-watermark", required_argument, NULL, 'W'},
+        {"log-dir", required_argument, NULL, 'o'},
+        {"segment-size", required_argument, NULL, 'Z'},
+        {NULL, 0, NULL, 0},
+    };
+
+    options_t options = {.port = 0, .threads = 1, .edgeTriggered = 0, .readBudget = 65536, .loopBudget = 1048576, .sharedListener = 0, .acceptBudget = 64, .acceptor = INBOX_NONE, .outputQueue = 1024, .stream = 0, .flushBytes = 65536, .flushMillis = 1000, .idleTimeout = 0, .lifetime = 0, .eventBatch = 1024, .busyPoll = 0, .socketBusyPoll = 0, .socketRcvLowat = 0, .cpus = NULL, .cpuCount = 0, .metricsPort = 0, .frame = FRAME_NONE, .delimiter = '\n', .maxRecord = 16777216, .memoryBudget = 0, .spillDir = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp", .highWatermark = 0, .lowWatermark = 0, .logDir = NULL, .segmentSize = 67108864};
+    int opt;
 
-    if (port < 1 || port > 65535)
+    while ((opt = getopt_long(argc, argv, "t:sa:A:eb:u:q:ml:w:i:L:E:B:S:R:c:M:f:r:g:d:H:W:o:Z:", longOptions, NULL)) != -1)
     {
-        fprintf(stderr, "Invalid port number. Please enter a value between 1 and 65535.\n");
+        switch (opt)
+        {
+        case 't':
+            options.threads = parseNumber(optarg, 1, MAX_THREADS, "Invalid number of threads.");
+            break;
+
+        case 's':
+            options.sharedListener = 1;
+            break;
+
+        case 'a':
+            options.acceptBudget = parseNumber(optarg, 1, UINT_MAX, "Invalid accept budget.");
+            break;
+
+        case 'A':
+            if (strcmp(optarg, "round-robin") == 0)
+                options.acceptor = INBOX_ROUND_ROBIN;
+            else if (strcmp(optarg, "least-loaded") == 0)
+                options.acceptor = INBOX_LEAST_LOADED;
+            else
+            {
+                fprintf(stderr, "Invalid acceptor policy.\n");
+                exit(1);
+            }
+
+            break;
+
+        case 'e':
+            options.edgeTriggered = 1;
+            break;
+
+        case 'b':
+            options.readBudget = parseNumber(optarg, 1, SIZE_MAX, "Invalid read budget.");
+            break;
+
+        case 'u':
+            options.loopBudget = parseNumber(optarg, 0, SIZE_MAX, "Invalid loop budget.");
+            break;
+
+        case 'q':
+            options.outputQueue = parseNumber(optarg, 1, SIZE_MAX, "Invalid output queue size.");
+            break;
+
+        case 'm':
+            options.stream = 1;
+            break;
+
+        case 'l':
+            options.flushBytes = parseNumber(optarg, 1, SIZE_MAX, "Invalid flush size.");
+            break;
+
+        case 'w':
+            options.flushMillis = parseNumber(optarg, 1, INT_MAX, "Invalid flush age.");
+            break;
+
+        case 'i':
+            options.idleTimeout = parseNumber(optarg, 0, UINT_MAX, "Invalid idle timeout.");
+            break;
+
+        case 'L':
+            options.lifetime = parseNumber(optarg, 0, UINT_MAX, "Invalid lifetime.");
+            break;
+
+        case 'E':
+            options.eventBatch = parseNumber(optarg, 1, INT_MAX, "Invalid event batch size.");
+            break;
+
+        case 'B':
+            options.busyPoll = parseNumber(optarg, 0, INT_MAX, "Invalid busy-poll time.");
+            break;
+
+        case 'S':
+            options.socketBusyPoll = parseNumber(optarg, 0, INT_MAX, "Invalid socket busy-poll time.");
+            break;
+
+        case 'R':
+            options.socketRcvLowat = parseNumber(optarg, 1, INT_MAX, "Invalid socket receive low-water mark.");
+            break;
+
+        case 'c':
+        {
+            int count = cpuParse(optarg, &options.cpus);
+
+            if (count < 1)
+            {
+                fprintf(stderr, "Invalid list of CPUs.\n");
+                exit(1);
+            }
+
+            options.cpuCount = count;
+            break;
+        }
+
+        case 'M':
+            options.metricsPort = parseNumber(optarg, 1, 65535, "Invalid metrics port.");
+            break;
+
+        case 'f':
+            if (frameParse(optarg, &options.frame, &options.delimiter) < 0)
+            {
+                fprintf(stderr, "Invalid framing mode.\n");
+                exit(1);
+            }
+
+            break;
+
+        case 'r':
+            options.maxRecord = parseNumber(optarg, 1, SIZE_MAX, "Invalid maximum record size.");
+            break;
+
+        case 'g':
+            options.memoryBudget = parseNumber(optarg, 0, SIZE_MAX, "Invalid memory budget.");
+            break;
+
+        case 'd':
+            options.spillDir = optarg;
+            break;
+
+        case 'H':
+            options.highWatermark = parseNumber(optarg, 0, SIZE_MAX, "Invalid high watermark.");
+            break;
+
+        case 'W':
+            options.lowWatermark = parseNumber(optarg, 0, SIZE_MAX, "Invalid low watermark.");
+            break;
+
+        case 'o':
+            options.logDir = optarg;
+            break;
+
+        case 'Z':
+            options.segmentSize = parseNumber(optarg, 4096, SIZE_MAX, "Invalid segment size.");
+            break;
+
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (argc - optind != 1)
+        usage(argv[0]);
+
+    if (options.stream && options.frame != FRAME_NONE)
+    {
+        fprintf(stderr, "Streaming and framing modes are exclusive.\n");
         exit(1);
     }
 
-    return port;
+    if (options.sharedListener && options.acceptor != INBOX_NONE)
+    {
+        fprintf(stderr, "The shared listener and the acceptor thread are exclusive.\n");
+        exit(1);
+    }
+
+    if (options.lowWatermark == 0)
+        options.lowWatermark = options.highWatermark / 2;
+    else if (options.lowWatermark >= options.highWatermark)
+    {
+        fprintf(stderr, "The low watermark must be below the high watermark.\n");
+        exit(1);
+    }
+
+    options.port = parseNumber(argv[optind], 1, 65535, "Invalid port number. Please enter a value between 1 and 65535.");
+
+    return options;
+}
+
+/**
+ * @brief Raises the soft limit of open files to the hard limit, so that the number of connections is bounded by the system only.
+ *
+ * @return This function does not return a value.
+ */
+static void raiseFileLimit()
+{
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
 }
 
 int main(int argc, char *argv[])
 {
-    unsigned port = getPort(argc, argv);
-    serve(port);
+    options_t options = getOptions(argc, argv);
+    raiseFileLimit();
+    serve(&options);
     return 0;
 }
@@ -0,0 +1,375 @@
+/**
+ * @file metrics.c
+ * @brief This file contains the implementation of the metrics registry and its Prometheus text rendering.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include "chunk.h"
+#include "metrics.h"
+#include "writer.h"
+
+#define ADMIN_BACKLOG 16
+#define ADMIN_TIMEOUT_SECONDS 1
+
+#define die(msg)     \
+    {                \
+        perror(msg); \
+        abort();     \
+    }
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static metrics_t *registry;
+static unsigned loops;
+static histogram_t output;
+
+/**
+ * @brief Writes a counter or a gauge of every event loop.
+ *
+ * @param out The output stream.
+ * @param name The name of the metric.
+ * @param help The description of the metric.
+ * @param offset The offset of the value in metrics_t.
+ * @param type The type of the metric, "counter" or "gauge".
+ *
+ * @return This function does not return a value.
+ */
+static void renderValue(FILE *out, const char *name, const char *help, size_t offset, const char *type)
+{
+    fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+
+    for (metrics_t *m = registry; m != NULL; m = m->next)
+        fprintf(out, "%s{thread=\"%u\"} %llu\n", name, m->id, (unsigned long long)atomic_load_explicit((_Atomic uint64_t *)((char *)m + offset), memory_order_relaxed));
+}
+
+/**
+ * @brief Writes a counter of every event loop.
+ *
+ * @param out The output stream.
+ * @param name The name of the metric.
+ * @param help The description of the metric.
+ * @param offset The offset of the counter in metrics_t.
+ *
+ * @return This function does not return a value.
+ */
+static void renderCounter(FILE *out, const char *name, const char *help, size_t offset)
+{
+    renderValue(out, name, help, offset, "counter");
+}
+
+/**
+ * @brief Writes the buckets of a histogram.
+ *
+ * The buckets are merged at every power of two, so the bounds are 0, 1, 3, 7, 15 and so on,
+ * up to the highest one that holds a value.
+ *
+ * @param out The output stream.
+ * @param name The name of the metric.
+ * @param labels The labels of the histogram, including the trailing comma, or an empty string.
+ * @param histogram The histogram.
+ *
+ * @return This function does not return a value.
+ */
+static void renderBuckets(FILE *out, const char *name, const char *labels, histogram_t *histogram)
+{
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total = 0;
+    uint64_t cumulative = 0;
+    size_t last = 0;
+    char bare[64] = "";
+
+    // The sum and the count take the same labels without the bucket bound.
+    if (strlen(labels) > 0)
+        snprintf(bare, sizeof(bare), "{%.*s}", (int)strlen(labels) - 1, labels);
+
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        counts[i] = atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+        total += counts[i];
+
+        if (counts[i] > 0)
+            last = i;
+    }
+
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        cumulative += counts[i];
+
+        // Sub-bucket 3 of each power ends right before the next power of two.
+        if (i < 2 || (i & HISTOGRAM_SUB_MASK) == HISTOGRAM_SUB_MASK)
+        {
+            unsigned long long bound = i < HISTOGRAM_SUB_COUNT ? i : (2ULL << ((i >> HISTOGRAM_SUB_BITS) + 1)) - 1;
+            fprintf(out, "%s_bucket{%sle=\"%llu\"} %llu\n", name, labels, bound, (unsigned long long)cumulative);
+
+            if (i >= last && i > 0)
+                break;
+        }
+    }
+
+    fprintf(out, "%s_bucket{%sle=\"+Inf\"} %llu\n", name, labels, (unsigned long long)total);
+    fprintf(out, "%s_sum%s %llu\n", name, bare, (unsigned long long)atomic_load_explicit(&histogram->sum, memory_order_relaxed));
+    fprintf(out, "%s_count%s %llu\n", name, bare, (unsigned long long)total);
+}
+
+/**
+ * @brief Writes a histogram of every event loop.
+ *
+ * @param out The output stream.
+ * @param name The name of the metric.
+ * @param help The description of the metric.
+ * @param offset The offset of the histogram in metrics_t.
+ *
+ * @return This function does not return a value.
+ */
+static void renderHistogram(FILE *out, const char *name, const char *help, size_t offset)
+{
+    fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+
+    for (metrics_t *m = registry; m != NULL; m = m->next)
+    {
+        char labels[32];
+        snprintf(labels, sizeof(labels), "thread=\"%u\",", m->id);
+        renderBuckets(out, name, labels, (histogram_t *)((char *)m + offset));
+    }
+}
+
+/**
+ * @brief Writes all the metrics in the Prometheus text format.
+ *
+ * @param out The output stream.
+ *
+ * @return This function does not return a value.
+ */
+static void render(FILE *out)
+{
+    writer_stats_t stats;
+    writerStats(&stats);
+
+    pthread_mutex_lock(&mutex);
+
+    renderCounter(out, "server_connections_accepted_total", "Connections accepted.", offsetof(metrics_t, accepted));
+    renderCounter(out, "server_connections_closed_total", "Connections closed.", offsetof(metrics_t, closed));
+    fprintf(out, "# HELP server_connections_active Connections open.\n# TYPE server_connections_active gauge\n");
+
+    for (metrics_t *m = registry; m != NULL; m = m->next)
+        fprintf(out, "server_connections_active{thread=\"%u\"} %llu\n", m->id, (unsigned long long)(atomic_load_explicit(&m->accepted, memory_order_relaxed) - atomic_load_explicit(&m->closed, memory_order_relaxed)));
+
+    renderCounter(out, "server_connections_remote_cpu_total", "Connections accepted by a pinned loop whose packets arrive on another CPU.", offsetof(metrics_t, remoteCpu));
+    renderCounter(out, "server_received_bytes_total", "Bytes received from the connections.", offsetof(metrics_t, bytesReceived));
+    renderCounter(out, "server_reads_total", "Reads that returned data.", offsetof(metrics_t, reads));
+    renderCounter(out, "server_records_total", "Records handed over in framing mode.", offsetof(metrics_t, records));
+    renderValue(out, "server_resident_bytes", "Bytes held in memory by the buffers under the memory budget.", offsetof(metrics_t, residentBytes), "gauge");
+    renderCounter(out, "server_spills_total", "Buffers moved to spill files.", offsetof(metrics_t, spills));
+    renderCounter(out, "server_spilled_bytes_total", "Bytes written to spill files.", offsetof(metrics_t, spilledBytes));
+    fprintf(out, "# HELP server_memory_bytes Memory held by the data received and not written yet.\n# TYPE server_memory_bytes gauge\n");
+
+    for (metrics_t *m = registry; m != NULL; m = m->next)
+    {
+        const chunk_pool_t *pool = atomic_load_explicit(&m->pool, memory_order_acquire);
+        fprintf(out, "server_memory_bytes{thread=\"%u\"} %zu\n", m->id, pool != NULL ? chunkUsed(pool) : 0);
+    }
+
+    renderValue(out, "server_connections_paused", "Connections not read because the memory is over the high watermark.", offsetof(metrics_t, paused), "gauge");
+    renderCounter(out, "server_read_pauses_total", "Times a connection stopped being read because of the high watermark.", offsetof(metrics_t, pauses));
+    renderCounter(out, "server_poll_waits_total", "Waits for events.", offsetof(metrics_t, waits));
+    renderCounter(out, "server_poll_events_total", "Events returned by the waits.", offsetof(metrics_t, events));
+    renderCounter(out, "server_poll_spins_total", "Non-blocking waits made while busy polling.", offsetof(metrics_t, spins));
+    renderCounter(out, "server_poll_spin_wakeups_total", "Waits that found events while busy polling.", offsetof(metrics_t, spinWakeups));
+    renderCounter(out, "server_poll_sleeps_total", "Waits that blocked in the kernel.", offsetof(metrics_t, sleeps));
+    renderCounter(out, "server_poll_spin_nanoseconds_total", "Time spent busy polling.", offsetof(metrics_t, spinNanos));
+    fprintf(out, "# HELP server_poll_spin_ratio Fraction of the wakeups served by busy polling instead of sleeping.\n# TYPE server_poll_spin_ratio gauge\n");
+
+    for (metrics_t *m = registry; m != NULL; m = m->next)
+    {
+        uint64_t spun = atomic_load_explicit(&m->spinWakeups, memory_order_relaxed);
+        uint64_t slept = atomic_load_explicit(&m->sleeps, memory_order_relaxed);
+        fprintf(out, "server_poll_spin_ratio{thread=\"%u\"} %g\n", m->id, spun + slept > 0 ? (double)spun / (spun + slept) : 0.0);
+    }
+
+    renderCounter(out, "server_loop_budget_stops_total", "Iterations that left deferred sockets for the next one because the loop budget ran out.", offsetof(metrics_t, budgetStops));
+    renderHistogram(out, "server_poll_events_per_wait", "Events returned by each wait.", offsetof(metrics_t, eventsPerWait));
+    renderHistogram(out, "server_loop_iteration_nanoseconds", "Time spent in each iteration of the event loop, excluding the wait.", offsetof(metrics_t, loopNanos));
+    renderHistogram(out, "server_read_bytes", "Bytes returned by each read.", offsetof(metrics_t, readBytes));
+
+    pthread_mutex_unlock(&mutex);
+
+    fprintf(out, "# HELP server_output_write_nanoseconds Time spent writing each batch of output.\n# TYPE server_output_write_nanoseconds histogram\n");
+    renderBuckets(out, "server_output_write_nanoseconds", "", &output);
+    fprintf(out, "# HELP server_output_queue_depth Payloads waiting for the output writer.\n# TYPE server_output_queue_depth gauge\nserver_output_queue_depth %zu\n", stats.depth);
+    fprintf(out, "# HELP server_output_queue_max_depth Highest number of payloads waiting for the output writer.\n# TYPE server_output_queue_max_depth gauge\nserver_output_queue_max_depth %zu\n", stats.maxDepth);
+    fprintf(out, "# HELP server_output_held Payloads held by the loops because the output queue was full.\n# TYPE server_output_held gauge\nserver_output_held %zu\n", stats.overflow);
+    fprintf(out, "# HELP server_output_payloads_total Payloads written.\n# TYPE server_output_payloads_total counter\nserver_output_payloads_total %lu\n", stats.payloads);
+    fprintf(out, "# HELP server_output_bytes_total Bytes written.\n# TYPE server_output_bytes_total counter\nserver_output_bytes_total %lu\n", stats.bytes);
+    fprintf(out, "# HELP server_output_batches_total Batches written.\n# TYPE server_output_batches_total counter\nserver_output_batches_total %lu\n", stats.batches);
+    fprintf(out, "# HELP server_output_backpressure_total Payloads that found the output queue full.\n# TYPE server_output_backpressure_total counter\nserver_output_backpressure_total %lu\n", stats.backpressure);
+}
+
+/**
+ * @brief Writes the metrics to the standard error on every SIGUSR1.
+ *
+ * @param arg Unused.
+ *
+ * @return This function does not return.
+ */
+static void *signalRun(void *arg)
+{
+    sigset_t set;
+    (void)arg;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+
+    while (1)
+    {
+        int sig;
+
+        if (sigwait(&set, &sig) == 0)
+        {
+            render(stderr);
+            fflush(stderr);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Answers every connection to the admin port with the metrics.
+ *
+ * The request is read but not parsed: any request gets the metrics in an HTTP/1.0 response.
+ *
+ * @param arg The listening socket.
+ *
+ * @return This function does not return.
+ */
+static void *adminRun(void *arg)
+{
+    int serverSock = (int)(intptr_t)arg;
+
+    while (1)
+    {
+        int sock = accept(serverSock, NULL, NULL);
+
+        if (sock < 0)
+            continue;
+
+        struct timeval timeout = {ADMIN_TIMEOUT_SECONDS, 0};
+        char request[1024];
+        char *text = NULL;
+        size_t length = 0;
+
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        recv(sock, request, sizeof(request), 0);
+
+        FILE *out = open_memstream(&text, &length);
+
+        if (out != NULL)
+        {
+            render(out);
+            fclose(out);
+
+            char header[128];
+            int headerLength = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n", length);
+            send(sock, header, headerLength, MSG_NOSIGNAL);
+            send(sock, text, length, MSG_NOSIGNAL);
+            free(text);
+        }
+
+        close(sock);
+    }
+
+    return NULL;
+}
+
+// Gets the current time of the monotonic clock with nanosecond resolution.
+
+uint64_t metricsNanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Creates the metrics of the calling event loop and adds them to the registry.
+
+metrics_t *metricsRegister()
+{
+    metrics_t *metrics = calloc(1, sizeof(metrics_t));
+
+    if (metrics == NULL)
+        die("calloc");
+
+    pthread_mutex_lock(&mutex);
+    metrics->id = loops++;
+
+    // Keep the registry sorted by thread, so the output is stable.
+    metrics_t **link = &registry;
+
+    while (*link != NULL)
+        link = &(*link)->next;
+
+    *link = metrics;
+    pthread_mutex_unlock(&mutex);
+
+    return metrics;
+}
+
+// Records the time spent writing a batch of output.
+
+void metricsOutput(uint64_t nanos)
+{
+    histogramRecord(&output, nanos);
+}
+
+// Starts serving the metrics.
+
+void metricsStart(unsigned port)
+{
+    pthread_t thread;
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+
+    if (pthread_sigmask(SIG_BLOCK, &set, NULL) != 0)
+        die("pthread_sigmask");
+
+    if (pthread_create(&thread, NULL, signalRun, NULL) != 0)
+        die("pthread_create");
+
+    if (port == 0)
+        return;
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    int enable = 1;
+    struct sockaddr_in addr;
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = INADDR_ANY;
+
+    if (sock < 0)
+        die("socket");
+
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) < 0)
+        die("setsockopt: SO_REUSEADDR");
+
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        die("bind: metrics port");
+
+    if (listen(sock, ADMIN_BACKLOG) < 0)
+        die("listen");
+
+    if (pthread_create(&thread, NULL, adminRun, (void *)(intptr_t)sock) != 0)
+        die("pthread_create");
+}
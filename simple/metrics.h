@@ -0,0 +1,134 @@
+/**
+ * @file metrics.h
+ * @brief This file contains the declaration of the metrics_t and histogram_t data structures and related functions.
+ *
+ * Every event loop registers its own metrics, which only that loop updates, so the hot path needs neither locks
+ * nor atomic read-modify-write instructions: the counters are updated with relaxed loads and stores, which other
+ * threads may read at any time. Histograms use logarithmic buckets with four sub-buckets per power of two, so any
+ * recorded value is known within 25%.
+ *
+ * The metrics are rendered in the Prometheus text format, served on an optional admin port and written to the
+ * standard error when the process receives SIGUSR1.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define HISTOGRAM_SUB_BITS 2
+#define HISTOGRAM_SUB_COUNT (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_SUB_MASK (HISTOGRAM_SUB_COUNT - 1)
+#define HISTOGRAM_BUCKETS (64 << HISTOGRAM_SUB_BITS)
+
+typedef struct histogram_t
+{
+    _Atomic uint64_t buckets[HISTOGRAM_BUCKETS];
+    _Atomic uint64_t sum;
+} histogram_t;
+
+typedef struct metrics_t
+{
+    _Atomic uint64_t accepted;      // Connections accepted.
+    _Atomic uint64_t closed;        // Connections closed.
+    _Atomic uint64_t remoteCpu;     // Connections accepted by a pinned loop whose packets arrive on another CPU.
+    _Atomic uint64_t bytesReceived; // Bytes received from the connections.
+    _Atomic uint64_t reads;         // Reads that returned data.
+    _Atomic uint64_t records;       // Records handed over in framing mode.
+    _Atomic uint64_t residentBytes; // Bytes held in memory by the buffers under the memory budget.
+    _Atomic uint64_t spills;        // Buffers moved to spill files.
+    _Atomic uint64_t spilledBytes;  // Bytes written to spill files.
+    _Atomic uint64_t paused;        // Connections not read because the memory is over the high watermark.
+    _Atomic uint64_t pauses;        // Times a connection stopped being read because of the high watermark.
+    _Atomic uint64_t waits;         // Calls to poll_wait().
+    _Atomic uint64_t events;        // Events returned by poll_wait().
+    _Atomic uint64_t spins;         // Non-blocking waits made while busy polling.
+    _Atomic uint64_t spinWakeups;   // Waits that found events while busy polling.
+    _Atomic uint64_t sleeps;        // Waits that blocked in the kernel.
+    _Atomic uint64_t spinNanos;     // Time spent busy polling.
+    _Atomic uint64_t budgetStops;   // Iterations that left deferred sockets for the next one because the loop budget ran out.
+    histogram_t eventsPerWait;
+    histogram_t loopNanos;          // Time spent in each iteration of the loop, excluding the wait.
+    histogram_t readBytes;          // Bytes returned by each read.
+    _Atomic(const struct chunk_pool_t *) pool; // The chunk pool of the loop, whose memory in use is reported, or NULL.
+    unsigned id;
+    struct metrics_t *next;
+} metrics_t;
+
+/**
+ * @brief Adds a value to a counter owned by the calling thread.
+ *
+ * @param counter The counter.
+ * @param value The value to add.
+ *
+ * @return This function does not return a value.
+ */
+static inline void metricsAdd(_Atomic uint64_t *counter, uint64_t value)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+/**
+ * @brief Records a value in a histogram owned by the calling thread.
+ *
+ * @param histogram The histogram.
+ * @param value The value to record.
+ *
+ * @return This function does not return a value.
+ */
+static inline void histogramRecord(histogram_t *histogram, uint64_t value)
+{
+    size_t index = value;
+
+    if (value >= HISTOGRAM_SUB_COUNT)
+    {
+        int power = 63 - __builtin_clzll(value);
+        size_t sub = (value >> (power - HISTOGRAM_SUB_BITS)) & HISTOGRAM_SUB_MASK;
+        index = ((power - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS) + sub;
+    }
+
+    metricsAdd(&histogram->buckets[index], 1);
+    metricsAdd(&histogram->sum, value);
+}
+
+/**
+ * @brief Gets the current time of the monotonic clock with nanosecond resolution.
+ *
+ * @return The function returns the time in nanoseconds.
+ */
+uint64_t metricsNanos();
+
+/**
+ * @brief Creates the metrics of the calling event loop and adds them to the registry.
+ *
+ * @return The function returns the metrics, which live until the process exits.
+ */
+metrics_t *metricsRegister();
+
+/**
+ * @brief Records the time spent writing a batch of output.
+ *
+ * This function must only be called from the output writer thread.
+ *
+ * @param nanos The time, in nanoseconds.
+ *
+ * @return This function does not return a value.
+ */
+void metricsOutput(uint64_t nanos);
+
+/**
+ * @brief Starts serving the metrics.
+ *
+ * This function blocks SIGUSR1 in the calling thread, so it must be called before any other thread is created,
+ * and starts a thread that writes the metrics to the standard error on every SIGUSR1. If a port is given,
+ * it also starts a thread that answers every connection to that port with the metrics in an HTTP response.
+ *
+ * @param port The admin port, or 0 to serve the metrics only on SIGUSR1.
+ *
+ * @return This function does not return a value.
+ */
+void metricsStart(unsigned port);
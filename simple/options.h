@@ -0,0 +1,49 @@
+/**
+ * @file options.h
+ * @brief This file contains the declaration of the options_t data structure.
+ *
+ * The options_t data structure holds the settings given on the command line, which are shared by all the event loops.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include "frame.h"
+#include "inbox.h"
+
+typedef struct options_t
+{
+    unsigned port;    // The port number on which the server will listen for incoming connections.
+    unsigned threads; // The number of event loops, each one running on its own thread with its own listening socket.
+    int edgeTriggered; // Whether client sockets are registered edge-triggered and drained until EAGAIN on every wakeup.
+    size_t readBudget; // The maximum number of bytes read from a socket per wakeup in edge-triggered mode.
+    size_t loopBudget; // The bytes read in an iteration of a loop before the deferred sockets wait for the next one, or 0 for no limit.
+    int sharedListener; // Whether all the event loops share a single listening socket, registered as exclusive.
+    unsigned acceptBudget; // The maximum number of connections accepted per wakeup of the listening socket.
+    inbox_policy_t acceptor; // How an acceptor thread hands the connections over to the loops, or INBOX_NONE to let every loop accept its own.
+    size_t outputQueue; // The maximum number of payloads waiting for the output writer.
+    int stream;         // Whether the data of a connection is emitted in segments while it is open, instead of when it closes.
+    size_t flushBytes;  // In streaming mode, the number of buffered bytes of a connection that triggers a segment.
+    int flushMillis;    // In streaming mode, the age in milliseconds of the oldest buffered byte of a connection that triggers a segment.
+    unsigned idleTimeout; // The time in milliseconds a connection may go without receiving data before it is shut down, or 0 for no limit.
+    unsigned lifetime;    // The time in milliseconds a connection may stay open in total before it is shut down, or 0 for no limit.
+    int eventBatch;       // The maximum number of events returned by each wait of an event loop.
+    unsigned busyPoll;       // The time in microseconds an event loop spins on its poll set before blocking, or 0 to block right away.
+    unsigned socketBusyPoll; // The SO_BUSY_POLL time in microseconds of the accepted sockets, or 0 to leave it unset.
+    int socketRcvLowat;      // The SO_RCVLOWAT of the accepted sockets in bytes, or 0 to leave it unset.
+    int *cpus;            // The CPUs to which the event loops are pinned in turn, or NULL to leave them unpinned.
+    unsigned cpuCount;    // The number of CPUs in the list.
+    unsigned metricsPort; // The port on which the metrics are served over HTTP, or 0 to only dump them on SIGUSR1.
+    frame_mode_t frame;   // How the data of a connection is split into records, which are emitted as soon as they are complete.
+    char delimiter;       // In delimiter mode, the byte that ends every record.
+    size_t maxRecord;     // The maximum size of a record. Connections that send a larger one are closed.
+    size_t memoryBudget;  // The bytes that the buffers may hold in memory in total before the largest ones spill to disk, or 0 for no limit.
+    const char *spillDir; // The directory where the spill files are created.
+    size_t highWatermark; // The memory held by the received data above which connections stop being read, or 0 for no limit.
+    size_t lowWatermark;  // The memory held by the received data below which the connections that stopped are read again.
+    const char *logDir;   // The directory of the segment log where the payloads are written instead of the standard output, or NULL to print them.
+    size_t segmentSize;   // The size at which the segments of the log roll over.
+} options_t;
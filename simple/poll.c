@@ -0,0 +1,72 @@
+/**
+ * @file poll.c
+ * @brief This file contains the busy-poll logic shared by all the poll backends.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#include <stdint.h>
+#include <time.h>
+#include "poll.h"
+
+/**
+ * @brief Gets the current time of the monotonic clock.
+ *
+ * @return The function returns the time in nanoseconds.
+ */
+static uint64_t nanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Sets how long poll_wait() spins before blocking.
+
+void poll_spin(poll_t * poll, unsigned micros)
+{
+    poll->spinNanos = micros * 1000UL;
+}
+
+// Waits for events on the poll set with the specified timeout.
+
+int poll_wait(poll_t * poll, int timeout)
+{
+    if (timeout == 0)
+        return poll_fetch(poll, 0);
+
+    if (poll->spinNanos > 0)
+    {
+        uint64_t start = nanos();
+        uint64_t elapsed = 0;
+
+        do
+        {
+            int n = poll_fetch(poll, 0);
+            poll->stats.spins++;
+
+            if (n != 0)
+            {
+                poll->stats.spinNanos += nanos() - start;
+                poll->stats.spinWakeups += n > 0;
+                return n;
+            }
+
+            elapsed = nanos() - start;
+        } while (elapsed < poll->spinNanos && (timeout < 0 || elapsed < timeout * 1000000ULL));
+
+        poll->stats.spinNanos += elapsed;
+
+        if (timeout >= 0)
+        {
+            if (elapsed >= timeout * 1000000ULL)
+                return 0;
+
+            timeout -= elapsed / 1000000;
+        }
+    }
+
+    poll->stats.sleeps++;
+    return poll_fetch(poll, timeout);
+}
@@ -12,19 +12,39 @@
 
 #pragma once
 
+// Flag for poll_add(): report the file descriptor only when it becomes ready, not while it stays ready.
+#define POLL_EDGE 1
+
+// Flag for poll_add(): when several poll sets wait on the file descriptor, wake up only one of them per event.
+#define POLL_EXCLUSIVE 2
+
+// Flag for poll_modify(): stop reporting that the file descriptor is readable, until it is modified without this flag.
+#define POLL_PAUSED 4
+
+typedef struct poll_stats_t
+{
+    unsigned long spins;       // Non-blocking waits made while spinning.
+    unsigned long spinWakeups; // Waits that found events while spinning.
+    unsigned long sleeps;      // Waits that blocked in the kernel.
+    unsigned long spinNanos;   // Time spent spinning, in nanoseconds.
+} poll_stats_t;
+
 typedef struct poll_t
 {
     int fd;
     int size;
     void * events;
+    unsigned long spinNanos; // How long poll_wait() spins before blocking, in nanoseconds.
+    poll_stats_t stats;
 } poll_t;
 
 /**
  * @brief Initializes a poll set with the specified size.
  *
  * This function allocates memory for the poll set and initializes its internal data structures.
+ * Busy polling is disabled. The size only bounds the events returned by each wait: any number of file descriptors can be added.
  *
- * @param size The maximum number of file descriptors that can be added to the poll set.
+ * @param size The maximum number of events returned by each call to poll_wait().
  *
  * @return The function returns a pointer to the initialized poll set.
  */
@@ -45,19 +65,52 @@ void poll_destroy(poll_t * poll);
  * @brief Adds the specified file descriptor to the poll set.
  *
  * This function adds the specified file descriptor to the poll set for monitoring I/O events.
+ * By default, events are level-triggered. With POLL_EDGE, the caller must drain the file descriptor
+ * until it would block before waiting for it again.
  *
  * @param poll The poll set to which the file descriptor should be added.
  * @param fd The file descriptor to be added to the poll set.
+ * @param flags A combination of the POLL_ flags, or 0.
+ *
+ * @return This function does not return a value.
+ */
+void poll_add(poll_t * poll, int fd, int flags);
+
+/**
+ * @brief Changes the events reported for a file descriptor already in the poll set.
+ *
+ * With POLL_PAUSED, the file descriptor is no longer reported as readable, so the data that arrives stays in the kernel,
+ * and TCP flow control eventually stops the sender. Errors and hang-ups may still be reported.
+ * The flags replace the ones given to poll_add(), except POLL_EXCLUSIVE, which cannot be changed.
+ *
+ * @param poll The poll set.
+ * @param fd The file descriptor.
+ * @param flags A combination of the POLL_ flags other than POLL_EXCLUSIVE, or 0.
  *
  * @return This function does not return a value.
  */
-void poll_add(poll_t * poll, int fd);
+void poll_modify(poll_t * poll, int fd, int flags);
+
+/**
+ * @brief Sets how long poll_wait() spins before blocking.
+ *
+ * While spinning, the poll set is checked without blocking, so an event that arrives in the meantime is picked up
+ * without the cost of putting the thread to sleep and waking it up, at the price of the CPU time spent spinning.
+ *
+ * @param poll The poll set.
+ * @param micros The spin time, in microseconds, or 0 to block right away.
+ *
+ * @return This function does not return a value.
+ */
+void poll_spin(poll_t * poll, unsigned micros);
 
 /**
  * @brief Waits for events on the poll set with the specified timeout.
  *
  * This function waits for events on the poll set for the specified timeout period.
  * If an event occurs on any of the file descriptors in the poll set, the function returns the number of events.
+ * If a spin time is set, the poll set is checked without blocking until events arrive, the spin time passes
+ * or the timeout expires, and only then does the function block for the rest of the timeout.
  *
  * @param poll The poll set to wait for events.
  * @param timeout The maximum time to wait for events, in milliseconds. If timeout is negative, the function will block indefinitely.
@@ -66,6 +119,16 @@ void poll_add(poll_t * poll, int fd);
  */
 int poll_wait(poll_t * poll, int timeout);
 
+/**
+ * @brief Waits for events once, without spinning. Every backend implements this function, and poll_wait() builds on it.
+ *
+ * @param poll The poll set to wait for events.
+ * @param timeout The maximum time to wait for events, in milliseconds. If timeout is negative, the function will block indefinitely.
+ *
+ * @return The function returns the number of events that occurred on the poll set.
+ */
+int poll_fetch(poll_t * poll, int timeout);
+
 /**
  * @brief Retrieves the file descriptor associated with the specified event index.
  *
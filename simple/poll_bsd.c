@@ -41,16 +41,25 @@ void poll_destroy(poll_t * poll)
     free(poll);
 }
 
-void poll_add(poll_t * poll, int fd)
+void poll_add(poll_t * poll, int fd, int flags)
 {
     struct kevent request;
-    EV_SET(&request, fd, EVFILT_READ, EV_ADD, 0, 0, 0);
+    EV_SET(&request, fd, EVFILT_READ, EV_ADD | (flags & POLL_EDGE ? EV_CLEAR : 0), 0, 0, 0);
 
     if (kevent(poll->fd, &request, 1, NULL, 0, NULL) < 0)
         die("kevent: add");
 }
 
-int poll_wait(poll_t * poll, int timeout)
+void poll_modify(poll_t * poll, int fd, int flags)
+{
+    struct kevent request;
+    EV_SET(&request, fd, EVFILT_READ, (flags & POLL_PAUSED ? EV_DISABLE : EV_ENABLE) | (flags & POLL_EDGE ? EV_CLEAR : 0), 0, 0, 0);
+
+    if (kevent(poll->fd, &request, 1, NULL, 0, NULL) < 0)
+        die("kevent: modify");
+}
+
+int poll_fetch(poll_t * poll, int timeout)
 {
     struct timespec ts = { timeout / 1000, (timeout % 1000) * 1000000 };
     return kevent(poll->fd, NULL, 0, poll->events, poll->size, timeout >= 0 ? &ts : NULL);
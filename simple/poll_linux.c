@@ -42,15 +42,25 @@ void poll_destroy(poll_t * poll)
     free(poll);
 }
 
-void poll_add(poll_t * poll, int fd)
+void poll_add(poll_t * poll, int fd, int flags)
 {
-    struct epoll_event request = {.events = EPOLLIN, .data = {.fd = fd}};
+    uint32_t events = EPOLLIN | (flags & POLL_EDGE ? EPOLLET : 0) | (flags & POLL_EXCLUSIVE ? EPOLLEXCLUSIVE : 0);
+    struct epoll_event request = {.events = events, .data = {.fd = fd}};
 
     if (epoll_ctl(poll->fd, EPOLL_CTL_ADD, fd, &request) == -1)
         die("epoll_ctl: add");
 }
 
-int poll_wait(poll_t * poll, int timeout)
+void poll_modify(poll_t * poll, int fd, int flags)
+{
+    uint32_t events = (flags & POLL_PAUSED ? 0 : EPOLLIN) | (flags & POLL_EDGE ? EPOLLET : 0);
+    struct epoll_event request = {.events = events, .data = {.fd = fd}};
+
+    if (epoll_ctl(poll->fd, EPOLL_CTL_MOD, fd, &request) == -1)
+        die("epoll_ctl: modify");
+}
+
+int poll_fetch(poll_t * poll, int timeout)
 {
     return epoll_wait(poll->fd, poll->events, poll->size, timeout);
 }
@@ -3,34 +3,105 @@
  * @brief This file contains the implementation of a simple TCP server using the poll() system call.
  *
  * The server listens for incoming connections on a specified port, accepts incoming connections, and handles client requests.
- * It uses a buffer array to store and manipulate data associated with different sockets.
+ * It uses a buffer table to store and manipulate data associated with different sockets.
  * The server uses the poll() system call to efficiently manage multiple connections and handle events.
  *
  * @author Vikman Fernandez-Castro
  * @date July 7, 2024
  */
 
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <stdint.h>
 #include <netinet/in.h>
 
 #include "poll.h"
 #include "buffer.h"
+#include "cpu.h"
+#include "inbox.h"
+#include "log.h"
+#include "metrics.h"
+#include "server.h"
+#include "sink.h"
+#include "table.h"
+#include "wheel.h"
+#include "writer.h"
 
 #define TCP_BACKLOG 2048
-#define BUFFER_LENGTH 4096
+#define RECEIVE_MIN 1024
+#define RECEIVE_INITIAL 4096
+#define RECEIVE_MAX 65536
 #define TIMEOUT_MILLIS -1
+#define RETRY_MILLIS 1
+#define ACCEPT_RETRY_MILLIS 100
 #define die(msg)     \
     {                \
         perror(msg); \
         abort();     \
     }
 
-static int serverSock;
-static poll_t *poll;
-static char *data[TCP_BACKLOG];
+static const options_t *options;
+static int sharedSock = -1;
+static int *listeners;
+static inbox_t *inboxes; // The inboxes of the loops, if an acceptor thread hands the connections over.
+
+// Every event loop runs on its own thread and owns its own state.
+
+static _Thread_local int serverSock = -1;
+static _Thread_local inbox_t *inbox;
+static _Thread_local int loopCpu = -1;
+static _Thread_local poll_t *poll;
+static _Thread_local metrics_t *metrics;
+
+// Timers that shut the connections down when they stay idle or open for too long, indexed by socket.
+// The table never moves its entries, so the timers can stay linked in the wheel while it grows.
+
+typedef struct conn_t
+{
+    int sock;
+    int paused;   // Whether the connection is not read because the memory of the loop went over the high watermark.
+    int deferred; // Whether the socket is in the list of sockets to be read again on a later iteration.
+    size_t receiveSize; // The number of bytes reserved for the next read, adapted to the reads of the connection.
+    wheel_timer_t idle;
+    wheel_timer_t lifetime;
+} conn_t;
+
+static _Thread_local wheel_t wheel;
+static _Thread_local table_t conns;
+
+// Sockets that ran out of read budget and must be read again on a later iteration, in the order they ran out,
+// and sockets that are not read until the memory of the loop falls below the low watermark, in the order they stopped.
+
+typedef struct deferred_t
+{
+    int *socks;
+    size_t count;
+    size_t capacity;
+} deferred_t;
+
+static _Thread_local deferred_t deferred;
+static _Thread_local deferred_t paused;
+
+// The bytes read during the current iteration of the loop.
+
+static _Thread_local size_t loopBytes;
+
+// The watermarks of the loop, and whether the data of its connections is only released by reading more of it.
+
+static _Thread_local size_t highWatermark;
+static _Thread_local size_t lowWatermark;
+static _Thread_local int keepReading;
+static _Thread_local size_t openConns;
 
 /**
  * @brief Binds the specified socket to the given port.
@@ -57,53 +128,238 @@ static void bindPort(int sock, unsigned port)
  * @brief Opens a listening socket on the specified port.
  *
  * This function creates a socket, binds it to the specified port, and sets it to listen for incoming connections.
+ * If the port is shared with other threads, SO_REUSEPORT lets the kernel balance connections among their sockets.
+ * The socket is non-blocking, so that pending connections can be accepted in batches until the backlog is empty.
  *
  * @param port The port number on which the socket should listen for incoming connections.
+ * @param reusePort Whether to enable SO_REUSEPORT on the socket.
  *
  * @return The function returns the file descriptor of the listening socket.
  */
-static int openPort(unsigned port)
+static int openPort(unsigned port, int reusePort)
 {
     int sock = socket(AF_INET, SOCK_STREAM, 0);
 
     if (sock < 0)
         die("socket");
 
+    if (reusePort && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &reusePort, sizeof(reusePort)) < 0)
+        die("setsockopt: SO_REUSEPORT");
+
     bindPort(sock, port);
 
     if (listen(sock, TCP_BACKLOG) < 0)
         die("listen");
 
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
     return sock;
 }
 /**
- * @brief Prints the data associated with the given socket and frees the memory.
+ * @brief Shuts down the connection of an expired idle timer.
+ *
+ * The socket becomes readable and reports the end of the stream, so the connection is closed as if the client closed it.
+ *
+ * @param timer The timer.
+ *
+ * @return This function does not return a value.
+ */
+static void idleExpired(wheel_timer_t *timer)
+{
+    conn_t *conn = (conn_t *)((char *)timer - offsetof(conn_t, idle));
+    shutdown(conn->sock, SHUT_RDWR);
+}
+
+/**
+ * @brief Shuts down the connection of an expired lifetime timer.
+ *
+ * @param timer The timer.
+ *
+ * @return This function does not return a value.
+ */
+static void lifetimeExpired(wheel_timer_t *timer)
+{
+    conn_t *conn = (conn_t *)((char *)timer - offsetof(conn_t, lifetime));
+    shutdown(conn->sock, SHUT_RDWR);
+}
+
+/**
+ * @brief Closes the specified socket, cancels its timers, and forgets it if it was paused.
+ *
+ * If the socket is waiting to be read again, it is taken out of the list, so that a later iteration does not read
+ * a descriptor that is closed or already reused by another connection.
+ *
+ * @param sock The socket to be closed.
+ *
+ * @return This function does not return a value.
+ */
+static void closeConn(int sock)
+{
+    conn_t *conn = tableFind(&conns, sock);
+
+    if (conn != NULL)
+    {
+        wheelCancel(&conn->idle);
+        wheelCancel(&conn->lifetime);
+    }
+
+    if (conn != NULL && conn->deferred)
+    {
+        size_t i = 0;
+
+        while (deferred.socks[i] != sock)
+            i++;
+
+        memmove(&deferred.socks[i], &deferred.socks[i + 1], (--deferred.count - i) * sizeof(int));
+        conn->deferred = 0;
+    }
+
+    if (conn != NULL && conn->paused)
+    {
+        size_t i = 0;
+
+        while (paused.socks[i] != sock)
+            i++;
+
+        memmove(&paused.socks[i], &paused.socks[i + 1], (--paused.count - i) * sizeof(int));
+        conn->paused = 0;
+    }
+
+    openConns--;
+    metricsAdd(&metrics->closed, 1);
+
+    if (inbox != NULL)
+        inboxRelease(inbox);
+
+    close(sock);
+}
+
+/**
+ * @brief Appends a socket to a list of sockets.
+ *
+ * @param list The list.
+ * @param sock The socket.
  *
- * This function prints the data associated with the given socket, frees the memory allocated for the data,
- * and sets the data pointer to NULL.
+ * @return This function does not return a value.
+ */
+static void push(deferred_t *list, int sock)
+{
+    if (list->count == list->capacity)
+    {
+        list->capacity = list->capacity > 0 ? list->capacity * 2 : 64;
+        list->socks = realloc(list->socks, list->capacity * sizeof(int));
+
+        if (list->socks == NULL)
+            die("realloc");
+    }
+
+    list->socks[list->count++] = sock;
+}
+
+/**
+ * @brief Queues a socket to be read again on a later iteration, unless it is already queued.
  *
- * @param sock The socket associated with the data to be printed and freed.
+ * @param sock The socket.
  *
  * @return This function does not return a value.
  */
-static void printData(int sock)
+static void defer(int sock)
 {
-    if (sock >= TCP_BACKLOG)
+    conn_t *conn = tableAt(&conns, sock);
+
+    if (conn->deferred)
         return;
 
-    if (data[sock] != NULL)
+    conn->deferred = 1;
+    push(&deferred, sock);
+}
+
+/**
+ * @brief Checks whether the memory of the loop can only fall by reading from a connection.
+ *
+ * Unless the data is handed over in segments when it gets old, the data of a connection that is not complete yet,
+ * such as a record or the whole stream, is only released by reading the rest of it. Once the writer has nothing
+ * queued, no memory is released otherwise.
+ *
+ * @return The function returns 1 if the loop must keep reading from a connection, or 0 otherwise.
+ */
+static int stalled()
+{
+    if (!keepReading || writerPending())
+        return 0;
+
+    writer_stats_t stats;
+    writerStats(&stats);
+    return stats.depth == 0;
+}
+
+/**
+ * @brief Stops reading from a connection if the memory of the loop is over the high watermark.
+ *
+ * The socket is no longer reported as readable, so the data it receives stays in the kernel, and TCP flow control
+ * eventually stops the client. The connection that reads while the memory is over the watermark is the one paused,
+ * so the clients that send the most stop first, without scanning every connection.
+ * The last connection that is still read is not paused if the loop is stalled. Connections are also paused while
+ * the loop holds as many payloads as the writer queue takes, since the loop is not stalled while it holds any.
+ *
+ * @param sock The socket of the connection.
+ *
+ * @return The function returns 1 if the connection is paused, or 0 otherwise.
+ */
+static int throttle(int sock)
+{
+    conn_t *conn = tableAt(&conns, sock);
+
+    if (conn->paused)
+        return 1;
+
+    if (!writerFull() && (highWatermark == 0 || bufferMemory() <= highWatermark || (openConns - paused.count <= 1 && stalled())))
+        return 0;
+
+    poll_modify(poll, sock, (options->edgeTriggered ? POLL_EDGE : 0) | POLL_PAUSED);
+    push(&paused, sock);
+    conn->paused = 1;
+    metricsAdd(&metrics->pauses, 1);
+    return 1;
+}
+
+/**
+ * @brief Adapts the space reserved for the next read of a connection to the reads so far.
+ *
+ * A read that fills its space means that more data is waiting, so the space doubles, or grows at once to the bytes
+ * that FIONREAD reports in the socket, so bulk senders are read in fewer calls. The socket is only queried when
+ * the space grows, so it costs nothing once the space reaches its maximum. A read that fills less than a quarter
+ * halves the space, so a connection that goes quiet or sends little does not take a spare chunk for every read.
+ *
+ * @param sock The socket of the connection.
+ * @param conn The state of the connection.
+ * @param received The bytes received by the last read.
+ * @param reserved The space reserved for the last read.
+ *
+ * @return This function does not return a value.
+ */
+static void adapt(int sock, conn_t *conn, size_t received, size_t reserved)
+{
+    if (received == reserved && conn->receiveSize < RECEIVE_MAX)
     {
-        printf("[%d]: %s\n", sock, data[sock]);
-        free(data[sock]);
-        data[sock] = NULL;
+        int pending = 0;
+        ioctl(sock, FIONREAD, &pending);
+        size_t size = conn->receiveSize * 2 > (size_t)pending ? conn->receiveSize * 2 : (size_t)pending;
+        conn->receiveSize = size < RECEIVE_MAX ? size : RECEIVE_MAX;
     }
+    else if (received < conn->receiveSize / 4)
+        conn->receiveSize = conn->receiveSize / 2 > RECEIVE_MIN ? conn->receiveSize / 2 : RECEIVE_MIN;
 }
 
 /**
  * @brief Handles incoming data on the specified socket.
  *
- * This function receives data from the specified socket, appends it to the buffer associated with the socket,
- * and prints the data if it is complete.
+ * This function receives data from the specified socket directly into the free space of the buffer associated
+ * with the socket, as much of it per read as adapt() settled on from the previous reads, and prints the data if it is complete. In framing mode, the records completed by every read are
+ * printed right away, and a connection that sends a record that is not valid is closed.
+ * In edge-triggered mode, the socket is read until it would block. If the read budget runs out first,
+ * the socket is deferred to the next iteration so that other connections are served in between.
+ * Receiving data restarts the idle timer of the connection, and the connection stops being read if it takes the memory
+ * of the loop over the high watermark.
  *
  * @param sock The socket associated with the incoming data.
  *
@@ -111,55 +367,593 @@ static void printData(int sock)
  */
 static void handleConn(int sock)
 {
-    char data[BUFFER_LENGTH];
-    ssize_t bytes_read = recv(sock, data, sizeof(data), 0);
+    conn_t *conn = tableAt(&conns, sock);
+    size_t total = 0;
 
-    if (bytes_read > 0)
-        bufferAppend(sock, data, bytes_read);
-    else
+    do
     {
-        bufferDump(sock);
-        close(sock);
+        struct iovec iov[2];
+        int count = bufferSpace(sock, conn->receiveSize, iov);
+        size_t reserved = 0;
+
+        for (int i = 0; i < count; i++)
+            reserved += iov[i].iov_len;
+
+        ssize_t bytes_read = readv(sock, iov, count);
+        size_t records;
+        int valid = bufferCommit(sock, bytes_read > 0 ? bytes_read : 0, &records);
+        metricsAdd(&metrics->records, records);
+
+        if (valid < 0)
+        {
+            fprintf(stderr, "Invalid record from socket %d\n", sock);
+            bufferDump(sock);
+            closeConn(sock);
+            return;
+        }
+
+        if (bytes_read > 0)
+        {
+            if (options->idleTimeout > 0 && total == 0)
+                wheelAdd(&wheel, &conn->idle, wheelNow() + options->idleTimeout);
+
+            total += bytes_read;
+            loopBytes += bytes_read;
+            metricsAdd(&metrics->reads, 1);
+            metricsAdd(&metrics->bytesReceived, bytes_read);
+            histogramRecord(&metrics->readBytes, bytes_read);
+            adapt(sock, conn, bytes_read, reserved);
+
+            if (throttle(sock))
+                return;
+        }
+        else if (bytes_read == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        else
+        {
+            bufferDump(sock);
+            closeConn(sock);
+            return;
+        }
+    } while (options->edgeTriggered && total < options->readBudget);
+
+    if (options->edgeTriggered)
+        defer(sock);
+}
+
+/**
+ * @brief Reads again the sockets deferred before this iteration, in the order they were deferred, while the loop budget lasts.
+ *
+ * At least one socket is read per iteration, and the ones left keep their place ahead of those deferred in this iteration,
+ * so a few heavy senders cannot delay the events of the other connections by more than the budget.
+ * Every socket is queued at most once, and closing a connection takes its socket out of the list.
+ *
+ * @return This function does not return a value.
+ */
+static void resumeDeferred()
+{
+    size_t count = deferred.count;
+    size_t i = 0;
+
+    if (count == 0)
         return;
+
+    for (; i < count && (i == 0 || options->loopBudget == 0 || loopBytes < options->loopBudget); i++)
+    {
+        // The socket leaves the list before it is read, so that it can be queued again or closed.
+        ((conn_t *)tableAt(&conns, deferred.socks[i]))->deferred = 0;
+        handleConn(deferred.socks[i]);
+    }
+
+    if (i < count)
+        metricsAdd(&metrics->budgetStops, 1);
+
+    memmove(deferred.socks, deferred.socks + i, (deferred.count - i) * sizeof(int));
+    deferred.count -= i;
+}
+
+/**
+ * @brief Reads again the paused connections once the memory of the loop falls below the low watermark,
+ * and the payloads held by the loop fit in the writer queue again.
+ *
+ * The connections are deferred, so their pending data is read on the next iteration even if they are edge-triggered.
+ * If every open connection is paused and the loop is stalled, the one that stopped first is read again,
+ * so that it can complete its data.
+ *
+ * @return This function does not return a value.
+ */
+static void resumePaused()
+{
+    size_t count = 0;
+
+    if (paused.count == 0 || writerFull())
+        return;
+
+    if (highWatermark == 0 || bufferMemory() < lowWatermark)
+        count = paused.count;
+    else if (paused.count == openConns && stalled())
+        count = 1;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        int sock = paused.socks[i];
+        ((conn_t *)tableAt(&conns, sock))->paused = 0;
+        poll_modify(poll, sock, options->edgeTriggered ? POLL_EDGE : 0);
+        defer(sock);
+    }
+
+    memmove(paused.socks, paused.socks + count, (paused.count - count) * sizeof(int));
+    paused.count -= count;
+}
+
+/**
+ * @brief Accepts a pending connection on a listening socket.
+ *
+ * The accepted socket is non-blocking and close-on-exec. The call only blocks if the listening socket does.
+ *
+ * @param listener The listening socket.
+ *
+ * @return The function returns the accepted socket, or -1 on error.
+ */
+static int acceptSocket(int listener)
+{
+#ifdef __linux__
+    return accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+    int sock = accept(listener, NULL, NULL);
+
+    if (sock >= 0)
+    {
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+        fcntl(sock, F_SETFD, FD_CLOEXEC);
+    }
+
+    return sock;
+#endif
+}
+
+/**
+ * @brief Enables kernel busy polling on an accepted socket.
+ *
+ * With SO_BUSY_POLL, the kernel polls the device queue of the socket for up to the given time before sleeping,
+ * and SO_PREFER_BUSY_POLL asks it to keep polling instead of falling back to interrupts while the loop is busy.
+ * Raising SO_BUSY_POLL above net.core.busy_read requires CAP_NET_ADMIN, so a failure is reported once and ignored.
+ *
+ * @param sock The accepted socket.
+ *
+ * @return This function does not return a value.
+ */
+static void setBusyPoll(int sock)
+{
+#ifdef SO_BUSY_POLL
+    static _Thread_local int warned;
+    int usec = options->socketBusyPoll;
+
+    if (setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) < 0 && !warned)
+    {
+        perror("setsockopt: SO_BUSY_POLL");
+        warned = 1;
+    }
+
+#ifdef SO_PREFER_BUSY_POLL
+    int enable = 1;
+    setsockopt(sock, SOL_SOCKET, SO_PREFER_BUSY_POLL, &enable, sizeof(enable));
+#endif
+#endif
+}
+
+/**
+ * @brief Starts serving an accepted connection on the loop.
+ *
+ * This function creates the buffer and the connection state of the socket, starts the idle and lifetime timers
+ * of the connection, and adds the socket to the poll set.
+ *
+ * @param sock The accepted socket.
+ *
+ * @return This function does not return a value.
+ */
+static void openConn(int sock)
+{
+    bufferOpen(sock);
+    metricsAdd(&metrics->accepted, 1);
+
+    if (loopCpu >= 0 && cpuIncoming(sock) != loopCpu)
+        metricsAdd(&metrics->remoteCpu, 1);
+
+    conn_t *conn = tableAt(&conns, sock);
+    conn->sock = sock;
+    conn->paused = 0;
+    conn->deferred = 0;
+    conn->receiveSize = RECEIVE_INITIAL;
+    openConns++;
+    conn->idle.expire = idleExpired;
+    conn->lifetime.expire = lifetimeExpired;
+
+    if (options->idleTimeout > 0)
+        wheelAdd(&wheel, &conn->idle, wheelNow() + options->idleTimeout);
+
+    if (options->lifetime > 0)
+        wheelAdd(&wheel, &conn->lifetime, wheelNow() + options->lifetime);
+
+    if (options->socketBusyPoll > 0)
+        setBusyPoll(sock);
+
+    if (options->socketRcvLowat > 0 && setsockopt(sock, SOL_SOCKET, SO_RCVLOWAT, &options->socketRcvLowat, sizeof(options->socketRcvLowat)) < 0)
+        perror("setsockopt: SO_RCVLOWAT");
+
+    poll_add(poll, sock, options->edgeTriggered ? POLL_EDGE : 0);
+}
+
+/**
+ * @brief Accepts the pending connections on the listening socket.
+ *
+ * This function accepts connections until the backlog is empty or the accept budget runs out,
+ * and starts serving them. If the budget runs out, the listening socket
+ * is still ready and will be reported again on the next iteration.
+ *
+ * @return This function does not return a value.
+ */
+static void acceptClients()
+{
+    for (unsigned i = 0; i < options->acceptBudget; i++)
+    {
+        int sock = acceptSocket(serverSock);
+
+        if (sock < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                perror("accept");
+
+            return;
+        }
+
+        openConn(sock);
     }
 }
 
+/**
+ * @brief Starts serving the connections that the acceptor thread put in the inbox of the loop.
+ *
+ * The notifications are consumed first, so that a connection put in the meantime wakes the loop up again.
+ *
+ * @return This function does not return a value.
+ */
+static void receiveClients()
+{
+    inboxDrain(inbox);
+
+    for (int sock; (sock = inboxPop(inbox)) >= 0;)
+        openConn(sock);
+}
+
+/**
+ * @brief Combines two poll timeouts, where a negative value means no timeout.
+ *
+ * @param a The first timeout, in milliseconds.
+ * @param b The second timeout, in milliseconds.
+ *
+ * @return The function returns the shortest of the two timeouts.
+ */
+static int earliest(int a, int b)
+{
+    if (a < 0)
+        return b;
+
+    if (b < 0)
+        return a;
+
+    return a < b ? a : b;
+}
+
 /**
  * @brief Main loop for the server.
  *
  * This function continuously waits for events on the poll set, handles incoming connections and data,
- * and prints the data associated with each socket.
+ * and hands the data associated with each socket over to the output writer. The listening socket, or the inbox if an acceptor
+ * thread hands the connections over, is handled before the other events, so that accepting never waits behind a full batch. If some sockets were deferred, the wait does not block,
+ * and the deferred sockets are read after the events, as long as the bytes read in the iteration stay within the loop budget. If the output queue was full,
+ * the wait is shortened so that the held payloads are retried soon, and so are the paused connections. In streaming mode, the buffers that got old
+ * are handed over before waiting, and the wait ends when the next one does. Likewise, the timer wheel is advanced
+ * before waiting, and the wait ends when it needs to be advanced again.
+ * With busy polling, the wait spins on the poll set before blocking, so that events arriving soon are picked up without sleeping.
+ * The loop records its own metrics: the events returned by each wait, how many wakeups came from spinning rather than sleeping,
+ * and the time spent on everything else.
  *
  * @return This function does not return a value.
  */
 static void loop()
 {
-    int nEvents = poll_wait(poll, TIMEOUT_MILLIS);
+    uint64_t start = metricsNanos();
+    int timeout = earliest(TIMEOUT_MILLIS, bufferExpire());
+    loopBytes = 0;
+
+    if (wheel.count > 0)
+    {
+        uint64_t now = wheelNow();
+        wheelAdvance(&wheel, now);
+        timeout = earliest(timeout, wheelTimeout(&wheel, now));
+    }
+
+    // The memory is released by other threads without waking the loop up, so the paused connections are checked often.
+    if (writerPending() || paused.count > 0)
+        timeout = earliest(timeout, RETRY_MILLIS);
+
+    if (deferred.count > 0)
+        timeout = 0;
+
+    uint64_t waitStart = metricsNanos();
+    int nEvents = poll_wait(poll, timeout);
+    start += metricsNanos() - waitStart;
+
+    atomic_store_explicit(&metrics->spins, poll->stats.spins, memory_order_relaxed);
+    atomic_store_explicit(&metrics->spinWakeups, poll->stats.spinWakeups, memory_order_relaxed);
+    atomic_store_explicit(&metrics->sleeps, poll->stats.sleeps, memory_order_relaxed);
+    atomic_store_explicit(&metrics->spinNanos, poll->stats.spinNanos, memory_order_relaxed);
+    metricsAdd(&metrics->waits, 1);
+    metricsAdd(&metrics->events, nEvents > 0 ? nEvents : 0);
+    histogramRecord(&metrics->eventsPerWait, nEvents > 0 ? nEvents : 0);
+
+    // New connections are accepted first, so that a batch full of busy connections does not hold them back.
+    int listener = inbox != NULL ? inbox->fd : serverSock;
+
+    for (int i = 0; i < nEvents; i++)
+    {
+        if (poll_get(poll, i) == listener && inbox != NULL)
+            receiveClients();
+        else if (poll_get(poll, i) == listener)
+            acceptClients();
+    }
 
     for (int i = 0; i < nEvents; i++)
     {
         int sock = poll_get(poll, i);
 
-        if (sock == serverSock)
+        if (sock > 0 && sock != listener)
+            handleConn(sock);
+    }
+
+    resumeDeferred();
+    writerFlush();
+    resumePaused();
+    atomic_store_explicit(&metrics->paused, paused.count, memory_order_relaxed);
+    histogramRecord(&metrics->loopNanos, metricsNanos() - start);
+}
+
+/**
+ * @brief Runs an event loop on the calling thread.
+ *
+ * This function pins the thread to its CPU, if a list was given, before allocating anything, so the memory of the loop
+ * is local to that CPU. Then it registers its listening socket, the shared one as exclusive, or its inbox,
+ * creates its poll set, metrics, buffer table and connection table, and runs the loop forever.
+ *
+ * @param arg The index of the loop.
+ *
+ * @return This function does not return.
+ */
+static void *run(void *arg)
+{
+    unsigned index = (uintptr_t)arg;
+
+    if (options->cpuCount > 0)
+    {
+        loopCpu = options->cpus[index % options->cpuCount];
+        cpuPin(loopCpu);
+    }
+
+    poll = poll_init(options->eventBatch);
+    poll_spin(poll, options->busyPoll);
+    metrics = metricsRegister();
+    bufferCreate(options->stream ? options->flushBytes : 0, options->flushMillis);
+    bufferFraming(options->frame, options->delimiter, options->maxRecord);
+    bufferWatch(metrics);
+    tableInit(&conns, sizeof(conn_t));
+    wheelInit(&wheel);
+
+    // The watermarks and the budget are shared evenly by the loops, and the budget only applies to the data kept until the connections close.
+    highWatermark = (options->highWatermark + options->threads - 1) / options->threads;
+    lowWatermark = (options->lowWatermark + options->threads - 1) / options->threads;
+    keepReading = !options->stream;
+
+    if (!options->stream && options->frame == FRAME_NONE && options->memoryBudget > 0)
+        bufferSpilling((options->memoryBudget + options->threads - 1) / options->threads, options->spillDir, metrics);
+    else
+        bufferSpilling(0, options->spillDir, metrics);
+
+    if (inboxes != NULL)
+    {
+        inbox = &inboxes[index];
+        poll_add(poll, inbox->fd, 0);
+    }
+    else
+    {
+        serverSock = sharedSock >= 0 ? sharedSock : listeners[index];
+        poll_add(poll, serverSock, sharedSock >= 0 ? POLL_EXCLUSIVE : 0);
+    }
+
+    while (1)
+        loop();
+
+    return NULL;
+}
+
+/**
+ * @brief Opens a listening socket per event loop, and steers the connections to the loop that runs on their CPU.
+ *
+ * The sockets are opened in the order of the loops, so that they have the same index in the SO_REUSEPORT group.
+ * If the loops are pinned, every socket prefers the connections of its loop's CPU with SO_INCOMING_CPU,
+ * and a steering program is attached to the group, if the kernel allows it, to apply that preference strictly.
+ *
+ * @return This function does not return a value.
+ */
+static void openListeners()
+{
+    int *cpus = malloc(options->threads * sizeof(int));
+    listeners = malloc(options->threads * sizeof(int));
+
+    if (cpus == NULL || listeners == NULL)
+        die("malloc");
+
+    for (unsigned i = 0; i < options->threads; i++)
+    {
+        listeners[i] = openPort(options->port, options->threads > 1);
+
+        if (options->cpuCount > 0 && options->threads > 1)
         {
-            int sock = accept(serverSock, NULL, NULL);
-            poll_add(poll, sock);
+            cpus[i] = options->cpus[i % options->cpuCount];
+            cpuPrefer(listeners[i], cpus[i]);
+        }
+    }
+
+    if (options->cpuCount > 0 && options->threads > 1 && cpuSteer(listeners[0], cpus, options->threads) < 0)
+        fprintf(stderr, "Cannot attach the steering program, connections are steered with SO_INCOMING_CPU only\n");
+
+    free(cpus);
+}
+
+/**
+ * @brief Hands an accepted connection over to a loop through its inbox.
+ *
+ * In round-robin mode, the loops take turns. In least-loaded mode, the loop with the fewest connections waiting in its inbox
+ * or open gets it, and the turns only break ties. If the inbox of that loop is full, the next ones are tried in turn.
+ *
+ * @param sock The accepted socket.
+ * @param next The loop whose turn it is, which is moved past the loop that gets the connection.
+ *
+ * @return The function returns 0 on success, or -1 if every inbox is full.
+ */
+static int handOver(int sock, unsigned *next)
+{
+    unsigned chosen = *next % options->threads;
+
+    if (options->acceptor == INBOX_LEAST_LOADED)
+    {
+        for (unsigned i = 1; i < options->threads; i++)
+        {
+            unsigned index = (*next + i) % options->threads;
+
+            if (inboxLoad(&inboxes[index]) < inboxLoad(&inboxes[chosen]))
+                chosen = index;
         }
-        else if (sock > 0)
-            handleConn(sock);
     }
+
+    for (unsigned i = 0; i < options->threads; i++)
+    {
+        unsigned index = (chosen + i) % options->threads;
+
+        if (inboxPush(&inboxes[index], sock) == 0)
+        {
+            inboxNotify(&inboxes[index]);
+            *next = index + 1;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Runs the acceptor thread, which accepts every connection and hands it over to the loops.
+ *
+ * The listening socket is blocking, so the thread sleeps in accept() while there are no connections.
+ * While every inbox is full, the connection just accepted waits, and the next ones stay in the backlog.
+ *
+ * @param arg The listening socket.
+ *
+ * @return This function does not return.
+ */
+static void *acceptorRun(void *arg)
+{
+    int listener = (intptr_t)arg;
+    unsigned next = 0;
+
+    while (1)
+    {
+        int sock = acceptSocket(listener);
+
+        if (sock < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            perror("accept");
+
+            // Out of descriptors or memory, the backlog stays full: back off instead of spinning.
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+                usleep(ACCEPT_RETRY_MILLIS * 1000);
+
+            continue;
+        }
+
+        while (handOver(sock, &next) < 0)
+            usleep(RETRY_MILLIS * 1000);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Opens a single blocking listening socket and starts the acceptor thread, creating an inbox per loop.
+ *
+ * @return This function does not return a value.
+ */
+static void startAcceptor()
+{
+    int listener = openPort(options->port, 0);
+    fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) & ~O_NONBLOCK);
+    inboxes = aligned_alloc(_Alignof(inbox_t), options->threads * sizeof(inbox_t));
+
+    if (inboxes == NULL)
+        die("aligned_alloc");
+
+    for (unsigned i = 0; i < options->threads; i++)
+        inboxInit(&inboxes[i]);
+
+    pthread_t thread;
+
+    if (pthread_create(&thread, NULL, acceptorRun, (void *)(intptr_t)listener) != 0)
+        die("pthread_create");
 }
 
 // Starts a server listening on the specified port.
 
-void serve(unsigned port)
+void serve(const options_t *serverOptions)
 {
-    serverSock = openPort(port);
-    poll = poll_init(TCP_BACKLOG);
-    bufferCreate(TCP_BACKLOG);
+    options = serverOptions;
 
-    poll_add(poll, serverSock);
+    // The threads inherit the blocked signals, so only the wait below receives them.
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, NULL);
+    metricsStart(options->metricsPort);
+    sink_t *sink = sinkText();
 
-    while (1)
-        loop();
+    if (options->logDir != NULL && (sink = logOpen(options->logDir, options->segmentSize)) == NULL)
+    {
+        fprintf(stderr, "Cannot open the log in %s: %s\n", options->logDir, strerror(errno));
+        exit(1);
+    }
+
+    writerStart(options->outputQueue, sink);
+
+    if (options->acceptor != INBOX_NONE)
+        startAcceptor();
+    else if (options->sharedListener)
+        sharedSock = openPort(options->port, 0);
+    else
+        openListeners();
+
+    for (unsigned i = 0; i < options->threads; i++)
+    {
+        pthread_t thread;
+
+        if (pthread_create(&thread, NULL, run, (void *)(uintptr_t)i) != 0)
+            die("pthread_create");
+    }
+
+    for (int sig; sigwait(&stopSignals, &sig) != 0;)
+        ;
+
+    writerStop();
 }
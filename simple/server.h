@@ -10,14 +10,20 @@
 
 #pragma once
 
+#include "options.h"
+
 /**
  * @brief Starts a server listening on the specified port.
  *
  * This function initializes the server, sets up the poll set, and starts listening for incoming connections.
  * It continuously handles incoming connections and data using the poll() system call.
+ * If more than one thread is requested, every thread runs its own event loop with its own listening socket,
+ * bound with SO_REUSEPORT, its own poll set and its own buffer array. Alternatively, all the threads may share
+ * a single listening socket.
+ * The function returns on SIGINT or SIGTERM, once the output writer has written what is left in its queue.
  *
- * @param port The port number on which the server should listen for incoming connections.
+ * @param options The options of the server, including the port number and the number of threads.
  *
  * @return This function does not return a value.
  */
-void serve(unsigned port);
+void serve(const options_t *options);
@@ -0,0 +1,280 @@
+/**
+ * @file sink.c
+ * @brief This file contains the implementation of the text sink.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#include "sink.h"
+
+#define die(msg)     \
+    {                \
+        perror(msg); \
+        abort();     \
+    }
+
+/**
+ * @brief Writes a vector of buffers completely, retrying after partial writes.
+ *
+ * The buffers are written with writev() in batches of up to IOV_MAX entries.
+ *
+ * @param fd The file descriptor to write to.
+ * @param iov The vector of buffers. It is modified to track the progress.
+ * @param count The number of buffers in the vector.
+ *
+ * @return This function does not return a value.
+ */
+static void writeAll(int fd, struct iovec *iov, int count)
+{
+    while (count > 0)
+    {
+        ssize_t written = writev(fd, iov, count < IOV_MAX ? count : IOV_MAX);
+
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            perror("writev");
+            return;
+        }
+
+        while (count > 0 && (size_t)written >= iov->iov_len)
+        {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+
+        if (count > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+}
+
+/**
+ * @brief Writes a vector of buffers to the standard output.
+ *
+ * @param iov The vector of buffers.
+ * @param count The number of buffers in the vector.
+ *
+ * @return The function returns the number of bytes written.
+ */
+static size_t writeOut(struct iovec *iov, size_t count)
+{
+    size_t total = 0;
+
+    for (size_t i = 0; i < count; i++)
+        total += iov[i].iov_len;
+
+    writeAll(STDOUT_FILENO, iov, count);
+    return total;
+}
+
+/**
+ * @brief Copies the data of a spill file to the standard output.
+ *
+ * On Linux, the data goes from the page cache to the output with sendfile(), without passing through user space.
+ * If the output does not support it, for example because it was opened for appending, the file is read and written instead.
+ *
+ * @param fd The spill file.
+ * @param size The size of the data in the file.
+ *
+ * @return The function returns the number of bytes written.
+ */
+static size_t sendFile(int fd, size_t size)
+{
+    off_t offset = 0;
+
+#ifdef __linux__
+    while ((size_t)offset < size)
+    {
+        ssize_t sent = sendfile(STDOUT_FILENO, fd, &offset, size - offset);
+
+        if (sent > 0 || (sent < 0 && errno == EINTR))
+            continue;
+
+        if (sent < 0 && errno != EINVAL && errno != ENOSYS)
+            perror("sendfile");
+
+        break;
+    }
+#endif
+
+    while ((size_t)offset < size)
+    {
+        static char data[65536];
+        ssize_t length = pread(fd, data, size - offset < sizeof(data) ? size - offset : sizeof(data), offset);
+
+        if (length <= 0)
+        {
+            perror("pread");
+            break;
+        }
+
+        struct iovec iov = {data, length};
+        writeAll(STDOUT_FILENO, &iov, 1);
+        offset += length;
+    }
+
+    return offset;
+}
+
+/**
+ * @brief Ensures that a vector of buffers has room for the specified number of entries.
+ *
+ * @param iov The vector.
+ * @param capacity The capacity of the vector, updated if it grows.
+ * @param needed The number of entries needed.
+ *
+ * @return This function does not return a value.
+ */
+static void reserve(struct iovec **iov, size_t *capacity, size_t needed)
+{
+    if (needed > *capacity)
+    {
+        *capacity = needed * 2;
+        *iov = realloc(*iov, *capacity * sizeof(struct iovec));
+
+        if (*iov == NULL)
+            die("realloc");
+    }
+}
+
+/**
+ * @brief Adds the buffers of a record to a vector of buffers, one per chunk that it spans.
+ *
+ * The size of the last chunk of the payload may still grow while it is written, so it is never read.
+ *
+ * @param payload The payload that holds the record.
+ * @param record The record.
+ * @param iov The vector, which grows as needed.
+ * @param capacity The capacity of the vector.
+ * @param count The number of entries in the vector, updated with the new ones.
+ *
+ * @return This function does not return a value.
+ */
+static void addRecord(const payload_t *payload, const record_t *record, struct iovec **iov, size_t *capacity, size_t *count)
+{
+    chunk_t *chunk = record->chunk;
+    size_t offset = record->offset;
+
+    for (size_t remaining = record->length; remaining > 0;)
+    {
+        size_t length = chunk != payload->tail && chunk->size - offset < remaining ? chunk->size - offset : remaining;
+        reserve(iov, capacity, *count + 2);
+        (*iov)[(*count)++] = (struct iovec){chunk->data + offset, length};
+        remaining -= length;
+
+        // The link of the last chunk may be changing, so it is only followed if the record goes on.
+        if (remaining > 0)
+        {
+            chunk = chunk->next;
+            offset = 0;
+        }
+    }
+}
+
+/**
+ * @brief Writes a batch of payloads to the standard output with as few system calls as possible.
+ *
+ * Every record of a payload is written with its own header, which tells the connection and the number of the record.
+ * The buffers gathered before a spill file are written first, and the file is copied after them.
+ *
+ * @param sink The text sink.
+ * @param batch The payloads.
+ * @param n The number of payloads.
+ *
+ * @return The function returns the number of bytes written.
+ */
+static size_t textWrite(sink_t *sink, payload_t *batch, size_t n)
+{
+    static struct iovec *iov;
+    static size_t iovCapacity;
+    static char (*headers)[64];
+    static size_t headerCapacity;
+    size_t iovCount = 0;
+    size_t headerCount = 0;
+    size_t total = 0;
+    (void)sink;
+
+    for (size_t i = 0; i < n; i++)
+        headerCount += batch[i].recordCount;
+
+    if (headerCount > headerCapacity)
+    {
+        headerCapacity = headerCount * 2;
+        headers = realloc(headers, headerCapacity * sizeof(*headers));
+
+        if (headers == NULL)
+            die("realloc");
+    }
+
+    headerCount = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (batch[i].records != NULL)
+        {
+            for (size_t j = 0; j < batch[i].recordCount; j++)
+            {
+                record_t *record = &batch[i].records[j];
+                const char *partial = batch[i].partial && j + 1 == batch[i].recordCount ? " partial" : "";
+                char *header = headers[headerCount++];
+                int length = snprintf(header, sizeof(*headers), "[%d conn=%lu rec=%lu%s]: \"", batch[i].sock, batch[i].conn, batch[i].sequence + j, partial);
+
+                reserve(&iov, &iovCapacity, iovCount + 2);
+                iov[iovCount++] = (struct iovec){header, length};
+                addRecord(&batch[i], record, &iov, &iovCapacity, &iovCount);
+                iov[iovCount++] = (struct iovec){(void *)batch[i].trailer, strlen(batch[i].trailer)};
+            }
+
+            continue;
+        }
+
+        size_t needed = iovCount + 2;
+
+        for (chunk_t *chunk = batch[i].head; chunk != NULL; chunk = chunk->next)
+            needed++;
+
+        reserve(&iov, &iovCapacity, needed);
+        iov[iovCount++] = (struct iovec){batch[i].header, batch[i].headerLength};
+
+        for (chunk_t *chunk = batch[i].head; chunk != NULL; chunk = chunk->next)
+            iov[iovCount++] = (struct iovec){chunk->data, chunk->size};
+
+        if (batch[i].fileSize > 0)
+        {
+            total += writeOut(iov, iovCount);
+            total += sendFile(batch[i].file, batch[i].fileSize);
+            iovCount = 0;
+        }
+
+        iov[iovCount++] = (struct iovec){(void *)batch[i].trailer, strlen(batch[i].trailer)};
+    }
+
+    return total + writeOut(iov, iovCount);
+}
+
+static sink_t text = {.write = textWrite};
+
+// Gets the sink that prints the payloads on the standard output.
+
+sink_t *sinkText()
+{
+    return &text;
+}
@@ -0,0 +1,30 @@
+/**
+ * @file sink.h
+ * @brief This file contains the declaration of the sink_t data structure and the text sink.
+ *
+ * A sink is the destination of the payloads that the output writer takes from its queue. Sinks are only called
+ * from the writer thread, so they need no synchronization, and the writer releases the chunks and spill files
+ * of the payloads once the sink is done with them.
+ * The text sink prints every payload on the standard output after its header, with writev() and sendfile().
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include "writer.h"
+
+typedef struct sink_t
+{
+    size_t (*write)(struct sink_t *sink, payload_t *batch, size_t n); // Writes a batch of payloads, returning the number of bytes written.
+    void (*close)(struct sink_t *sink);                                // Closes the sink once the writer has stopped, or NULL if there is nothing to close.
+} sink_t;
+
+/**
+ * @brief Gets the sink that prints the payloads on the standard output.
+ *
+ * @return The function returns the sink.
+ */
+sink_t *sinkText();
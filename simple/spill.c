@@ -0,0 +1,111 @@
+/**
+ * @file spill.c
+ * @brief This file contains the implementation of the spill files.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "spill.h"
+
+// Creates an unlinked spill file in the specified directory.
+
+int spillOpen(spill_t *spill, const char *dir)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/server-spill-XXXXXX", dir);
+
+#ifdef __linux__
+    spill->fd = mkostemp(path, O_CLOEXEC);
+#else
+    spill->fd = mkstemp(path);
+
+    if (spill->fd >= 0)
+        fcntl(spill->fd, F_SETFD, FD_CLOEXEC);
+#endif
+
+    if (spill->fd < 0)
+        return -1;
+
+    unlink(path);
+    spill->map = NULL;
+    spill->mapOffset = 0;
+    spill->size = 0;
+    return 0;
+}
+
+// Gets free space at the end of a spill file.
+
+int spillSpace(spill_t *spill, size_t size, struct iovec *iov)
+{
+    if (size == 0)
+        return 0;
+
+    if (spill->map == NULL || spill->size == spill->mapOffset + SPILL_SEGMENT)
+    {
+        // Segments start at a page boundary, so the first one may begin before the end of the data written so far.
+        size_t offset = spill->size - spill->size % sysconf(_SC_PAGESIZE);
+
+        spillUnmap(spill);
+
+        if (ftruncate(spill->fd, offset + SPILL_SEGMENT) < 0)
+            return 0;
+
+        char *map = mmap(NULL, SPILL_SEGMENT, PROT_READ | PROT_WRITE, MAP_SHARED, spill->fd, offset);
+
+        if (map == MAP_FAILED)
+            return 0;
+
+        spill->map = map;
+        spill->mapOffset = offset;
+    }
+
+    size_t available = spill->mapOffset + SPILL_SEGMENT - spill->size;
+    iov->iov_base = spill->map + (spill->size - spill->mapOffset);
+    iov->iov_len = size < available ? size : available;
+    return 1;
+}
+
+// Marks the given number of bytes at the end of a spill file as used.
+
+void spillCommit(spill_t *spill, size_t size)
+{
+    spill->size += size;
+}
+
+// Appends data to a spill file.
+
+int spillWrite(spill_t *spill, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        struct iovec iov;
+
+        if (spillSpace(spill, size, &iov) == 0)
+            return -1;
+
+        memcpy(iov.iov_base, data, iov.iov_len);
+        spillCommit(spill, iov.iov_len);
+        data += iov.iov_len;
+        size -= iov.iov_len;
+    }
+
+    return 0;
+}
+
+// Unmaps the current segment of a spill file.
+
+void spillUnmap(spill_t *spill)
+{
+    if (spill->map != NULL)
+        munmap(spill->map, SPILL_SEGMENT);
+
+    spill->map = NULL;
+}
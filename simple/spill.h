@@ -0,0 +1,80 @@
+/**
+ * @file spill.h
+ * @brief This file contains the declaration of the spill_t data structure and related functions.
+ *
+ * A spill file holds the data of a connection that does not fit in the memory budget of its event loop.
+ * The file is created in a temporary directory and unlinked right away, so it disappears when it is closed.
+ * Data is written through a memory-mapped segment at the end of the file, which is remapped as it fills up,
+ * so receives land in the page cache directly and only one segment per file is mapped at a time.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#define SPILL_SEGMENT (1 << 20)
+
+typedef struct spill_t
+{
+    int fd;           // The file, or -1 if there is none.
+    char *map;        // The mapped segment, or NULL if none is mapped.
+    size_t mapOffset; // The position of the segment in the file.
+    size_t size;      // The number of bytes of data in the file.
+} spill_t;
+
+/**
+ * @brief Creates an unlinked spill file in the specified directory.
+ *
+ * @param spill The spill file.
+ * @param dir The directory.
+ *
+ * @return The function returns 0 on success, or -1 on error.
+ */
+int spillOpen(spill_t *spill, const char *dir);
+
+/**
+ * @brief Gets free space at the end of a spill file, mapping a new segment if the current one is full.
+ *
+ * @param spill The spill file.
+ * @param size The number of bytes to reserve. Fewer bytes may be reserved if they would cross the end of the segment.
+ * @param iov Output parameter that receives the space.
+ *
+ * @return The function returns 1, or 0 if the size is 0 or the segment could not be mapped.
+ */
+int spillSpace(spill_t *spill, size_t size, struct iovec *iov);
+
+/**
+ * @brief Marks the given number of bytes at the end of a spill file as used.
+ *
+ * @param spill The spill file.
+ * @param size The number of bytes written to the space returned by spillSpace().
+ *
+ * @return This function does not return a value.
+ */
+void spillCommit(spill_t *spill, size_t size);
+
+/**
+ * @brief Appends data to a spill file.
+ *
+ * @param spill The spill file.
+ * @param data The data.
+ * @param size The size of the data.
+ *
+ * @return The function returns 0 on success, or -1 if a segment could not be mapped.
+ */
+int spillWrite(spill_t *spill, const char *data, size_t size);
+
+/**
+ * @brief Unmaps the current segment of a spill file, so that the file can be handed over.
+ *
+ * The file descriptor is kept open, and its owner must close it.
+ *
+ * @param spill The spill file.
+ *
+ * @return This function does not return a value.
+ */
+void spillUnmap(spill_t *spill);
@@ -0,0 +1,56 @@
+/**
+ * @file table.c
+ * @brief This file contains the implementation of the fd-indexed tables.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "table.h"
+
+#define die(msg)     \
+    {                \
+        perror(msg); \
+        abort();     \
+    }
+
+// Initializes an empty table.
+
+void tableInit(table_t *table, size_t entrySize)
+{
+    table->pages = NULL;
+    table->pageCount = 0;
+    table->entrySize = entrySize;
+}
+
+// Allocates the page that holds the specified entry.
+
+void *tableGrow(table_t *table, size_t index)
+{
+    size_t page = index >> TABLE_PAGE_BITS;
+
+    if (page >= table->pageCount)
+    {
+        size_t count = table->pageCount > 0 ? table->pageCount : 1;
+
+        while (count <= page)
+            count *= 2;
+
+        char **pages = realloc(table->pages, count * sizeof(char *));
+
+        if (pages == NULL)
+            die("realloc");
+
+        memset(pages + table->pageCount, 0, (count - table->pageCount) * sizeof(char *));
+        table->pages = pages;
+        table->pageCount = count;
+    }
+
+    if (table->pages[page] == NULL && (table->pages[page] = calloc(TABLE_PAGE_ENTRIES, table->entrySize)) == NULL)
+        die("calloc");
+
+    return table->pages[page] + (index & (TABLE_PAGE_ENTRIES - 1)) * table->entrySize;
+}
@@ -0,0 +1,80 @@
+/**
+ * @file table.h
+ * @brief This file contains the declaration of the table_t data structure and related functions.
+ *
+ * A table maps file descriptors to fixed-size entries. The entries are stored in pages of TABLE_PAGE_ENTRIES,
+ * allocated on first use and never freed nor moved, so the table grows with the highest descriptor in use
+ * while a lookup stays two array accesses, and pointers to entries remain valid, as intrusive lists require.
+ * The kernel hands out the lowest free descriptors, so the pages in use stay dense.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#define TABLE_PAGE_BITS 10
+#define TABLE_PAGE_ENTRIES (1 << TABLE_PAGE_BITS)
+
+typedef struct table_t
+{
+    char **pages;     // The pages, or NULL for those not allocated yet.
+    size_t pageCount; // The number of slots in the page directory.
+    size_t entrySize; // The size of every entry.
+} table_t;
+
+/**
+ * @brief Initializes an empty table.
+ *
+ * @param table The table.
+ * @param entrySize The size of every entry.
+ *
+ * @return This function does not return a value.
+ */
+void tableInit(table_t *table, size_t entrySize);
+
+/**
+ * @brief Allocates the page that holds the specified entry.
+ *
+ * The page directory grows as needed, and the entries of the new page are zero-initialized.
+ *
+ * @param table The table.
+ * @param index The index of the entry.
+ *
+ * @return The function returns a pointer to the entry.
+ */
+void *tableGrow(table_t *table, size_t index);
+
+/**
+ * @brief Looks up an entry without allocating it.
+ *
+ * @param table The table.
+ * @param index The index of the entry.
+ *
+ * @return The function returns a pointer to the entry, or NULL if its page has not been allocated.
+ */
+static inline void *tableFind(const table_t *table, size_t index)
+{
+    size_t page = index >> TABLE_PAGE_BITS;
+
+    if (page >= table->pageCount || table->pages[page] == NULL)
+        return NULL;
+
+    return table->pages[page] + (index & (TABLE_PAGE_ENTRIES - 1)) * table->entrySize;
+}
+
+/**
+ * @brief Gets an entry, allocating its page if needed.
+ *
+ * @param table The table.
+ * @param index The index of the entry.
+ *
+ * @return The function returns a pointer to the entry. Entries that were never written are zero.
+ */
+static inline void *tableAt(table_t *table, size_t index)
+{
+    void *entry = tableFind(table, index);
+    return entry != NULL ? entry : tableGrow(table, index);
+}
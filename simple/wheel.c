@@ -0,0 +1,219 @@
+/**
+ * @file wheel.c
+ * @brief This file contains the implementation of the hierarchical timing wheel.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#include <limits.h>
+#include <time.h>
+#include "wheel.h"
+
+#define WHEEL_SPAN (((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+#define LEVEL_SPAN(level) ((uint64_t)1 << (WHEEL_BITS * (level)))
+
+/**
+ * @brief Links a timer into the slot that corresponds to its deadline.
+ *
+ * The level is the lowest one whose turn covers the distance to the deadline.
+ *
+ * @param wheel The wheel.
+ * @param timer The timer, which must not be linked.
+ *
+ * @return This function does not return a value.
+ */
+static void insert(wheel_t *wheel, wheel_timer_t *timer)
+{
+    uint64_t delta = timer->expires - wheel->current;
+    int level = 0;
+
+    while (level < WHEEL_LEVELS - 1 && delta >= LEVEL_SPAN(level + 1))
+        level++;
+
+    wheel_link_t *slot = &wheel->slots[level][(timer->expires >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)];
+    timer->level = level;
+    timer->link.prev = slot->prev;
+    timer->link.next = slot;
+    slot->prev->next = &timer->link;
+    slot->prev = &timer->link;
+    wheel->counts[level]++;
+}
+
+/**
+ * @brief Moves the timers of the current slot of a level to the levels below it.
+ *
+ * @param wheel The wheel.
+ * @param level The level, which must be above the lowest one.
+ *
+ * @return This function does not return a value.
+ */
+static void cascade(wheel_t *wheel, int level)
+{
+    wheel_link_t *slot = &wheel->slots[level][(wheel->current >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)];
+
+    while (slot->next != slot)
+    {
+        wheel_timer_t *timer = (wheel_timer_t *)slot->next;
+        slot->next = timer->link.next;
+        timer->link.next->prev = slot;
+        wheel->counts[level]--;
+        insert(wheel, timer);
+    }
+}
+
+// Initializes an empty wheel starting at the current time.
+
+void wheelInit(wheel_t *wheel)
+{
+    wheel->current = wheelNow();
+    wheel->count = 0;
+
+    for (int level = 0; level < WHEEL_LEVELS; level++)
+    {
+        wheel->counts[level] = 0;
+
+        for (int i = 0; i < WHEEL_SLOTS; i++)
+            wheel->slots[level][i].prev = wheel->slots[level][i].next = &wheel->slots[level][i];
+    }
+}
+
+// Gets the current time of the monotonic clock.
+
+uint64_t wheelNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+// Adds a timer to the wheel, removing it first from any wheel it was in.
+
+void wheelAdd(wheel_t *wheel, wheel_timer_t *timer, uint64_t deadline)
+{
+    wheelCancel(timer);
+
+    if (deadline < wheel->current)
+        deadline = wheel->current;
+    else if (deadline - wheel->current > WHEEL_SPAN)
+        deadline = wheel->current + WHEEL_SPAN;
+
+    timer->expires = deadline;
+    timer->wheel = wheel;
+    wheel->count++;
+    insert(wheel, timer);
+}
+
+// Removes a timer from its wheel.
+
+void wheelCancel(wheel_timer_t *timer)
+{
+    if (timer->wheel == NULL)
+        return;
+
+    timer->link.prev->next = timer->link.next;
+    timer->link.next->prev = timer->link.prev;
+    timer->wheel->counts[timer->level]--;
+    timer->wheel->count--;
+    timer->wheel = NULL;
+}
+
+// Advances the wheel to the specified time, expiring the timers whose deadline has passed.
+
+void wheelAdvance(wheel_t *wheel, uint64_t time)
+{
+    while (wheel->current <= time)
+    {
+        int empty = 0;
+
+        while (empty < WHEEL_LEVELS && wheel->counts[empty] == 0)
+            empty++;
+
+        if (empty == WHEEL_LEVELS)
+        {
+            wheel->current = time + 1;
+            return;
+        }
+
+        wheel_link_t expired = {&expired, &expired};
+
+        if (empty == 0)
+        {
+            // Take the timers of the current tick out of the wheel, so the ones added while they expire go to later ticks.
+            wheel_link_t *slot = &wheel->slots[0][wheel->current & (WHEEL_SLOTS - 1)];
+
+            if (slot->next != slot)
+            {
+                expired.next = slot->next;
+                expired.prev = slot->prev;
+                expired.next->prev = &expired;
+                expired.prev->next = &expired;
+                slot->next = slot->prev = slot;
+            }
+
+            wheel->current++;
+        }
+        else
+        {
+            // The lower levels are empty, so skip straight to the next turn of the lowest level with timers.
+            uint64_t next = (wheel->current / LEVEL_SPAN(empty) + 1) * LEVEL_SPAN(empty);
+
+            if (next > time + 1)
+            {
+                wheel->current = time + 1;
+                return;
+            }
+
+            wheel->current = next;
+        }
+
+        // Move the timers down when levels complete a turn, starting from the highest one.
+        int level = 0;
+
+        while (level < WHEEL_LEVELS - 1 && (wheel->current & (LEVEL_SPAN(level + 1) - 1)) == 0)
+            level++;
+
+        for (; level > 0; level--)
+            cascade(wheel, level);
+
+        // The expired timers are still pending until their turn comes, so the callbacks may cancel them.
+        while (expired.next != &expired)
+        {
+            wheel_timer_t *timer = (wheel_timer_t *)expired.next;
+            wheelCancel(timer);
+            timer->expire(timer);
+        }
+    }
+}
+
+// Computes how long the event loop may wait before the wheel needs to be advanced.
+
+int wheelTimeout(const wheel_t *wheel, uint64_t time)
+{
+    if (wheel->count == 0)
+        return -1;
+
+    uint64_t next;
+
+    if (wheel->counts[0] > 0)
+    {
+        next = wheel->current;
+
+        while (wheel->slots[0][next & (WHEEL_SLOTS - 1)].next == &wheel->slots[0][next & (WHEEL_SLOTS - 1)])
+            next++;
+    }
+    else
+    {
+        int level = 1;
+
+        while (wheel->counts[level] == 0)
+            level++;
+
+        next = (wheel->current / LEVEL_SPAN(level) + 1) * LEVEL_SPAN(level);
+    }
+
+    if (next <= time)
+        return 0;
+
+    return next - time > INT_MAX ? INT_MAX : (int)(next - time);
+}
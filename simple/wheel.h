@@ -0,0 +1,104 @@
+/**
+ * @file wheel.h
+ * @brief This file contains the declaration of the wheel_t and wheel_timer_t data structures and related functions.
+ *
+ * A wheel keeps the timers of an event loop in a hierarchical timing wheel with a resolution of one millisecond.
+ * Every level has WHEEL_SLOTS slots, and each slot of a level spans a whole turn of the level below it, so adding and
+ * cancelling a timer take constant time. As time advances, the timers of a slot are moved down one level when the level
+ * below completes a turn, and they expire when their slot in the lowest level is reached.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+
+typedef struct wheel_link_t
+{
+    struct wheel_link_t *prev;
+    struct wheel_link_t *next;
+} wheel_link_t;
+
+typedef struct wheel_timer_t
+{
+    wheel_link_t link;     // Position in the slot. It must be the first member.
+    struct wheel_t *wheel; // The wheel that holds the timer, or NULL if it is not pending.
+    uint64_t expires;
+    int level;
+    void (*expire)(struct wheel_timer_t *timer); // Called when the timer expires. The timer is no longer pending at that point.
+} wheel_timer_t;
+
+typedef struct wheel_t
+{
+    uint64_t current; // The next tick to be processed.
+    size_t count;
+    size_t counts[WHEEL_LEVELS];
+    wheel_link_t slots[WHEEL_LEVELS][WHEEL_SLOTS];
+} wheel_t;
+
+/**
+ * @brief Initializes an empty wheel starting at the current time.
+ *
+ * @param wheel The wheel.
+ *
+ * @return This function does not return a value.
+ */
+void wheelInit(wheel_t *wheel);
+
+/**
+ * @brief Gets the current time of the monotonic clock.
+ *
+ * @return The function returns the time in milliseconds.
+ */
+uint64_t wheelNow();
+
+/**
+ * @brief Adds a timer to the wheel, removing it first from any wheel it was in.
+ *
+ * Deadlines further away than the span of the wheel are clamped to it.
+ *
+ * @param wheel The wheel.
+ * @param timer The timer. Its expire callback must be set, and it must be zeroed before its first use.
+ * @param deadline The time, in milliseconds of the monotonic clock, at which the timer expires.
+ *
+ * @return This function does not return a value.
+ */
+void wheelAdd(wheel_t *wheel, wheel_timer_t *timer, uint64_t deadline);
+
+/**
+ * @brief Removes a timer from its wheel. Nothing happens if the timer is not pending.
+ *
+ * @param timer The timer.
+ *
+ * @return This function does not return a value.
+ */
+void wheelCancel(wheel_timer_t *timer);
+
+/**
+ * @brief Advances the wheel to the specified time, expiring the timers whose deadline has passed.
+ *
+ * @param wheel The wheel.
+ * @param time The current time, in milliseconds.
+ *
+ * @return This function does not return a value.
+ */
+void wheelAdvance(wheel_t *wheel, uint64_t time);
+
+/**
+ * @brief Computes how long the event loop may wait before the wheel needs to be advanced.
+ *
+ * The result may be shorter than the time to the next deadline when timers have to be moved down a level first.
+ *
+ * @param wheel The wheel.
+ * @param time The current time, in milliseconds.
+ *
+ * @return The function returns the number of milliseconds to wait, or -1 if the wheel is empty.
+ */
+int wheelTimeout(const wheel_t *wheel, uint64_t time);
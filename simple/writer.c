@@ -0,0 +1,259 @@
+/**
+ * @file writer.c
+ * @brief This file contains the implementation of the output writer.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "metrics.h"
+#include "sink.h"
+#include "writer.h"
+
+#define WRITER_BATCH 64
+
+#define die(msg)     \
+    {                \
+        perror(msg); \
+        abort();     \
+    }
+
+typedef struct overflow_t
+{
+    payload_t payload;
+    struct overflow_t *next;
+} overflow_t;
+
+static sink_t *sink;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static payload_t *queue;
+static size_t capacity;
+static size_t head;
+static size_t count;
+static size_t maxDepth;
+static int stopping;
+static pthread_t thread;
+
+static atomic_size_t overflowed;
+static atomic_ulong payloads;
+static atomic_ulong bytes;
+static atomic_ulong batches;
+static atomic_ulong backpressure;
+
+// Payloads held by the calling loop while the queue is full.
+
+static _Thread_local overflow_t *overflowHead;
+static _Thread_local overflow_t *overflowTail;
+static _Thread_local size_t overflowCount;
+
+/**
+ * @brief Passes a batch of payloads to the sink and releases their chunks and spill files.
+ *
+ * @param batch The payloads.
+ * @param n The number of payloads.
+ *
+ * @return This function does not return a value.
+ */
+static void writeBatch(payload_t *batch, size_t n)
+{
+    uint64_t start = metricsNanos();
+    size_t total = sink->write(sink, batch, n);
+    metricsOutput(metricsNanos() - start);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (batch[i].records != NULL)
+        {
+            chunkReleaseRemote(batch[i].pool, batch[i].head, batch[i].tail);
+            free(batch[i].records);
+        }
+        else if (batch[i].head != NULL)
+            chunkPutRemote(batch[i].pool, batch[i].head, batch[i].tail);
+
+        if (batch[i].fileSize > 0)
+            close(batch[i].file);
+    }
+
+    atomic_fetch_add_explicit(&payloads, n, memory_order_relaxed);
+    atomic_fetch_add_explicit(&bytes, total, memory_order_relaxed);
+    atomic_fetch_add_explicit(&batches, 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Main loop of the output writer thread.
+ *
+ * Once the thread is asked to stop, it goes on until the queue is empty.
+ *
+ * @param arg Unused.
+ *
+ * @return This function returns NULL once the writer is stopped.
+ */
+static void *writerRun(void *arg)
+{
+    payload_t batch[WRITER_BATCH];
+    (void)arg;
+
+    while (1)
+    {
+        pthread_mutex_lock(&mutex);
+
+        while (count == 0 && !stopping)
+            pthread_cond_wait(&cond, &mutex);
+
+        if (count == 0)
+        {
+            pthread_mutex_unlock(&mutex);
+            return NULL;
+        }
+
+        size_t n = count < WRITER_BATCH ? count : WRITER_BATCH;
+
+        for (size_t i = 0; i < n; i++)
+            batch[i] = queue[(head + i) % capacity];
+
+        head = (head + n) % capacity;
+        count -= n;
+        pthread_mutex_unlock(&mutex);
+
+        writeBatch(batch, n);
+    }
+}
+
+/**
+ * @brief Tries to add a payload to the queue.
+ *
+ * @param payload The payload.
+ *
+ * @return The function returns a non-zero value if the payload was queued, or 0 if the queue is full.
+ */
+static int tryPush(const payload_t *payload)
+{
+    pthread_mutex_lock(&mutex);
+
+    if (count == capacity)
+    {
+        pthread_mutex_unlock(&mutex);
+        return 0;
+    }
+
+    queue[(head + count) % capacity] = *payload;
+
+    if (++count > maxDepth)
+        maxDepth = count;
+
+    if (count == 1)
+        pthread_cond_signal(&cond);
+
+    pthread_mutex_unlock(&mutex);
+    return 1;
+}
+
+// Starts the output writer thread.
+
+void writerStart(size_t size, sink_t *destination)
+{
+    sink = destination;
+    queue = calloc(size, sizeof(payload_t));
+    capacity = size;
+
+    if (queue == NULL)
+        die("calloc");
+
+    if (pthread_create(&thread, NULL, writerRun, NULL) != 0)
+        die("pthread_create");
+}
+
+// Writes the payloads left in the queue, stops the output writer thread and closes the sink.
+
+void writerStop()
+{
+    pthread_mutex_lock(&mutex);
+    stopping = 1;
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(thread, NULL);
+
+    if (sink->close != NULL)
+        sink->close(sink);
+}
+
+// Hands a payload over to the output writer.
+
+void writerSubmit(const payload_t *payload)
+{
+    if (overflowHead == NULL && tryPush(payload))
+        return;
+
+    overflow_t *node = malloc(sizeof(overflow_t));
+
+    if (node == NULL)
+        die("malloc");
+
+    node->payload = *payload;
+    node->next = NULL;
+
+    if (overflowTail != NULL)
+        overflowTail->next = node;
+    else
+        overflowHead = node;
+
+    overflowTail = node;
+    overflowCount++;
+    atomic_fetch_add_explicit(&overflowed, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&backpressure, 1, memory_order_relaxed);
+}
+
+// Moves the payloads held by the calling thread into the queue, as long as there is room.
+
+void writerFlush()
+{
+    while (overflowHead != NULL && tryPush(&overflowHead->payload))
+    {
+        overflow_t *node = overflowHead;
+        overflowHead = node->next;
+
+        if (overflowHead == NULL)
+            overflowTail = NULL;
+
+        free(node);
+        overflowCount--;
+        atomic_fetch_sub_explicit(&overflowed, 1, memory_order_relaxed);
+    }
+}
+
+// Checks whether the calling thread holds payloads waiting for room in the queue.
+
+int writerPending()
+{
+    return overflowHead != NULL;
+}
+
+// Checks whether the calling thread holds as many payloads as the queue takes.
+
+int writerFull()
+{
+    return overflowCount >= capacity;
+}
+
+// Retrieves the statistics of the output writer.
+
+void writerStats(writer_stats_t *stats)
+{
+    pthread_mutex_lock(&mutex);
+    stats->depth = count;
+    stats->maxDepth = maxDepth;
+    pthread_mutex_unlock(&mutex);
+
+    stats->overflow = atomic_load_explicit(&overflowed, memory_order_relaxed);
+    stats->payloads = atomic_load_explicit(&payloads, memory_order_relaxed);
+    stats->bytes = atomic_load_explicit(&bytes, memory_order_relaxed);
+    stats->batches = atomic_load_explicit(&batches, memory_order_relaxed);
+    stats->backpressure = atomic_load_explicit(&backpressure, memory_order_relaxed);
+}
@@ -0,0 +1,119 @@
+/**
+ * @file writer.h
+ * @brief This file contains the declaration of the output writer.
+ *
+ * The output writer prints the completed payloads on a dedicated thread, so that a slow standard output
+ * never stalls the event loops. The loops hand the payloads over through a bounded queue, and the writer
+ * passes them in batches to its sink, returning the chunks to the pools they came from.
+ * While the queue is full, every loop holds its payloads in order, and once it holds as many as the queue takes,
+ * it stops reading until the writer catches up, so a slow output pushes back on the clients instead of filling the memory.
+ * A payload either owns a chain of chunks, or a spill file that the writer closes once the sink has copied it,
+ * or holds records: views into chunks that it shares with a buffer.
+ *
+ * @author Vikman Fernandez-Castro
+ * @date July 7, 2024
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include "chunk.h"
+
+struct sink_t;
+
+typedef struct record_t
+{
+    chunk_t *chunk; // The chunk where the record starts.
+    size_t offset;  // The position of the record in its first chunk.
+    size_t length;  // The size of the record, which may continue in the following chunks.
+} record_t;
+
+typedef struct payload_t
+{
+    chunk_pool_t *pool; // The pool that owns the chunks.
+    chunk_t *head;      // The first chunk of the data.
+    chunk_t *tail;      // The last chunk of the data.
+    char header[64];    // Text written before the data.
+    size_t headerLength;
+    const char *trailer; // Text written after the data. It must be a string literal.
+    record_t *records;   // The records, allocated with malloc(), or NULL to write the whole chain.
+    size_t recordCount;  // The number of records. The payload holds a reference to every chunk from head to tail.
+    int sock;            // The socket the data came from.
+    unsigned long conn;     // The identifier of the connection the data came from.
+    unsigned long sequence; // The number of the first record, or of the segment in streaming mode, in the connection.
+    int partial;            // Whether the last record was cut short by the end of the connection.
+    int file;               // The spill file that holds the data instead of the chunks.
+    size_t fileSize;        // The size of the data in the spill file, or 0 if there is no file.
+} payload_t;
+
+typedef struct writer_stats_t
+{
+    size_t depth;               // The number of payloads in the queue.
+    size_t maxDepth;            // The highest number of payloads in the queue so far.
+    size_t overflow;            // The number of payloads held by the loops because the queue was full.
+    unsigned long payloads;     // The number of payloads written.
+    unsigned long bytes;        // The number of bytes written.
+    unsigned long batches;      // The number of batches written.
+    unsigned long backpressure; // The number of payloads that found the queue full.
+} writer_stats_t;
+
+/**
+ * @brief Starts the output writer thread.
+ *
+ * @param capacity The maximum number of payloads in the queue, and in the overflow of every loop.
+ * @param sink The destination of the payloads.
+ *
+ * @return This function does not return a value.
+ */
+void writerStart(size_t capacity, struct sink_t *sink);
+
+/**
+ * @brief Writes the payloads left in the queue, stops the output writer thread and closes the sink.
+ *
+ * The payloads submitted afterwards, or still held by the loops, are not written.
+ *
+ * @return This function does not return a value.
+ */
+void writerStop();
+
+/**
+ * @brief Hands a payload over to the output writer.
+ *
+ * This function never blocks. If the queue is full, or earlier payloads from the calling thread are still waiting,
+ * the payload is held by the calling thread in arrival order until writerFlush() finds room for it.
+ *
+ * @param payload The payload. The writer takes ownership of its chunks, or of its references to them and its records.
+ *
+ * @return This function does not return a value.
+ */
+void writerSubmit(const payload_t *payload);
+
+/**
+ * @brief Moves the payloads held by the calling thread into the queue, as long as there is room.
+ *
+ * @return This function does not return a value.
+ */
+void writerFlush();
+
+/**
+ * @brief Checks whether the calling thread holds payloads waiting for room in the queue.
+ *
+ * @return The function returns a non-zero value if there are payloads waiting.
+ */
+int writerPending();
+
+/**
+ * @brief Checks whether the calling thread holds as many payloads as the queue takes, so it must stop reading.
+ *
+ * @return The function returns a non-zero value if the overflow of the calling thread is full.
+ */
+int writerFull();
+
+/**
+ * @brief Retrieves the statistics of the output writer.
+ *
+ * @param stats Output parameter that receives the statistics.
+ *
+ * @return This function does not return a value.
+ */
+void writerStats(writer_stats_t *stats);